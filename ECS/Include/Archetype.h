@@ -0,0 +1,197 @@
+// The MIT License (MIT)
+//
+// 	Copyright (c) 2017 Sergey Makeev
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy
+// 	of this software and associated documentation files (the "Software"), to deal
+// 	in the Software without restriction, including without limitation the rights
+// 	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// 	copies of the Software, and to permit persons to whom the Software is
+// 	furnished to do so, subject to the following conditions:
+//
+//      The above copyright notice and this permission notice shall be included in
+// 	all copies or substantial portions of the Software.
+//
+// 	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// 	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// 	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// 	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// 	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// 	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// 	THE SOFTWARE.
+#pragma once
+
+
+#include <stdint.h>
+#include <assert.h>
+#include <unordered_map>
+#include "BitSet.h"
+#include "Memory.h"
+#include "Utils.h"
+
+
+namespace ecs
+{
+	typedef uint16_t ArchetypeId;
+
+
+	//
+	// Archetype table (interned entity components masks)
+	//
+	//  Every unique combination of the components is stored only once and entities keep a 16-bit archetype id instead of the mask.
+	//  Adding/removing a component is a cached transition (archetype + component -> archetype),
+	//  the mask is built and interned only the first time the transition is taken.
+	//
+	//  Archetypes are never removed (ids stay valid until clear), so the per-archetype caches only need to evaluate the new archetypes.
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	class archetype_table
+	{
+		// archetype id -> components mask
+		ecs::vector<bitset> masks;
+
+		// mask hash -> archetype id
+		std::unordered_multimap<uint64_t, ArchetypeId> lookup;
+
+		// (archetype, component, add/remove) -> archetype
+		std::unordered_map<uint32_t, ArchetypeId> transitions;
+
+		// incremented by clear() (archetype ids are reused for the different masks)
+		uint32_t generation;
+
+		// non copyable
+		archetype_table(archetype_table&);
+		void operator=(archetype_table&);
+
+		static uint64_t hash(const bitset& mask);
+
+		static uint32_t transition_key(ArchetypeId archetype, uint32_t componentTypeIndex, bool isRemove)
+		{
+			assert(componentTypeIndex < bitset::MaxBitCount::value);
+			return (uint32_t(archetype) << 16) | (componentTypeIndex << 1) | (isRemove ? 1 : 0);
+		}
+
+		ArchetypeId transition(ArchetypeId archetype, uint32_t componentTypeIndex, bool isRemove);
+
+	public:
+
+		// archetype without components
+		static const ArchetypeId emptyArchetype = 0;
+
+		archetype_table();
+
+		// archetype id of the mask (creates a new archetype if the mask is not interned yet)
+		ArchetypeId intern(const bitset& mask);
+
+		ArchetypeId add_component(ArchetypeId archetype, uint32_t componentTypeIndex)
+		{
+			return transition(archetype, componentTypeIndex, false);
+		}
+
+		ArchetypeId remove_component(ArchetypeId archetype, uint32_t componentTypeIndex)
+		{
+			return transition(archetype, componentTypeIndex, true);
+		}
+
+		// note: the reference is valid until the next intern() / add_component() / remove_component() call
+		const bitset& mask(ArchetypeId archetype) const
+		{
+			assert(archetype < masks.size());
+			return masks[archetype];
+		}
+
+		const bitset* data() const
+		{
+			return masks.data();
+		}
+
+		// number of archetypes
+		uint32_t size() const
+		{
+			return narrow_cast<uint32_t>(masks.size());
+		}
+
+		uint32_t get_generation() const
+		{
+			return generation;
+		}
+
+		// remove all the archetypes (except the empty one), all the archetype ids become invalid
+		void clear();
+	};
+
+
+	//
+	// Per-archetype cached results of the aspect matching
+	//
+	//  isMatch[archetype] = filter.match(mask(archetype)), evaluated once per archetype (see internal::MatchMasks),
+	//  so matching of the entity is a table lookup and matching of the query is O(archetypes).
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	class archetype_match_cache
+	{
+		aspect_filter filter;
+		ecs::vector<uint8_t> isMatch;
+
+		// generation of the archetype table the results were evaluated for
+		uint32_t generation;
+
+	public:
+
+		archetype_match_cache()
+			: generation(0)
+		{
+		}
+
+		explicit archetype_match_cache(const aspect_filter& _filter)
+			: filter(_filter)
+			, generation(0)
+		{
+		}
+
+		// change the aspect (all the cached results are invalidated)
+		void reset(const aspect_filter& _filter)
+		{
+			filter = _filter;
+			isMatch.clear();
+		}
+
+		// evaluate the archetypes created since the last update
+		void update(const archetype_table& archetypes)
+		{
+			// archetype table was cleared, all the results are stale
+			if (generation != archetypes.get_generation())
+			{
+				generation = archetypes.get_generation();
+				isMatch.clear();
+			}
+
+			uint32_t archetypesCount = archetypes.size();
+			uint32_t first = narrow_cast<uint32_t>(isMatch.size());
+			if (first == archetypesCount)
+			{
+				return;
+			}
+
+			isMatch.resize(archetypesCount);
+			internal::MatchMasks(filter, archetypes.data() + first, archetypesCount - first, isMatch.data() + first);
+		}
+
+		bool is_match(ArchetypeId archetype) const
+		{
+			assert(archetype < isMatch.size() && "Cache is out of date, call update()");
+			return isMatch[archetype] != 0;
+		}
+
+		const uint8_t* data() const
+		{
+			return isMatch.data();
+		}
+
+		const aspect_filter& aspect() const
+		{
+			return filter;
+		}
+	};
+
+}
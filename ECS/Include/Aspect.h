@@ -31,16 +31,7 @@
 // Generate bitset from template params
 //
 #define GENERATE_MASK_FOR_PARAM(NUM)                                                                            \
-{                                                                                                               \
-	const uint32_t componentTypeIndex = ecs::GetComponentTypeIndex<std::remove_const<T##NUM>::type>();          \
-	componentsMask.set(componentTypeIndex);                                                                     \
-	                                                                                                            \
-	const bool isReadOnlyAccess = std::is_const< T##NUM >::value;                                               \
-	if (isReadOnlyAccess)                                                                                       \
-	{                                                                                                           \
-		accesTypeReadOnlyMask.set(componentTypeIndex);                                                          \
-	}                                                                                                           \
-}                                                                                                               \
+	ecs::internal::aspect_param< T##NUM >::GenerateMask(filter, accesTypeReadOnlyMask);                         \
 
 
 // T0 - source type (int)
@@ -64,6 +55,94 @@ namespace ecs
 	typedef char FinalComponentTypeValue;
 
 
+	//
+	// Aspect filter markers (affect only the matching, the aspect gets nullptr instead of the component pointer)
+	//
+	//  Without<T>    - entity must not have the component T                 ( Aspect<Pos, Without<Sleeping>> )
+	//  AnyOf<T...>   - entity must have at least one of the components T... ( Aspect<Pos, AnyOf<Player, Enemy>> )
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename T>
+	struct Without
+	{
+	};
+
+	template<typename... T>
+	struct AnyOf
+	{
+	};
+
+
+	namespace internal
+	{
+		// aspect parameter: regular component
+		template<typename T>
+		struct aspect_param
+		{
+			static inline void GenerateMask(aspect_filter& filter, bitset& accesTypeReadOnlyMask)
+			{
+				const uint32_t componentTypeIndex = ecs::GetComponentTypeIndex<typename std::remove_const<T>::type>();
+				filter.required.set(componentTypeIndex);
+
+				const bool isReadOnlyAccess = std::is_const<T>::value;
+				if (isReadOnlyAccess)
+				{
+					accesTypeReadOnlyMask.set(componentTypeIndex);
+				}
+			}
+
+			static ecs_force_inline T* Get(const EntityId id)
+			{
+				return ecs::GetComponent<T>(id);
+			}
+
+			static ecs_force_inline const T* Get(const ConstEntityId id)
+			{
+				return ecs::GetComponent<T>(id);
+			}
+		};
+
+		// aspect parameter: excluded component
+		template<typename T>
+		struct aspect_param< Without<T> >
+		{
+			static inline void GenerateMask(aspect_filter& filter, bitset& /*accesTypeReadOnlyMask*/)
+			{
+				filter.excluded.set(ecs::GetComponentTypeIndex<typename std::remove_const<T>::type>());
+			}
+
+			template<typename TId>
+			static ecs_force_inline std::nullptr_t Get(const TId /*id*/)
+			{
+				return nullptr;
+			}
+		};
+
+		// aspect parameter: at least one of the components
+		template<typename... T>
+		struct aspect_param< AnyOf<T...> >
+		{
+			static_assert(sizeof...(T) > 0, "AnyOf needs at least one component type");
+
+			static inline void GenerateMask(aspect_filter& filter, bitset& /*accesTypeReadOnlyMask*/)
+			{
+				const uint32_t componentTypeIndices[] = { ecs::GetComponentTypeIndex<typename std::remove_const<T>::type>()... };
+				for (uint32_t componentTypeIndex : componentTypeIndices)
+				{
+					filter.anyOf.set(componentTypeIndex);
+				}
+			}
+
+			template<typename TId>
+			static ecs_force_inline std::nullptr_t Get(const TId /*id*/)
+			{
+				return nullptr;
+			}
+		};
+	}
+
+
+
 
 	//
 	//
@@ -80,7 +159,7 @@ namespace ecs
 	{
 		Aspect()
 		{
-			static_assert(false, "Partial template specialization goes wrong (too many params?)");
+			static_assert(sizeof(T0) == 0, "Partial template specialization goes wrong (too many params?)");
 		}
 	};
 
@@ -91,7 +170,7 @@ namespace ecs
 	template<typename T0>
 	struct Aspect<T0, UnusedComponentTypeValue, UnusedComponentTypeValue, FinalComponentTypeValue>
 	{
-		typedef typename Aspect<T0, UnusedComponentTypeValue, UnusedComponentTypeValue, FinalComponentTypeValue> ThisType;
+		typedef Aspect<T0, UnusedComponentTypeValue, UnusedComponentTypeValue, FinalComponentTypeValue> ThisType;
 		DECLARE_ADDITIONAL_TYPES(0);
 
 		struct Const
@@ -103,7 +182,7 @@ namespace ecs
 			{
 				ThisType::Const r;
 				r.id = id;
-				r.c0 = ecs::GetComponent<T0>(id);
+				r.c0 = internal::aspect_param<T0>::Get(id);
 				return r;
 			}
 		};
@@ -112,16 +191,26 @@ namespace ecs
 		EntityId id;
 		P0 c0;
 		
-		static inline void GenerateMask(bitset& componentsMask, bitset& accesTypeReadOnlyMask)
+		// required / excluded / any-of components (see Without, AnyOf)
+		static inline void GenerateMask(aspect_filter& filter, bitset& accesTypeReadOnlyMask)
 		{
 			GENERATE_MASK_FOR_PARAM(0);
 		}
 
+		// required components only
+		static inline void GenerateMask(bitset& componentsMask, bitset& accesTypeReadOnlyMask)
+		{
+			aspect_filter filter(componentsMask);
+			GenerateMask(filter, accesTypeReadOnlyMask);
+			assert(filter.excluded.empty() && filter.anyOf.empty() && "Aspect has Without/AnyOf params, use GenerateMask(aspect_filter&, bitset&)");
+			componentsMask = filter.required;
+		}
+
 		static ecs_force_inline ThisType Create(const EntityId id)
 		{
 			ThisType r;
 			r.id = id;
-			r.c0 = ecs::GetComponent<T0>(id);
+			r.c0 = internal::aspect_param<T0>::Get(id);
 			return r;
 		}
 
@@ -135,7 +224,7 @@ namespace ecs
 	template<typename T0, typename T1>
 	struct Aspect<T0, T1, UnusedComponentTypeValue, FinalComponentTypeValue>
 	{
-		typedef typename Aspect<T0, T1, UnusedComponentTypeValue, FinalComponentTypeValue> ThisType;
+		typedef Aspect<T0, T1, UnusedComponentTypeValue, FinalComponentTypeValue> ThisType;
 
 		DECLARE_ADDITIONAL_TYPES(0);
 		DECLARE_ADDITIONAL_TYPES(1);
@@ -150,8 +239,8 @@ namespace ecs
 			{
 				ThisType::Const r;
 				r.id = id;
-				r.c0 = ecs::GetComponent<T0>(id);
-				r.c1 = ecs::GetComponent<T1>(id);
+				r.c0 = internal::aspect_param<T0>::Get(id);
+				r.c1 = internal::aspect_param<T1>::Get(id);
 				return r;
 			}
 		};
@@ -161,18 +250,28 @@ namespace ecs
 		P0 c0;
 		P1 c1;
 
-		static inline void GenerateMask(bitset& componentsMask, bitset& accesTypeReadOnlyMask)
+		// required / excluded / any-of components (see Without, AnyOf)
+		static inline void GenerateMask(aspect_filter& filter, bitset& accesTypeReadOnlyMask)
 		{
 			GENERATE_MASK_FOR_PARAM(0);
 			GENERATE_MASK_FOR_PARAM(1);
 		}
 
+		// required components only
+		static inline void GenerateMask(bitset& componentsMask, bitset& accesTypeReadOnlyMask)
+		{
+			aspect_filter filter(componentsMask);
+			GenerateMask(filter, accesTypeReadOnlyMask);
+			assert(filter.excluded.empty() && filter.anyOf.empty() && "Aspect has Without/AnyOf params, use GenerateMask(aspect_filter&, bitset&)");
+			componentsMask = filter.required;
+		}
+
 		static ecs_force_inline ThisType Create(const EntityId id)
 		{
 			ThisType r;
 			r.id = id;
-			r.c0 = ecs::GetComponent<T0>(id);
-			r.c1 = ecs::GetComponent<T1>(id);
+			r.c0 = internal::aspect_param<T0>::Get(id);
+			r.c1 = internal::aspect_param<T1>::Get(id);
 			return r;
 		}
 	};
@@ -185,7 +284,7 @@ namespace ecs
 	template<typename T0, typename T1, typename T2>
 	struct Aspect<T0, T1, T2, FinalComponentTypeValue>
 	{
-		typedef typename Aspect<T0, T1, T2, FinalComponentTypeValue> ThisType;
+		typedef Aspect<T0, T1, T2, FinalComponentTypeValue> ThisType;
 
 		DECLARE_ADDITIONAL_TYPES(0);
 		DECLARE_ADDITIONAL_TYPES(1);
@@ -202,9 +301,9 @@ namespace ecs
 			{
 				ThisType::Const r;
 				r.id = id;
-				r.c0 = ecs::GetComponent<T0>(id);
-				r.c1 = ecs::GetComponent<T1>(id);
-				r.c2 = ecs::GetComponent<T2>(id);
+				r.c0 = internal::aspect_param<T0>::Get(id);
+				r.c1 = internal::aspect_param<T1>::Get(id);
+				r.c2 = internal::aspect_param<T2>::Get(id);
 				return r;
 			}
 		};
@@ -215,20 +314,30 @@ namespace ecs
 		P1 c1;
 		P2 c2;
 
-		static inline void GenerateMask(bitset& componentsMask, bitset& accesTypeReadOnlyMask)
+		// required / excluded / any-of components (see Without, AnyOf)
+		static inline void GenerateMask(aspect_filter& filter, bitset& accesTypeReadOnlyMask)
 		{
 			GENERATE_MASK_FOR_PARAM(0);
 			GENERATE_MASK_FOR_PARAM(1);
 			GENERATE_MASK_FOR_PARAM(2);
 		}
 
+		// required components only
+		static inline void GenerateMask(bitset& componentsMask, bitset& accesTypeReadOnlyMask)
+		{
+			aspect_filter filter(componentsMask);
+			GenerateMask(filter, accesTypeReadOnlyMask);
+			assert(filter.excluded.empty() && filter.anyOf.empty() && "Aspect has Without/AnyOf params, use GenerateMask(aspect_filter&, bitset&)");
+			componentsMask = filter.required;
+		}
+
 		static ecs_force_inline ThisType Create(const EntityId id)
 		{
 			ThisType r;
 			r.id = id;
-			r.c0 = ecs::GetComponent<T0>(id);
-			r.c1 = ecs::GetComponent<T1>(id);
-			r.c2 = ecs::GetComponent<T2>(id);
+			r.c0 = internal::aspect_param<T0>::Get(id);
+			r.c1 = internal::aspect_param<T1>::Get(id);
+			r.c2 = internal::aspect_param<T2>::Get(id);
 			return r;
 		}
 	};
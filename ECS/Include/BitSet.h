@@ -25,76 +25,141 @@
 #include <stdint.h>
 #include <assert.h>
 #include <cstring>
-#include <emmintrin.h> 
-#include <intrin.h>
+#include <type_traits>
+#include <emmintrin.h>
 
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#include "Platform.h"
 #include "Utils.h"
 
-/* gcc/clang - support
 
-unsigned char _BitScanForward(unsigned long* Index, unsigned long Mask)
+// Width of the entity components mask (maximum number of the component types): 64, 128, 256, 384, 512 or 1024 bits
+//   every archetype keeps one mask (see archetype_table), so the smaller mask means less memory and faster aspect matching
+#ifndef ECS_COMPONENT_MASK_BITS
+#define ECS_COMPONENT_MASK_BITS (384)
+#endif
+
+
+namespace ecs
 {
-	if (Mask == 0)
+	template<uint32_t BITS, int KIND> class basic_bitset_matcher;
+
+	namespace internal
 	{
-		return 0;
+		// 0 - one 64 bit register, 1 - one SSE register, 2 - several SIMD registers
+		template<uint32_t BITS>
+		struct bitset_kind : public std::integral_constant<int, (BITS == 64) ? 0 : ((BITS == 128) ? 1 : 2)>
+		{
+		};
+
+		// storage element of the bitset (64 bit mask doesn't need SSE alignment, 8 bytes per entity)
+		template<bool IS_SSE>
+		struct bitset_vector
+		{
+			typedef __m128i type;
+		};
+
+		template<>
+		struct bitset_vector<false>
+		{
+			typedef uint64_t type;
+		};
 	}
 
-	*Index = __builtin_ctz(Mask);
-	return 1;
-}
+	// bitset for BITS bits (BITS / 8 bytes)
+	template<uint32_t BITS>
+	class basic_bitset
+	{
+		static_assert(BITS == 64 || BITS == 128 || BITS == 256 || BITS == 384 || BITS == 512 || BITS == 1024, "Unsupported bitset width");
+
+		template<uint32_t, int> friend class basic_bitset_matcher;
 
+	public:
 
-*/
+		static const uint32_t dwordsCount = BITS / 32;
+		static const uint32_t qwordsCount = BITS / 64;
+		static const uint32_t sseCount = BITS / 128;
 
+	private:
+
+		typedef typename internal::bitset_vector<(BITS >= 128)>::type vector_type;
 
-namespace ecs
-{
-	// betset for 384 bits (48 bytes)
-	class bitset
-	{
-		// 12 * 4 = 48 bytes = 384 bits
 		union
 		{
-			__m128i sse_storage[3];
-			uint32_t storage[12];
+			vector_type sse_storage[BITS / (sizeof(vector_type) * 8)];
+			uint64_t qwords[qwordsCount];
+			uint32_t storage[dwordsCount];
 		};
 
+		void clear(std::integral_constant<bool, false>)
+		{
+			qwords[0] = 0;
+		}
+
+		void clear(std::integral_constant<bool, true>)
+		{
+			__m128i zero = _mm_setzero_si128();
+			for (uint32_t i = 0; i < sseCount; i++)
+			{
+				_mm_store_si128(&sse_storage[i], zero);
+			}
+		}
+
+		bool contains(const basic_bitset& other, std::integral_constant<bool, false>) const
+		{
+			return ((qwords[0] & other.qwords[0]) == other.qwords[0]);
+		}
+
+		bool contains(const basic_bitset& other, std::integral_constant<bool, true>) const
+		{
+			// missing bits = other & ~this
+			__m128i missing = _mm_andnot_si128(sse_storage[0], other.sse_storage[0]);
+			for (uint32_t i = 1; i < sseCount; i++)
+			{
+				missing = _mm_or_si128(missing, _mm_andnot_si128(sse_storage[i], other.sse_storage[i]));
+			}
+
+			// compare and move compare results into integer register
+			return (_mm_movemask_epi8(_mm_cmpeq_epi32(missing, _mm_setzero_si128())) == 0xFFFF);
+		}
+
 	public:
 
 		enum MaxBitCount
 		{
-			value = 384,
+			value = BITS,
 		};
 
 		class const_iterator
 		{
-			static const int32_t dwordsCount = 12;
-
-			const bitset* const object;
+			const basic_bitset* const object;
 			uint32_t currentDwordIndex;
 			uint32_t currentMask;
 			int32_t val;
 
 			int32_t FindNextEnabledBit()
 			{
-				char res = 0;
-				uint32_t bitIndex = (uint32_t)-1;
+				uint32_t v = 0;
 				for (; currentDwordIndex < dwordsCount; currentDwordIndex++, currentMask = 0xFFFFFFFF)
 				{
-					uint32_t v = object->storage[currentDwordIndex] & currentMask;
-					res = _BitScanForward((unsigned long*)&bitIndex, v);
-					if (res != 0)
+					v = object->storage[currentDwordIndex] & currentMask;
+					if (v != 0)
 					{
 						break;
 					}
 				}
 
 				// no more enabled bits
-				if (res == 0)
+				if (v == 0)
 				{
 					return -1;
 				}
 
+				uint32_t bitIndex = internal::BitScanForward(v);
+
 				assert(bitIndex < 32);
 
 				// update hide mask
@@ -105,7 +170,7 @@ namespace ecs
 
 		public:
 
-			const_iterator(const bitset* const p, uint32_t firstDwordIndex = 0)
+			const_iterator(const basic_bitset* const p, uint32_t firstDwordIndex = 0)
 				: object(p)
 				, currentDwordIndex(firstDwordIndex)
 				, currentMask(0xFFFFFFFF)
@@ -143,33 +208,32 @@ namespace ecs
 		};
 
 
-		bitset()
+		basic_bitset()
 		{
 			clear();
 		}
 
-		bitset(const bitset& other)
+		basic_bitset(const basic_bitset& other)
 		{
-			sse_storage[0] = other.sse_storage[0];
-			sse_storage[1] = other.sse_storage[1];
-			sse_storage[2] = other.sse_storage[2];
+			for (uint32_t i = 0; i < sizeof(sse_storage) / sizeof(sse_storage[0]); i++)
+			{
+				sse_storage[i] = other.sse_storage[i];
+			}
 		}
 
-		bitset& operator=(const bitset& other)
+		basic_bitset& operator=(const basic_bitset& other)
 		{
-			sse_storage[0] = other.sse_storage[0];
-			sse_storage[1] = other.sse_storage[1];
-			sse_storage[2] = other.sse_storage[2];
+			for (uint32_t i = 0; i < sizeof(sse_storage) / sizeof(sse_storage[0]); i++)
+			{
+				sse_storage[i] = other.sse_storage[i];
+			}
 			return *this;
 		}
 
 
 		void clear()
 		{
-			__m128i zero = _mm_setzero_si128();
-			_mm_store_si128(&sse_storage[0], zero);
-			_mm_store_si128(&sse_storage[1], zero);
-			_mm_store_si128(&sse_storage[2], zero);
+			clear(std::integral_constant<bool, (BITS >= 128)>());
 		}
 
 		void set(uint32_t index)
@@ -225,23 +289,38 @@ namespace ecs
 			return (storage[dwordIndex] & mask) != 0;
 		}
 
-		bool contains(const bitset& other) const
+		// true if all the bits of other are set in this bitset
+		bool contains(const basic_bitset& other) const
 		{
-			// and
-			__m128i a = _mm_and_si128(sse_storage[0], other.sse_storage[0] );
-			__m128i b = _mm_and_si128(sse_storage[1], other.sse_storage[1] );
-			__m128i c = _mm_and_si128(sse_storage[2], other.sse_storage[2] );
-
-			// compare and move compare results into integer register
-			int v0 = _mm_movemask_epi8(_mm_cmpeq_epi32(a, other.sse_storage[0]));
-			int v1 = _mm_movemask_epi8(_mm_cmpeq_epi32(b, other.sse_storage[1]));
-			int v2 = _mm_movemask_epi8(_mm_cmpeq_epi32(c, other.sse_storage[2]));
+			return contains(other, std::integral_constant<bool, (BITS >= 128)>());
+		}
 
-			// merge results
-			int res = v0 & v1 & v2;
+		// true if at least one bit of other is set in this bitset
+		bool intersects(const basic_bitset& other) const
+		{
+			uint64_t common = 0;
+			for (uint32_t i = 0; i < qwordsCount; i++)
+			{
+				common |= (qwords[i] & other.qwords[i]);
+			}
+			return (common != 0);
+		}
 
-			return (res == 0xFFFF);
+		// raw bits (qwordsCount 64 bit words)
+		const uint64_t* data() const
+		{
+			return qwords;
+		}
 
+		// true if no bits are set
+		bool empty() const
+		{
+			uint64_t any = 0;
+			for (uint32_t i = 0; i < qwordsCount; i++)
+			{
+				any |= qwords[i];
+			}
+			return (any == 0);
 		}
 
 		const_iterator begin() const
@@ -258,4 +337,314 @@ namespace ecs
 	};
 
 
-}
\ No newline at end of file
+	//
+	// Batch version of bitset::contains (test many masks against the same aspect mask)
+	//
+	//  The aspect mask is loaded into registers once:
+	//    64 bit   - general purpose register
+	//    128 bit  - one SSE register
+	//    wider    - AVX-512: 512-bit registers (masked load of the tail)
+	//               AVX2:    256-bit registers + 128-bit register for the tail
+	//               SSE2:    128-bit registers
+	//
+	//  mask.contains(aspect) == ((aspect & ~mask) == 0)
+	//
+	//  The instruction set is selected at compile time (__AVX2__ / __AVX512F__),
+	//  internal::MatchMasks is the batch version selected at runtime (one binary for all the hosts).
+	//
+	//  Optional excluded/any-of masks (see aspect_filter) are tested in the same pass:
+	//    (mask & required) == required && (mask & excluded) == 0 && (anyOf is empty || (mask & anyOf) != 0)
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<uint32_t BITS, int KIND = internal::bitset_kind<BITS>::value>
+	class basic_bitset_matcher
+	{
+		typedef basic_bitset<BITS> bitset_type;
+
+#if defined(__AVX512F__)
+		static const uint32_t zmmCount = (BITS + 511) / 512;
+		static const uint32_t tailDwords = (BITS % 512) / 32;
+		__m512i aspect[zmmCount];
+		__m512i excluded[zmmCount];
+		__m512i anyOf[zmmCount];
+
+		static __m512i load(const bitset_type& mask, uint32_t i)
+		{
+			__mmask16 loadMask = (i == zmmCount - 1 && tailDwords != 0) ? __mmask16((1 << tailDwords) - 1) : __mmask16(0xFFFF);
+			return _mm512_maskz_loadu_epi32(loadMask, mask.storage + i * 16);
+		}
+#elif defined(__AVX2__)
+		static const uint32_t ymmCount = BITS / 256;
+		static const uint32_t xmmTail = (BITS % 256) / 128;
+		__m256i aspect[ymmCount];
+		__m256i excluded[ymmCount];
+		__m256i anyOf[ymmCount];
+		__m128i aspectTail;
+		__m128i excludedTail;
+		__m128i anyOfTail;
+#else
+		__m128i aspect[bitset_type::sseCount];
+		__m128i excluded[bitset_type::sseCount];
+		__m128i anyOf[bitset_type::sseCount];
+#endif
+		// 1 if the any-of mask is empty (any-of test always passes)
+		int noAnyOf;
+
+		void init(const bitset_type& aspectMask, const bitset_type& excludedMask, const bitset_type& anyOfMask)
+		{
+#if defined(__AVX512F__)
+			for (uint32_t i = 0; i < zmmCount; i++)
+			{
+				aspect[i] = load(aspectMask, i);
+				excluded[i] = load(excludedMask, i);
+				anyOf[i] = load(anyOfMask, i);
+			}
+#elif defined(__AVX2__)
+			for (uint32_t i = 0; i < ymmCount; i++)
+			{
+				aspect[i] = _mm256_loadu_si256((const __m256i*)&aspectMask.sse_storage[i * 2]);
+				excluded[i] = _mm256_loadu_si256((const __m256i*)&excludedMask.sse_storage[i * 2]);
+				anyOf[i] = _mm256_loadu_si256((const __m256i*)&anyOfMask.sse_storage[i * 2]);
+			}
+			aspectTail = xmmTail ? aspectMask.sse_storage[ymmCount * 2] : _mm_setzero_si128();
+			excludedTail = xmmTail ? excludedMask.sse_storage[ymmCount * 2] : _mm_setzero_si128();
+			anyOfTail = xmmTail ? anyOfMask.sse_storage[ymmCount * 2] : _mm_setzero_si128();
+#else
+			for (uint32_t i = 0; i < bitset_type::sseCount; i++)
+			{
+				aspect[i] = aspectMask.sse_storage[i];
+				excluded[i] = excludedMask.sse_storage[i];
+				anyOf[i] = anyOfMask.sse_storage[i];
+			}
+#endif
+			noAnyOf = anyOfMask.empty() ? 1 : 0;
+		}
+
+	public:
+
+		explicit basic_bitset_matcher(const bitset_type& aspectMask)
+		{
+			bitset_type empty;
+			init(aspectMask, empty, empty);
+		}
+
+		basic_bitset_matcher(const bitset_type& aspectMask, const bitset_type& excludedMask, const bitset_type& anyOfMask)
+		{
+			init(aspectMask, excludedMask, anyOfMask);
+		}
+
+		// true if the mask contains all the bits of the aspect, none of the excluded bits and at least one any-of bit
+		bool match(const bitset_type& mask) const
+		{
+#if defined(__AVX512F__)
+			__mmask16 missing = 0;
+			__mmask16 hit = 0;
+			for (uint32_t i = 0; i < zmmCount; i++)
+			{
+				__m512i m = load(mask, i);
+				missing |= _mm512_cmpneq_epi32_mask(_mm512_and_si512(m, aspect[i]), aspect[i]);
+				missing |= _mm512_test_epi32_mask(m, excluded[i]);
+				hit |= _mm512_test_epi32_mask(m, anyOf[i]);
+			}
+			return (missing == 0) && ((hit != 0) | (noAnyOf != 0));
+#elif defined(__AVX2__)
+			int res = 1;
+			int hit = noAnyOf;
+			for (uint32_t i = 0; i < ymmCount; i++)
+			{
+				__m256i m = _mm256_loadu_si256((const __m256i*)&mask.sse_storage[i * 2]);
+				res &= _mm256_testc_si256(m, aspect[i]);
+				res &= _mm256_testz_si256(m, excluded[i]);
+				hit |= (1 - _mm256_testz_si256(m, anyOf[i]));
+			}
+			if (xmmTail)
+			{
+				__m128i m = mask.sse_storage[ymmCount * 2];
+				res &= _mm_testc_si128(m, aspectTail);
+				res &= _mm_testz_si128(m, excludedTail);
+				hit |= (1 - _mm_testz_si128(m, anyOfTail));
+			}
+			return ((res & hit) != 0);
+#else
+			// missing = (aspect & ~mask) | (excluded & mask), hit = anyOf & mask
+			__m128i missing = _mm_setzero_si128();
+			__m128i hit = _mm_setzero_si128();
+			for (uint32_t i = 0; i < bitset_type::sseCount; i++)
+			{
+				__m128i m = mask.sse_storage[i];
+				missing = _mm_or_si128(missing, _mm_or_si128(_mm_andnot_si128(m, aspect[i]), _mm_and_si128(m, excluded[i])));
+				hit = _mm_or_si128(hit, _mm_and_si128(m, anyOf[i]));
+			}
+			__m128i zero = _mm_setzero_si128();
+			bool isMissing = (_mm_movemask_epi8(_mm_cmpeq_epi32(missing, zero)) != 0xFFFF);
+			bool isHit = (_mm_movemask_epi8(_mm_cmpeq_epi32(hit, zero)) != 0xFFFF);
+			return !isMissing && (isHit || noAnyOf != 0);
+#endif
+		}
+
+		// bit i of the result is set if masks[i] matches (count <= 64)
+		uint64_t match_block(const bitset_type* masks, uint32_t count) const
+		{
+			assert(count <= 64);
+			uint64_t bits = 0;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				bits |= uint64_t(match(masks[i])) << i;
+			}
+			return bits;
+		}
+	};
+
+	// 64 bit mask (scalar)
+	template<uint32_t BITS>
+	class basic_bitset_matcher<BITS, 0>
+	{
+		typedef basic_bitset<BITS> bitset_type;
+		uint64_t aspect;
+		uint64_t excluded;
+		uint64_t anyOf;
+		bool noAnyOf;
+
+	public:
+
+		explicit basic_bitset_matcher(const bitset_type& aspectMask)
+			: aspect(aspectMask.qwords[0])
+			, excluded(0)
+			, anyOf(0)
+			, noAnyOf(true)
+		{
+		}
+
+		basic_bitset_matcher(const bitset_type& aspectMask, const bitset_type& excludedMask, const bitset_type& anyOfMask)
+			: aspect(aspectMask.qwords[0])
+			, excluded(excludedMask.qwords[0])
+			, anyOf(anyOfMask.qwords[0])
+			, noAnyOf(anyOfMask.qwords[0] == 0)
+		{
+		}
+
+		bool match(const bitset_type& mask) const
+		{
+			uint64_t m = mask.qwords[0];
+			return ((m & aspect) == aspect) & ((m & excluded) == 0) & (((m & anyOf) != 0) | noAnyOf);
+		}
+
+		uint64_t match_block(const bitset_type* masks, uint32_t count) const
+		{
+			assert(count <= 64);
+			uint64_t bits = 0;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				bits |= uint64_t(match(masks[i])) << i;
+			}
+			return bits;
+		}
+	};
+
+	// 128 bit mask (single SSE register)
+	template<uint32_t BITS>
+	class basic_bitset_matcher<BITS, 1>
+	{
+		typedef basic_bitset<BITS> bitset_type;
+		__m128i aspect;
+		__m128i excluded;
+		__m128i anyOf;
+		int noAnyOf;
+
+	public:
+
+		explicit basic_bitset_matcher(const bitset_type& aspectMask)
+			: aspect(aspectMask.sse_storage[0])
+			, excluded(_mm_setzero_si128())
+			, anyOf(_mm_setzero_si128())
+			, noAnyOf(1)
+		{
+		}
+
+		basic_bitset_matcher(const bitset_type& aspectMask, const bitset_type& excludedMask, const bitset_type& anyOfMask)
+			: aspect(aspectMask.sse_storage[0])
+			, excluded(excludedMask.sse_storage[0])
+			, anyOf(anyOfMask.sse_storage[0])
+			, noAnyOf(anyOfMask.empty() ? 1 : 0)
+		{
+		}
+
+		bool match(const bitset_type& mask) const
+		{
+			__m128i m = mask.sse_storage[0];
+			__m128i zero = _mm_setzero_si128();
+			__m128i missing = _mm_or_si128(_mm_andnot_si128(m, aspect), _mm_and_si128(m, excluded));
+			bool isMissing = (_mm_movemask_epi8(_mm_cmpeq_epi32(missing, zero)) != 0xFFFF);
+			bool isHit = (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(m, anyOf), zero)) != 0xFFFF);
+			return !isMissing && (isHit || noAnyOf != 0);
+		}
+
+		uint64_t match_block(const bitset_type* masks, uint32_t count) const
+		{
+			assert(count <= 64);
+			uint64_t bits = 0;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				bits |= uint64_t(match(masks[i])) << i;
+			}
+			return bits;
+		}
+	};
+
+
+	typedef basic_bitset<ECS_COMPONENT_MASK_BITS> bitset;
+	typedef basic_bitset_matcher<ECS_COMPONENT_MASK_BITS> bitset_matcher;
+
+
+	//
+	// Aspect matching rule (see Aspect, Without, AnyOf)
+	//
+	//  (mask & required) == required && (mask & excluded) == 0 && (anyOf is empty || (mask & anyOf) != 0)
+	//
+	//  A plain components mask converts to the filter with only the required bits.
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	struct aspect_filter
+	{
+		bitset required;
+		bitset excluded;
+		bitset anyOf;
+
+		aspect_filter()
+		{
+		}
+
+		aspect_filter(const bitset& _required)
+			: required(_required)
+		{
+		}
+
+		bool match(const bitset& mask) const
+		{
+			return mask.contains(required) && !mask.intersects(excluded) && (anyOf.empty() || mask.intersects(anyOf));
+		}
+
+		bitset_matcher matcher() const
+		{
+			return bitset_matcher(required, excluded, anyOf);
+		}
+	};
+
+
+	namespace internal
+	{
+		//
+		// Batch aspect matching kernels: results[i] = filter.match(masks[i])
+		//
+		//  SSE2 / AVX2 / AVX-512 versions are built into the same binary (see ECS_TARGET_AVX2, ECS_TARGET_AVX512)
+		//  MatchMasks uses the best kernel for the CPU, selected on the first call (see GetSimdLevel)
+		//
+		typedef void (*MatchMasksFunc)(const aspect_filter& filter, const bitset* masks, uint32_t count, uint8_t* results);
+
+		// kernel for the instruction set (falls back to the narrower kernel if there is no benefit or it is not built)
+		MatchMasksFunc GetMatchMasksKernel(SimdLevel::Type level);
+
+		void MatchMasks(const aspect_filter& filter, const bitset* masks, uint32_t count, uint8_t* results);
+	}
+
+}
@@ -0,0 +1,209 @@
+// The MIT License (MIT)
+//
+// 	Copyright (c) 2017 Sergey Makeev
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy
+// 	of this software and associated documentation files (the "Software"), to deal
+// 	in the Software without restriction, including without limitation the rights
+// 	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// 	copies of the Software, and to permit persons to whom the Software is
+// 	furnished to do so, subject to the following conditions:
+//
+//      The above copyright notice and this permission notice shall be included in
+// 	all copies or substantial portions of the Software.
+//
+// 	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// 	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// 	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// 	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// 	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// 	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// 	THE SOFTWARE.
+#pragma once
+
+
+
+#include <stdint.h>
+#include <assert.h>
+#include <new>
+#include <utility>
+#include "ComponentTraits.h"
+#include "Memory.h"
+#include "Utils.h"
+
+
+namespace ecs
+{
+
+	//
+	// Chunked container with stable element addresses
+	//
+	//  Elements are stored in fixed-size blocks of BLOCK_SIZE elements + block table.
+	//  Growth only allocates a new block and never moves existing elements,
+	//  so pointers to the elements stay valid until the element is removed (or moved by the storage).
+	//
+	//  Elements are still stored linearly inside the block, iterate block by block for the best performance.
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename T, uint32_t BLOCK_SIZE>
+	class chunked_vector
+	{
+		static_assert(BLOCK_SIZE > 0 && (BLOCK_SIZE & (BLOCK_SIZE - 1)) == 0, "Block size must be a power of two");
+
+		static const size_t blockAlignment = component_alignment<T>::value;
+
+		// block table
+		ecs::vector<T*> blocks;
+
+		// number of elements
+		uint32_t count;
+
+		// non copyable
+		chunked_vector(chunked_vector&);
+		void operator=(chunked_vector&);
+
+		void add_block()
+		{
+			T* pBlock = (T*)memory::Alloc(sizeof(T) * BLOCK_SIZE, blockAlignment);
+			blocks.push_back(pBlock);
+		}
+
+	public:
+
+		static const uint32_t blockSize = BLOCK_SIZE;
+
+		chunked_vector()
+			: count(0)
+		{
+		}
+
+		~chunked_vector()
+		{
+			clear();
+			for (auto it = blocks.begin(); it != blocks.end(); ++it)
+			{
+				memory::Free(*it);
+			}
+			blocks.clear();
+		}
+
+		uint32_t size() const
+		{
+			return count;
+		}
+
+		bool empty() const
+		{
+			return (count == 0);
+		}
+
+		uint32_t capacity() const
+		{
+			return narrow_cast<uint32_t>(blocks.size()) * BLOCK_SIZE;
+		}
+
+		void reserve(uint32_t newCapacity)
+		{
+			while (capacity() < newCapacity)
+			{
+				add_block();
+			}
+		}
+
+		void push_back(T&& v)
+		{
+			if (count == capacity())
+			{
+				add_block();
+			}
+
+			T* p = blocks[count / BLOCK_SIZE] + (count % BLOCK_SIZE);
+			new (p) T(std::move(v));
+			count++;
+		}
+
+		void pop_back()
+		{
+			assert(count > 0);
+			count--;
+			T* p = blocks[count / BLOCK_SIZE] + (count % BLOCK_SIZE);
+			p->~T();
+		}
+
+		// destroy all elements (memory blocks are kept for reuse)
+		void clear()
+		{
+			while (count > 0)
+			{
+				pop_back();
+			}
+		}
+
+		T& operator[] (uint32_t index)
+		{
+			assert(index < count);
+			return blocks[index / BLOCK_SIZE][index % BLOCK_SIZE];
+		}
+
+		const T& operator[] (uint32_t index) const
+		{
+			assert(index < count);
+			return blocks[index / BLOCK_SIZE][index % BLOCK_SIZE];
+		}
+
+		// free the blocks above newCapacity, returns number of bytes reclaimed
+		size_t shrink(uint32_t newCapacity)
+		{
+			if (newCapacity < count)
+			{
+				newCapacity = count;
+			}
+
+			size_t newBlocksCount = (size_t(newCapacity) + (BLOCK_SIZE - 1)) / BLOCK_SIZE;
+			size_t bytesCount = 0;
+			while (blocks.size() > newBlocksCount)
+			{
+				memory::Free(blocks.back());
+				blocks.pop_back();
+				bytesCount += sizeof(T) * BLOCK_SIZE;
+			}
+			return bytesCount;
+		}
+
+		// number of blocks that contain elements
+		uint32_t blocks_count() const
+		{
+			return (count + (BLOCK_SIZE - 1)) / BLOCK_SIZE;
+		}
+
+		T* block_data(uint32_t blockIndex)
+		{
+			assert(blockIndex < blocks_count());
+			return blocks[blockIndex];
+		}
+
+		const T* block_data(uint32_t blockIndex) const
+		{
+			assert(blockIndex < blocks_count());
+			return blocks[blockIndex];
+		}
+
+		// number of elements in the block
+		uint32_t block_size(uint32_t blockIndex) const
+		{
+			assert(blockIndex < blocks_count());
+			uint32_t firstIndex = blockIndex * BLOCK_SIZE;
+			return ((count - firstIndex) < BLOCK_SIZE) ? (count - firstIndex) : BLOCK_SIZE;
+		}
+	};
+
+
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename T, uint32_t BLOCK_SIZE>
+	inline size_t trim_capacity(chunked_vector<T, BLOCK_SIZE>& container, const TrimPolicy& policy)
+	{
+		size_t newCapacity = policy.shrink_capacity(container.size(), container.capacity());
+		return container.shrink(narrow_cast<uint32_t>(newCapacity));
+	}
+
+}
@@ -0,0 +1,286 @@
+// The MIT License (MIT)
+//
+// 	Copyright (c) 2017 Sergey Makeev
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy
+// 	of this software and associated documentation files (the "Software"), to deal
+// 	in the Software without restriction, including without limitation the rights
+// 	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// 	copies of the Software, and to permit persons to whom the Software is
+// 	furnished to do so, subject to the following conditions:
+//
+//      The above copyright notice and this permission notice shall be included in
+// 	all copies or substantial portions of the Software.
+//
+// 	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// 	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// 	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// 	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// 	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// 	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// 	THE SOFTWARE.
+#pragma once
+
+
+#include <stdint.h>
+#include <tuple>
+#include <vector>
+#include <type_traits>
+#include <cstring>
+#include "Memory.h"
+
+
+//
+// Per component type traits.
+//
+//  Traits must be declared next to the component type (in the header), since every translation unit
+//  that instantiates ComponentsStorage<T> must see the same traits.
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+//
+// Declare structure-of-arrays layout for the component type.
+//
+//  ECS_DECLARE_COMPONENT_SOA(Pos, &Pos::x, &Pos::y);
+//
+//  The components storage keeps one aligned array per declared field.
+//  All fields must be trivially copyable and all the component data must be declared as fields.
+//
+#define ECS_DECLARE_COMPONENT_SOA(TYPE, ...)                                  \
+namespace ecs                                                                 \
+{                                                                             \
+	template<>                                                                \
+	struct component_fields<TYPE>                                             \
+	{                                                                         \
+		typedef decltype(std::make_tuple(__VA_ARGS__)) members_type;          \
+		                                                                      \
+		static inline members_type members()                                  \
+		{                                                                     \
+			return std::make_tuple(__VA_ARGS__);                              \
+		}                                                                     \
+	};                                                                        \
+	                                                                          \
+	template<>                                                                \
+	struct component_container<TYPE>                                         \
+	{                                                                         \
+		typedef ecs::soa_vector<TYPE> type;                                   \
+	};                                                                        \
+}                                                                             \
+
+
+//
+// Declare chunked (stable address) storage for the component type.
+//
+//  ECS_DECLARE_COMPONENT_CHUNKED(Particle, 4096);
+//
+//  Components are stored in blocks of BLOCK_SIZE elements, storage growth never moves existing components.
+//  BLOCK_SIZE must be a power of two.
+//
+#define ECS_DECLARE_COMPONENT_CHUNKED(TYPE, BLOCK_SIZE)                       \
+namespace ecs                                                                 \
+{                                                                             \
+	template<>                                                                \
+	struct component_container<TYPE>                                         \
+	{                                                                         \
+		typedef ecs::chunked_vector<TYPE, BLOCK_SIZE> type;                   \
+	};                                                                        \
+}                                                                             \
+
+
+//
+// Declare shared (flyweight) storage for the component type.
+//
+//  ECS_DECLARE_COMPONENT_SHARED(Material);
+//
+//  Equal component values are stored only once and shared between entities (copy on write).
+//  Values are compared by component_hash<T> / component_equal<T> (bytewise by default).
+//
+#define ECS_DECLARE_COMPONENT_SHARED(TYPE)                                    \
+namespace ecs                                                                 \
+{                                                                             \
+	template<>                                                                \
+	struct component_container<TYPE>                                         \
+	{                                                                         \
+		typedef ecs::shared_vector<TYPE> type;                                \
+	};                                                                        \
+}                                                                             \
+
+
+//
+// Declare double-buffered storage for the component type.
+//
+//  ECS_DECLARE_COMPONENT_DOUBLE_BUFFERED(Pos);
+//
+//  Aspect<const T> (and any read-only access) reads the value of the previous frame,
+//  Aspect<T> (and any mutable access) writes the value of the current frame.
+//  Buffers are flipped at the end of ecs::Update
+//
+#define ECS_DECLARE_COMPONENT_DOUBLE_BUFFERED(TYPE)                           \
+namespace ecs                                                                 \
+{                                                                             \
+	template<>                                                                \
+	struct component_container<TYPE>                                         \
+	{                                                                         \
+		typedef ecs::double_buffer<TYPE> type;                                \
+	};                                                                        \
+}                                                                             \
+
+
+//
+// Declare virtual memory reserved storage for the component type.
+//
+//  ECS_DECLARE_COMPONENT_RESERVED(Transform);
+//
+//  Storage reserves the address range for all possible entities and commits memory pages on demand,
+//  growth never copies components and component addresses are stable.
+//
+#define ECS_DECLARE_COMPONENT_RESERVED(TYPE)                                  \
+namespace ecs                                                                 \
+{                                                                             \
+	template<>                                                                \
+	struct component_container<TYPE>                                         \
+	{                                                                         \
+		typedef ecs::reserved_vector<TYPE> type;                              \
+	};                                                                        \
+}                                                                             \
+
+//
+// Override the memory alignment of the component storage.
+//
+//  ECS_DECLARE_COMPONENT_ALIGNMENT(Transform, 64);
+//
+//  By default components are aligned to max(alignof(T), 16).
+//  Only the base address of the storage buffer (and of the hibernated component) is aligned,
+//  components are packed with the stride of sizeof(T). sizeof(T) must be a multiple of ALIGNMENT,
+//  so every component is placed at its own aligned address (e.g. cache line isolated components written from different threads).
+//
+#define ECS_DECLARE_COMPONENT_ALIGNMENT(TYPE, ALIGNMENT)                      \
+namespace ecs                                                                 \
+{                                                                             \
+	template<>                                                                \
+	struct component_alignment<TYPE>                                          \
+		: public std::integral_constant<uint32_t, ALIGNMENT>                  \
+	{                                                                         \
+		static_assert((sizeof(TYPE) % (ALIGNMENT)) == 0,                      \
+			"sizeof(TYPE) must be a multiple of the alignment (stride of the components is sizeof(TYPE))"); \
+	};                                                                        \
+}                                                                             \
+
+//
+// Declare the component type as trivially relocatable.
+//
+//  ECS_DECLARE_COMPONENT_RELOCATABLE(Mesh);
+//
+//  The object can be moved to another address by memcpy (the source is not destroyed after that).
+//  True for the most types which do not keep pointers to itself (e.g. std::unique_ptr),
+//  trivially copyable types are relocatable by default.
+//
+#define ECS_DECLARE_COMPONENT_RELOCATABLE(TYPE)                               \
+namespace ecs                                                                 \
+{                                                                             \
+	template<>                                                                \
+	struct is_trivially_relocatable<TYPE> : public std::true_type             \
+	{                                                                         \
+	};                                                                        \
+}                                                                             \
+
+
+
+namespace ecs
+{
+	// fwd decl
+	template<typename T> class soa_vector;
+	template<typename T, uint32_t BLOCK_SIZE> class chunked_vector;
+	template<typename T> class shared_vector;
+	template<typename T> class double_buffer;
+	template<typename T, uint32_t MAX_COUNT = (1 << 20)> class reserved_vector;
+
+
+	//
+	// Memory alignment of the components data
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename T>
+	struct component_alignment : public std::integral_constant<uint32_t, internal::default_alignment<T>::value>
+	{
+	};
+
+
+	//
+	// Container used by ComponentsStorage<T> to hold the components data (array of structures by default)
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename T>
+	struct component_container
+	{
+		typedef ecs::vector<T, component_alignment<T>::value> type;
+	};
+
+
+	//
+	// Tag component (empty type). Tags have no storage at all, only the bit in the entity components mask.
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename T>
+	struct is_tag_component : public std::integral_constant<bool, std::is_empty<T>::value>
+	{
+	};
+
+
+	//
+	// Component can be relocated by memcpy (storage moves become memcpy/bitwise swaps)
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename T>
+	struct is_trivially_relocatable : public std::integral_constant<bool, std::is_trivially_copyable<T>::value>
+	{
+	};
+
+
+	//
+	// List of the component fields (pointers to members), declared by ECS_DECLARE_COMPONENT_SOA
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename T>
+	struct component_fields;
+
+
+
+	//
+	// Hash and equality of the component values (used to deduplicate shared components)
+	//
+	//  Default implementation is bytewise, so the component must be trivially copyable and must not contain padding.
+	//  Specialize both structures for other types.
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename T>
+	struct component_hash
+	{
+		uint64_t operator()(const T& v) const
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "Specialize component_hash<T> for this type");
+
+			// FNV-1a
+			const uint8_t* bytes = (const uint8_t*)&v;
+			uint64_t hash = 14695981039346656037ULL;
+			for (size_t i = 0; i < sizeof(T); i++)
+			{
+				hash ^= bytes[i];
+				hash *= 1099511628211ULL;
+			}
+			return hash;
+		}
+	};
+
+	template<typename T>
+	struct component_equal
+	{
+		bool operator()(const T& a, const T& b) const
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "Specialize component_equal<T> for this type");
+			return (std::memcmp(&a, &b, sizeof(T)) == 0);
+		}
+	};
+
+}
@@ -24,9 +24,22 @@
 
 #include <vector>
 #include <array>
+#include <algorithm>
+#include <iterator>
+#include <new>
+#include <cstring>
+#include <type_traits>
 #include "Memory.h"
-#include "EntityId.h"
+#include "EntityID.h"
 #include "BitSet.h"
+#include "SparseIndex.h"
+#include "ComponentTraits.h"
+#include "SoaVector.h"
+#include "ChunkedVector.h"
+#include "SharedVector.h"
+#include "DoubleBuffer.h"
+#include "ReservedVector.h"
+#include "RadixSort.h"
 
 
 
@@ -34,14 +47,110 @@ namespace ecs
 {
 	class IComponentsStorage;
 
+	template<typename T, bool IS_TAG = is_tag_component<T>::value>
+	class ComponentsStorage;
+
 	// forward decl
 	std::array<IComponentsStorage*, bitset::MaxBitCount::value>& GetStorageDirectory();
 	ecs::vector<IComponentsStorage*>& GetStorageLinearDirectory();
+	uint32_t& GlobalFrameIndex();
+
+	// forward decl (implementation in macro ECS_IMPLEMENT_COMPONENT_META)
+	template<typename TComponent>
+	ecs::ComponentsStorage<TComponent>& GetComponentStorage();
+
+	template<typename TComponent>
+	uint32_t GetComponentTypeIndex();
+
+	namespace internal
+	{
+		bool HasComponentBit(const ConstEntityId id, uint32_t componentTypeIndex);
+	}
 
 
 	typedef ecs::vector<uint32_t> ComponentsIterator;
 
 
+	//
+	// Memory and occupancy statistics of the components storage (see ecs::GetComponentsStats)
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	struct StorageStats
+	{
+		// component type index (-1 for the aggregated statistics)
+		uint32_t componentTypeIndex;
+		uint32_t componentSize;
+
+		// number of live components / number of components the storage can hold without reallocation
+		uint32_t count;
+		uint32_t capacity;
+
+		// number of components stored out of the entities order (entity index is lower than the index of the previous component)
+		uint32_t misplacedCount;
+
+		// length of the unsorted tail, the work left for the incremental OptimizeLayoutForCache
+		//  (a single component of the reused low entity index can make the whole tail unsorted)
+		uint32_t unsortedTailCount;
+
+		// bytes used by the components data, forward index (entity -> component), back index (component -> entity) and versions
+		size_t dataBytes;
+		size_t forwardIndexBytes;
+		size_t backIndexBytes;
+		size_t versionsBytes;
+
+		// number of components added / removed since the last reset_stats
+		uint64_t pushCount;
+		uint64_t eraseCount;
+
+		StorageStats()
+			: componentTypeIndex(UINT32_MAX)
+			, componentSize(0)
+			, count(0)
+			, capacity(0)
+			, misplacedCount(0)
+			, unsortedTailCount(0)
+			, dataBytes(0)
+			, forwardIndexBytes(0)
+			, backIndexBytes(0)
+			, versionsBytes(0)
+			, pushCount(0)
+			, eraseCount(0)
+		{
+		}
+
+		size_t total_bytes() const
+		{
+			return dataBytes + forwardIndexBytes + backIndexBytes + versionsBytes;
+		}
+
+		// fraction of the components stored out of the entities order [0..1]
+		float fragmentation() const
+		{
+			return (count > 0) ? (float(misplacedCount) / float(count)) : 0.0f;
+		}
+
+		// fraction of the capacity in use [0..1]
+		float occupancy() const
+		{
+			return (capacity > 0) ? (float(count) / float(capacity)) : 0.0f;
+		}
+
+		void accumulate(const StorageStats& other)
+		{
+			count += other.count;
+			capacity += other.capacity;
+			misplacedCount += other.misplacedCount;
+			unsortedTailCount += other.unsortedTailCount;
+			dataBytes += other.dataBytes;
+			forwardIndexBytes += other.forwardIndexBytes;
+			backIndexBytes += other.backIndexBytes;
+			versionsBytes += other.versionsBytes;
+			pushCount += other.pushCount;
+			eraseCount += other.eraseCount;
+		}
+	};
+
+
 	class IComponentsStorage
 	{
 	public:
@@ -49,7 +158,35 @@ namespace ecs
 		virtual ~IComponentsStorage() {}
 		virtual void erase_v(const EntityId id) = 0;
 		virtual void optimize_v() = 0;
+		virtual bool optimize_step_v(uint32_t maxEntitiesCount) = 0;
+		virtual void optimize_order_v(const EntityId* order, uint32_t count) = 0;
+
+		// parallel layout optimization (see ecs::OptimizeLayoutForCacheParallel)
+		//   number of components stored out of the entities order (0 - nothing to optimize)
+		virtual uint32_t fragmented_count_v() const = 0;
+		//   build the permutation to the entities order and the start of every permutation cycle (false - storage can't be split)
+		virtual bool build_optimize_permutation_v(ecs::vector<uint32_t>& permutation, ecs::vector<uint32_t>& cycles) = 0;
+		//   apply one cycle of the permutation (different cycles can be applied from different threads)
+		virtual void apply_permutation_cycle_v(uint32_t* permutation, uint32_t start) = 0;
+		//   all the cycles are applied
+		virtual void finish_optimize_permutation_v() = 0;
+		virtual void flip_v() = 0;
+		virtual void release_memory_v() = 0;
+		virtual size_t trim_v(const TrimPolicy& policy) = 0;
+		virtual void get_stats_v(StorageStats& stats) const = 0;
+		virtual void reset_stats_v() = 0;
 		virtual void push_back_v(const EntityId id, void* pMem, size_t sizeOf, size_t alignOf) = 0;
+
+		// component type info
+		virtual size_t component_size_v() const = 0;
+		virtual size_t component_align_v() const = 0;
+		virtual bool is_trivially_copyable_v() const = 0;
+
+		// move the entity component to the uninitialized memory and remove it from the storage
+		virtual void move_out_v(const EntityId id, void* pMem) = 0;
+
+		// call dtor for the component stored outside the storage
+		virtual void destroy_value_v(void* pMem) = 0;
 	};
 
 
@@ -57,17 +194,226 @@ namespace ecs
 
 
 
+	namespace internal
+	{
+		// number of the components out of the entities order, only the unsorted tail [sortedCount .. size) is visited
+		inline uint32_t CountMisplacedComponents(const ecs::vector<EntityId>& backIndex, uint32_t sortedCount)
+		{
+			uint32_t misplacedCount = 0;
+			for (size_t i = std::max(sortedCount, 1u); i < backIndex.size(); i++)
+			{
+				misplacedCount += (backIndex[i].u.index < backIndex[i - 1].u.index) ? 1 : 0;
+			}
+			return misplacedCount;
+		}
+
+		// relocation kind of the component type
+		//   0 - regular (move assignment / std::swap)
+		//   1 - trivially relocatable (bitwise swap)
+		//   2 - trivially copyable (memcpy)
+		template<typename T>
+		struct relocation_kind : public std::integral_constant<int, std::is_trivially_copyable<T>::value ? 2 : (is_trivially_relocatable<T>::value ? 1 : 0)>
+		{
+		};
+
+		// full layout optimization strategy
+		//   small trivially copyable components are cheaper to swap in place (no permutation array, sequential access),
+		//   the rest are moved along the cycles of the permutation (every component is moved exactly once)
+		template<typename T>
+		struct optimize_by_cycles : public std::integral_constant<bool, (relocation_kind<T>::value != 2) || (sizeof(T) > 64)>
+		{
+		};
+
+		template<typename T>
+		inline void BitwiseSwap(T& a, T& b)
+		{
+			typename std::aligned_storage<sizeof(T), __alignof(T)>::type tmp;
+			std::memcpy((void*)&tmp, (const void*)&a, sizeof(T));
+			std::memcpy((void*)&a, (const void*)&b, sizeof(T));
+			std::memcpy((void*)&b, (const void*)&tmp, sizeof(T));
+		}
+
+		template<typename T>
+		inline void MoveComponent(T& dst, T& src, std::integral_constant<int, 0>)
+		{
+			dst = std::move(src);
+		}
+
+		// the destination value is moved to the source slot, the caller destroys the source slot (see ComponentsStorage::erase)
+		template<typename T>
+		inline void MoveComponent(T& dst, T& src, std::integral_constant<int, 1>)
+		{
+			BitwiseSwap(dst, src);
+		}
+
+		template<typename T>
+		inline void MoveComponent(T& dst, T& src, std::integral_constant<int, 2>)
+		{
+			std::memcpy((void*)&dst, (const void*)&src, sizeof(T));
+		}
+
+		template<typename T>
+		inline void SwapComponents(T& a, T& b, std::integral_constant<int, 0>)
+		{
+			std::swap(a, b);
+		}
+
+		template<typename T, int KIND>
+		inline void SwapComponents(T& a, T& b, std::integral_constant<int, KIND>)
+		{
+			BitwiseSwap(a, b);
+		}
+
+		template<typename TContainer, typename T>
+		inline void RotateCycle(TContainer& container, const uint32_t* permutation, uint32_t start, std::integral_constant<int, 0>)
+		{
+			T tmp(std::move(container[start]));
+			uint32_t cur = start;
+			for (uint32_t next = permutation[cur]; next != start; next = permutation[cur])
+			{
+				container[cur] = std::move(container[next]);
+				cur = next;
+			}
+			container[cur] = std::move(tmp);
+		}
+
+		// relocatable types: bytes are moved, the intermediate copies are overwritten without dtor
+		template<typename TContainer, typename T, int KIND>
+		inline void RotateCycle(TContainer& container, const uint32_t* permutation, uint32_t start, std::integral_constant<int, KIND>)
+		{
+			typename std::aligned_storage<sizeof(T), __alignof(T)>::type tmp;
+			std::memcpy((void*)&tmp, (const void*)&container[start], sizeof(T));
+			uint32_t cur = start;
+			for (uint32_t next = permutation[cur]; next != start; next = permutation[cur])
+			{
+				std::memcpy((void*)&container[cur], (const void*)&container[next], sizeof(T));
+				cur = next;
+			}
+			std::memcpy((void*)&container[cur], (const void*)&tmp, sizeof(T));
+		}
+	}
+
+
+	//
+	// Element-wise operations used by ComponentsStorage<T> (array of structures containers)
+	//
+	//  Trivially relocatable components are moved by memcpy instead of the move assignment/std::swap
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename TContainer>
+	inline void move_component(TContainer& container, uint32_t dstIndex, uint32_t srcIndex)
+	{
+		typedef typename std::remove_reference<decltype(container[dstIndex])>::type T;
+		internal::MoveComponent(container[dstIndex], container[srcIndex], internal::relocation_kind<T>());
+	}
+
+	template<typename TContainer>
+	inline void swap_components(TContainer& container, uint32_t indexA, uint32_t indexB)
+	{
+		typedef typename std::remove_reference<decltype(container[indexA])>::type T;
+		internal::SwapComponents(container[indexA], container[indexB], internal::relocation_kind<T>());
+	}
+
+	// apply the cycle of the permutation (element at position i = old element at position permutation[i])
+	//   every element is moved exactly once
+	template<typename TContainer>
+	inline void rotate_components(TContainer& container, const uint32_t* permutation, uint32_t start)
+	{
+		typedef typename std::remove_reference<decltype(container[start])>::type T;
+		internal::RotateCycle<TContainer, T>(container, permutation, start, internal::relocation_kind<T>());
+	}
+
+	// move-construct the component to the uninitialized memory
+	template<typename T, typename TContainer>
+	inline void extract_component(TContainer& container, uint32_t index, T* pDst)
+	{
+		new (pDst) T(std::move(container[index]));
+	}
+
 	template<typename T>
+	inline void extract_component(soa_vector<T>& container, uint32_t index, T* pDst)
+	{
+		container.load(index, pDst);
+	}
+
+	// end of frame notification (only double-buffered containers use it)
+	template<typename TContainer>
+	inline void flip_components(TContainer& /*container*/)
+	{
+	}
+
+	// return unused memory back to the OS (only virtual memory reserved containers use it)
+	template<typename TContainer>
+	inline void release_memory(TContainer& /*container*/)
+	{
+	}
+
+	// number of bytes used by the container
+	template<typename TContainer>
+	inline size_t memory_footprint(const TContainer& container)
+	{
+		typedef typename std::remove_reference<decltype(container[0])>::type T;
+		return size_t(container.capacity()) * sizeof(T);
+	}
+
+	// release excess capacity, returns number of bytes reclaimed (containers without overload keep the memory)
+	template<typename TContainer>
+	inline size_t trim_capacity(TContainer& /*container*/, const TrimPolicy& /*policy*/)
+	{
+		return 0;
+	}
+
+	// append (move) values to the end of container
+	template<typename TContainer, typename T>
+	inline void append_components(TContainer& container, T* values, uint32_t count)
+	{
+		reserve_additional(container, count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			container.push_back(std::move(values[i]));
+		}
+	}
+
+	template<typename T, uint32_t Alignment>
+	inline void append_components(ecs::vector<T, Alignment>& container, T* values, uint32_t count)
+	{
+		// single insert (memmove for trivially copyable types)
+		container.insert(container.end(), std::make_move_iterator(values), std::make_move_iterator(values + count));
+	}
+
+
+
+	template<typename T, bool IS_TAG>
 	class ComponentsStorage : public IComponentsStorage
 	{
-		ecs::vector<T> dataBuffer;
+		typedef typename component_container<T>::type ContainerType;
+
+		ContainerType dataBuffer;
 
 		// translate EntityId to component index or -1 if no component present for this entity.
-		ecs::vector<int32_t> forwardIndex;
+		ecs::sparse_index forwardIndex;
 
 		// translate component index to EntityId
 		ecs::vector<EntityId> backIndex;
 
+		// component index -> frame index of the last write access
+		ecs::vector<uint32_t> versions;
+
+		// global frame counter
+		const uint32_t* frameIndex;
+
+		// Components [0 .. sortedComponentsCount) are stored in the order of entities
+		//   and all the other components belong to entities with a greater index.
+		// So the storage is fragmented only in the range [sortedComponentsCount .. size())
+		uint32_t sortedComponentsCount;
+
+		// Components are stored in the custom order (see optimize(order, count)), valid until the storage is modified
+		bool isCustomOrder;
+
+		// number of components added / removed since the last reset_stats
+		uint64_t pushCount;
+		uint64_t eraseCount;
+
 
 	private:
 
@@ -76,18 +422,135 @@ namespace ecs
 		void operator=(ComponentsStorage&);
 
 
-		T* get_element(const EntityId id)
+		// update fragmented range (component is added to the end of storage)
+		void on_push_back(const EntityId id, uint32_t componentIndex)
 		{
-			assert(dataBuffer.size() == backIndex.size());
+			isCustomOrder = false;
 
-			// invalid entity index
-			if (id.u.index >= forwardIndex.size())
+			if (sortedComponentsCount > 0 && backIndex[sortedComponentsCount - 1].u.index > id.u.index)
 			{
-				return nullptr;
+				// the new component belongs inside the sorted range, shrink the sorted range up to this position
+				auto it = std::lower_bound(backIndex.begin(), backIndex.begin() + sortedComponentsCount, id, [](const EntityId& a, const EntityId& b)
+				{
+					return a.u.index < b.u.index;
+				});
+				sortedComponentsCount = narrow_cast<uint32_t>(it - backIndex.begin());
 			}
+			else if (sortedComponentsCount == componentIndex)
+			{
+				// adding to the end of sorted storage
+				sortedComponentsCount++;
+			}
+		}
 
-			// convert EntityId to component index
-			int32_t index = forwardIndex.at(id.u.index);
+
+		//
+		// Apply the cycle of the permutation (component at position i = old component at position permutation[i])
+		//   every component of the cycle is moved exactly once, visited positions are marked as permutation[i] = i
+		//
+		//  Touches only the positions of this cycle (and the forward index entries of their entities),
+		//  so the disjoint cycles can be applied from different threads.
+		//
+		void apply_permutation_cycle(uint32_t* permutation, uint32_t start)
+		{
+			rotate_components(dataBuffer, permutation, start);
+
+			// second pass: entity ids and versions (rotated together) + forward index
+			EntityId startId = backIndex[start];
+			uint32_t startVersion = versions[start];
+			uint32_t cur = start;
+			for (uint32_t next = permutation[cur]; next != start; next = permutation[cur])
+			{
+				backIndex[cur] = backIndex[next];
+				versions[cur] = versions[next];
+				forwardIndex.set(backIndex[cur].u.index, cur);
+				permutation[cur] = cur;
+				cur = next;
+			}
+			backIndex[cur] = startId;
+			versions[cur] = startVersion;
+			forwardIndex.set(startId.u.index, cur);
+			permutation[cur] = cur;
+		}
+
+		// permutation[i] = component of the i-th entity in the entities order (identity for the sorted range)
+		void build_entities_order_permutation(ecs::vector<uint32_t>& permutation)
+		{
+			uint32_t componentsCount = size();
+			permutation.resize(componentsCount);
+			for (uint32_t i = 0; i < sortedComponentsCount; i++)
+			{
+				permutation[i] = i;
+			}
+
+			uint32_t tgtComponentIndex = sortedComponentsCount;
+			uint32_t tgtEntityIndex = (tgtComponentIndex > 0) ? (backIndex[tgtComponentIndex - 1].u.index + 1) : 0;
+			while (tgtComponentIndex < componentsCount)
+			{
+				uint32_t pageIndex = (tgtEntityIndex >> sparse_index::pageSizeLog2);
+				uint32_t pageEnd = ((pageIndex + 1) << sparse_index::pageSizeLog2);
+
+				// There are no components for the whole range of entities, skip the page
+				if (forwardIndex.is_empty_page(pageIndex))
+				{
+					tgtEntityIndex = pageEnd;
+					continue;
+				}
+
+				for (; tgtEntityIndex < pageEnd && tgtComponentIndex < componentsCount; tgtEntityIndex++)
+				{
+					int32_t srcComponentIndex = forwardIndex.get(tgtEntityIndex);
+					if (srcComponentIndex >= 0)
+					{
+						permutation[tgtComponentIndex] = srcComponentIndex;
+						tgtComponentIndex++;
+					}
+				}
+			}
+		}
+
+		void optimize_full(std::false_type)
+		{
+			optimize(UINT32_MAX);
+		}
+
+		void optimize_full(std::true_type)
+		{
+			ecs::vector<uint32_t> permutation;
+			build_entities_order_permutation(permutation);
+
+			uint32_t componentsCount = size();
+			for (uint32_t i = sortedComponentsCount; i < componentsCount; i++)
+			{
+				if (permutation[i] != i)
+				{
+					apply_permutation_cycle(permutation.data(), i);
+				}
+			}
+
+			sortedComponentsCount = componentsCount;
+		}
+
+		// Reorder the storage: component at position i = old component at position permutation[i]
+		//   permutation is destroyed (used to mark visited positions)
+		void apply_permutation(uint32_t* permutation, uint32_t count)
+		{
+			assert(count == size());
+			for (uint32_t i = 0; i < count; i++)
+			{
+				if (permutation[i] != i)
+				{
+					apply_permutation_cycle(permutation, i);
+				}
+			}
+		}
+
+		T* get_element(const EntityId id)
+		{
+			assert(dataBuffer.size() == backIndex.size());
+
+			// convert EntityId to component index (-1 for invalid entity index)
+			int32_t index = forwardIndex.get(id.u.index);
 
 			//no component of this type for this EntityId
 			if (index < 0)
@@ -95,6 +558,9 @@ namespace ecs
 				return nullptr;
 			}
 
+			// write access, update component version
+			versions[index] = *frameIndex;
+
 			// return component pointer
 			return &dataBuffer[index];
 		}
@@ -104,8 +570,8 @@ namespace ecs
 		{
 			assert(dataBuffer.size() == backIndex.size());
 
-			// convert EntityId to component index
-			int32_t index = forwardIndex.at(id.u.index);
+			// convert EntityId to component index (-1 for invalid entity index)
+			int32_t index = forwardIndex.get(id.u.index);
 
 			//no component of this type for this EntityId
 			if (index < 0)
@@ -121,6 +587,11 @@ namespace ecs
 	public:
 
 		ComponentsStorage()
+			: frameIndex(&ecs::GlobalFrameIndex())
+			, sortedComponentsCount(0)
+			, isCustomOrder(false)
+			, pushCount(0)
+			, eraseCount(0)
 		{
 			// register storage
 			uint32_t componentTypeIndex = ecs::GetComponentTypeIndex<T>();
@@ -137,16 +608,49 @@ namespace ecs
 		{
 			assert(dataBuffer.size() == backIndex.size());
 
-			if (id.u.index >= forwardIndex.size())
-			{
-				forwardIndex.resize(id.u.index + 1, -1);
-			}
-
 			uint32_t componentIndex = size();
+			on_push_back(id, componentIndex);
+
 			dataBuffer.push_back(std::move(v));
 
 			backIndex.push_back(id);
-			forwardIndex[id.u.index] = componentIndex;
+			versions.push_back(*frameIndex);
+			forwardIndex.set(id.u.index, componentIndex);
+			pushCount++;
+		}
+
+		//
+		// Batch version of push_back (values are moved)
+		//   Memory is reserved once for the whole batch.
+		//
+		void push_back(const EntityId* ids, T* values, uint32_t count)
+		{
+			assert(dataBuffer.size() == backIndex.size());
+			if (count == 0)
+			{
+				return;
+			}
+
+			uint32_t firstComponentIndex = size();
+			pushCount += count;
+
+			append_components(dataBuffer, values, count);
+			backIndex.insert(backIndex.end(), ids, ids + count);
+			versions.insert(versions.end(), count, *frameIndex);
+
+			uint32_t maxEntityIndex = 0;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				maxEntityIndex = std::max(maxEntityIndex, (uint32_t)ids[i].u.index);
+			}
+			forwardIndex.reserve(maxEntityIndex + 1);
+
+			for (uint32_t i = 0; i < count; i++)
+			{
+				uint32_t componentIndex = firstComponentIndex + i;
+				on_push_back(ids[i], componentIndex);
+				forwardIndex.set(ids[i].u.index, componentIndex);
+			}
 		}
 
 
@@ -162,6 +666,53 @@ namespace ecs
 			return dataBuffer.empty();
 		}
 
+		uint32_t capacity() const
+		{
+			return narrow_cast<uint32_t>(dataBuffer.capacity());
+		}
+
+		// memory and occupancy statistics (misplaced components are counted by the scan of the unsorted tail)
+		StorageStats stats() const
+		{
+			StorageStats r;
+			r.componentTypeIndex = ecs::GetComponentTypeIndex<T>();
+			r.componentSize = narrow_cast<uint32_t>(sizeof(T));
+			r.count = size();
+			r.capacity = capacity();
+			r.unsortedTailCount = isCustomOrder ? 0 : (size() - sortedComponentsCount);
+			r.misplacedCount = isCustomOrder ? 0 : internal::CountMisplacedComponents(backIndex, sortedComponentsCount);
+			r.dataBytes = memory_footprint(dataBuffer);
+			r.forwardIndexBytes = forwardIndex.memory_footprint();
+			r.backIndexBytes = memory_footprint(backIndex);
+			r.versionsBytes = memory_footprint(versions);
+			r.pushCount = pushCount;
+			r.eraseCount = eraseCount;
+			return r;
+		}
+
+		void reset_stats()
+		{
+			pushCount = 0;
+			eraseCount = 0;
+		}
+
+		// shrink forward index down to the highest entity index in use and release excess capacity,
+		//   returns number of bytes reclaimed
+		size_t trim(const TrimPolicy& policy)
+		{
+			uint32_t indexCount = 0;
+			for (auto it = backIndex.begin(); it != backIndex.end(); ++it)
+			{
+				indexCount = std::max(indexCount, (uint32_t)it->u.index + 1);
+			}
+
+			size_t bytesCount = forwardIndex.trim(indexCount);
+			bytesCount += trim_capacity(dataBuffer, policy);
+			bytesCount += trim_capacity(backIndex, policy);
+			bytesCount += trim_capacity(versions, policy);
+			return bytesCount;
+		}
+
 		T* get(const EntityId id)
 		{
 			return get_element(id);
@@ -172,19 +723,87 @@ namespace ecs
 			return get_element(id);
 		}
 
+		// explicitly mark the component as changed in the current frame
+		void mark_changed(const EntityId id)
+		{
+			int32_t index = forwardIndex.get(id.u.index);
+			if (index >= 0)
+			{
+				versions[index] = *frameIndex;
+			}
+		}
+
+		// frame index of the last write access to the component (0 if no component present for this entity)
+		uint32_t version(const ConstEntityId id) const
+		{
+			int32_t index = forwardIndex.get(id.u.index);
+			if (index < 0)
+			{
+				return 0;
+			}
+			return versions[index];
+		}
+
+		// true if the component was modified at the frame 'frame' or later
+		bool changed_since(const ConstEntityId id, uint32_t frame) const
+		{
+			int32_t index = forwardIndex.get(id.u.index);
+			if (index < 0)
+			{
+				return false;
+			}
+			return (versions[index] >= frame);
+		}
+
+		// component index (position in the storage) for the entity or -1 if no component present for this entity.
+		int32_t index_of(const ConstEntityId id) const
+		{
+			return forwardIndex.get(id.u.index);
+		}
+
+		// number of unique component values (only for components declared by ECS_DECLARE_COMPONENT_SHARED)
+		uint32_t unique_count() const
+		{
+			return dataBuffer.unique_count();
+		}
+
+		// contiguous array of the component field values (only for components declared by ECS_DECLARE_COMPONENT_SOA)
+		//   note: field access does not update component versions, use mark_changed()
+		template<uint32_t FIELD>
+		auto field() -> decltype(dataBuffer.template field<FIELD>())
+		{
+			return dataBuffer.template field<FIELD>();
+		}
+
+		template<uint32_t FIELD>
+		auto field() const -> decltype(static_cast<const ContainerType&>(dataBuffer).template field<FIELD>())
+		{
+			return dataBuffer.template field<FIELD>();
+		}
+
 		void erase(const EntityId id)
 		{
 			assert(dataBuffer.size() == backIndex.size());
-			if (id.u.index >= forwardIndex.size())
+
+			// convert EntityId to component index
+			int32_t componentIndex = forwardIndex.get(id.u.index);
+			if (componentIndex < 0)
 			{
 				return;
 			}
 
-			// convert EntityId to component index
-			uint32_t index = forwardIndex.at(id.u.index);
+			uint32_t index = componentIndex;
 			assert(index < dataBuffer.size());
 
 			uint32_t lastIndex = size() - 1;
+			eraseCount++;
+
+			// update fragmented range
+			isCustomOrder = false;
+			if (index < sortedComponentsCount)
+			{
+				sortedComponentsCount = index;
+			}
 
 			// Remove an element without preserving order of components.
 			// If the element is not the last element transfer the last element into its position
@@ -192,17 +811,28 @@ namespace ecs
 			{
 				//
 				backIndex[index] = std::move(backIndex[lastIndex] );
-				dataBuffer[index] = std::move(dataBuffer[lastIndex] );
+				versions[index] = versions[lastIndex];
+				move_component(dataBuffer, index, lastIndex);
 
 				// update forward index for moved component
 				EntityId movedEntityId = backIndex[index];
-				forwardIndex[movedEntityId.u.index] = index;
+				forwardIndex.set(movedEntityId.u.index, index);
 			}
 
 			// destroy component
 			backIndex.pop_back();
+			versions.pop_back();
 			dataBuffer.pop_back();
-			forwardIndex[id.u.index] = -1;
+			forwardIndex.reset(id.u.index);
+		}
+
+		// Batch version of erase
+		void erase(const EntityId* ids, uint32_t count)
+		{
+			for (uint32_t i = 0; i < count; i++)
+			{
+				erase(ids[i]);
+			}
 		}
 
 
@@ -211,54 +841,239 @@ namespace ecs
 		//    The order of the components corresponds to the order of entities.
 		//    This will improve the use of the CPU cache while iterating through components array.
 		//
+		//  Only the fragmented range of the storage is processed, the second consecutive call does nothing.
+		//
+		//  The target permutation is computed first, then it is applied cycle by cycle,
+		//  so every component is moved exactly once.
+		//  Small trivially copyable components (up to a cache line) are swapped in place instead (see internal::optimize_by_cycles).
+		//
 		//  Worst/Best/Average-case performance is O(n)
 		//    where is n is the number of components
 		//
 		/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 		void optimize()
 		{
-			//TODO: create and check for fragmentation flag
-			//      second consecutive call (OptimizeLayoutForCache) should not do anything
-			//
-			// set framgentation flags if entity or component created/destroyed
-			//    and reset this flag afrer defragmentation
+			if (is_optimized())
+			{
+				return;
+			}
+
+			optimize_full(internal::optimize_by_cycles<T>());
+		}
+
+		//
+		// Incremental version of optimize()
+		//    Process at most maxEntitiesCount entities and return true if the storage is fully optimized.
+		//    Next call continues from the same place (even if the storage was modified between calls).
+		//
+		//  Components are moved to the place by swaps (the cycles of the permutation can't be split into steps).
+		//
+		/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+		bool optimize(uint32_t maxEntitiesCount)
+		{
+			uint32_t componentsCount = size();
+			uint32_t tgtComponentIndex = sortedComponentsCount;
+
+			// nothing to do
+			if (tgtComponentIndex == componentsCount || isCustomOrder)
+			{
+				return true;
+			}
+
+			// components of all entities before this one are already in place
+			uint32_t tgtEntityIndex = (tgtComponentIndex > 0) ? (backIndex[tgtComponentIndex - 1].u.index + 1) : 0;
+
+			uint32_t budget = maxEntitiesCount;
+			while (tgtComponentIndex < componentsCount && budget > 0)
+			{
+				uint32_t pageIndex = (tgtEntityIndex >> sparse_index::pageSizeLog2);
+				uint32_t pageEnd = ((pageIndex + 1) << sparse_index::pageSizeLog2);
+
+				// There are no components for the whole range of entities, skip the page
+				if (forwardIndex.is_empty_page(pageIndex))
+				{
+					tgtEntityIndex = pageEnd;
+					continue;
+				}
+
+				uint32_t maxEntityIndex = pageEnd;
+				if (budget < (pageEnd - tgtEntityIndex))
+				{
+					maxEntityIndex = tgtEntityIndex + budget;
+				}
+				budget -= (maxEntityIndex - tgtEntityIndex);
 
+				for (; tgtEntityIndex < maxEntityIndex; tgtEntityIndex++)
+				{
+					// Get the index of the component currently used for the Entity[tgtEntityIndex]
+					int32_t srcComponentIndex = forwardIndex.get(tgtEntityIndex);
+
+					// If component index is invalid, Entity[tgtEntityIndex] does not contain component of such type, ignoring...
+					if (srcComponentIndex < 0)
+					{
+						continue;
+					}
+
+					// Sanity check
+					assert(backIndex[srcComponentIndex].u.index == tgtEntityIndex);
+					assert((uint32_t)srcComponentIndex >= tgtComponentIndex);
+
+					// Query entity index that is using our component slot.
+					uint32_t srcEntityIndex = backIndex[tgtComponentIndex].u.index;
+
+					// No need to optimize (component already stored in right place)
+					if (tgtEntityIndex == srcEntityIndex)
+					{
+						tgtComponentIndex++;
+						continue;
+					}
+
+					// Swap components data
+					swap_components(dataBuffer, srcComponentIndex, tgtComponentIndex);
+
+					// Update forward and back index
+					forwardIndex.set(srcEntityIndex, srcComponentIndex);
+					forwardIndex.set(tgtEntityIndex, tgtComponentIndex);
+					std::swap(backIndex[tgtComponentIndex], backIndex[srcComponentIndex]);
+					std::swap(versions[tgtComponentIndex], versions[srcComponentIndex]);
+
+					//
+					tgtComponentIndex++;
+				}
+			}
+
+			sortedComponentsCount = tgtComponentIndex;
+			return (sortedComponentsCount == componentsCount);
+		}
+
+		//
+		// Optimize storage data layout for the custom order of entities (e.g. ordered working set of the process)
+		//    Components of the listed entities are moved to the beginning of the storage in the order of the list,
+		//    components of all the other entities are stored after them.
+		//
+		//  The layout is kept until the storage is modified.
+		//
+		//  Worst/Best/Average-case performance is O(n)
+		//    where is n is the number of entities in the list
+		//
+		/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+		void optimize(const EntityId* order, uint32_t count)
+		{
 			uint32_t tgtComponentIndex = 0;
-			uint32_t maxEntityIndex = narrow_cast<uint32_t>(forwardIndex.size());
-			for (uint32_t tgtEntityIndex = 0; tgtEntityIndex < maxEntityIndex; tgtEntityIndex++)
+			for (uint32_t i = 0; i < count; i++)
 			{
+				uint32_t tgtEntityIndex = order[i].u.index;
+
 				// Get the index of the component currently used for the Entity[tgtEntityIndex]
-				int32_t srcComponentIndex = forwardIndex[tgtEntityIndex];
+				int32_t srcComponentIndex = forwardIndex.get(tgtEntityIndex);
 
-				// If component index is invalid, Entity[tgtEntityIndex] does not contain component of such type, ignoring...
+				// Entity does not contain component of such type, ignoring...
 				if (srcComponentIndex < 0)
 				{
 					continue;
 				}
 
-				// Sanity check
+				// Sanity check (entities in the list must be unique)
 				assert(backIndex[srcComponentIndex].u.index == tgtEntityIndex);
+				assert((uint32_t)srcComponentIndex >= tgtComponentIndex && "Duplicate entity in the list");
 
-				// Query entity index that is using our component slot.
-				uint32_t srcEntityIndex = backIndex[tgtComponentIndex].u.index;
+				if ((uint32_t)srcComponentIndex != tgtComponentIndex)
+				{
+					// Query entity index that is using our component slot.
+					uint32_t srcEntityIndex = backIndex[tgtComponentIndex].u.index;
+
+					// Swap components data
+					swap_components(dataBuffer, srcComponentIndex, tgtComponentIndex);
+
+					// Update forward and back index
+					forwardIndex.set(srcEntityIndex, srcComponentIndex);
+					forwardIndex.set(tgtEntityIndex, tgtComponentIndex);
+					std::swap(backIndex[tgtComponentIndex], backIndex[srcComponentIndex]);
+					std::swap(versions[tgtComponentIndex], versions[srcComponentIndex]);
+				}
 
-				// No need to optimize (component already stored in right place)
-				if (tgtEntityIndex == srcEntityIndex)
+				tgtComponentIndex++;
+			}
+
+			sortedComponentsCount = 0;
+			isCustomOrder = true;
+		}
+
+		//
+		// Sort the storage by the user key (e.g. material/depth key of renderables)
+		//    keyFn(const T&) must return 32 or 64 bit unsigned key, the order of components with equal keys is kept.
+		//
+		//  The layout is kept until the storage is modified (same as optimize(order, count)).
+		//
+		//  Worst/Best/Average-case performance is O(n)
+		//    stable LSD radix sort over (key, component index) + single permutation pass.
+		//    if threadsCount > 1, the keys and the radix sort passes are computed in parallel.
+		//
+		/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+		template<typename TKeyFunc>
+		void sort_by(const TKeyFunc& keyFn, uint32_t threadsCount = 1)
+		{
+			typedef typename std::decay<decltype(keyFn(std::declval<const T&>()))>::type TKeyResult;
+			static_assert(std::is_unsigned<TKeyResult>::value && sizeof(TKeyResult) <= sizeof(uint64_t), "Sort key must be unsigned integer");
+			typedef typename std::conditional<(sizeof(TKeyResult) <= sizeof(uint32_t)), uint32_t, uint64_t>::type TKey;
+
+			uint32_t count = size();
+			if (count == 0)
+			{
+				return;
+			}
+
+			ecs::vector<sort_item<TKey>> items;
+			items.resize(count);
+
+			const ContainerType& data = dataBuffer;
+			auto computeKeys = [&](uint32_t first, uint32_t last)
+			{
+				for (uint32_t i = first; i < last; i++)
 				{
-					tgtComponentIndex++;
-					continue;
+					items[i].key = TKey(keyFn(data[i]));
+					items[i].index = i;
 				}
+			};
 
-				// Swap components data
-				std::swap(dataBuffer[srcComponentIndex], dataBuffer[tgtComponentIndex]);
+			if (threadsCount > 1 && count >= threadsCount * 4096)
+			{
+				uint32_t itemsPerThread = (count + threadsCount - 1) / threadsCount;
+				internal::ParallelFor(threadsCount, [&](uint32_t threadIndex)
+				{
+					uint32_t first = std::min(count, threadIndex * itemsPerThread);
+					computeKeys(first, std::min(count, first + itemsPerThread));
+				});
+			}
+			else
+			{
+				computeKeys(0, count);
+			}
 
-				// Update forward and back index
-				std::swap(forwardIndex[srcEntityIndex], forwardIndex[tgtEntityIndex]);
-				std::swap(backIndex[tgtComponentIndex], backIndex[srcComponentIndex]);
+			{
+				ecs::vector<sort_item<TKey>> tmp;
+				tmp.resize(count);
+				radix_sort(items.data(), tmp.data(), count, threadsCount);
+			}
 
-				//
-				tgtComponentIndex++;
+			// (key, index) pairs -> permutation
+			ecs::vector<uint32_t> permutation;
+			permutation.resize(count);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				permutation[i] = items[i].index;
 			}
+
+			apply_permutation(permutation.data(), count);
+
+			sortedComponentsCount = 0;
+			isCustomOrder = true;
+		}
+
+		// true if the components are stored in the order of entities (or in the custom order)
+		bool is_optimized() const
+		{
+			return (sortedComponentsCount == size()) || isCustomOrder;
 		}
 
 
@@ -272,14 +1087,127 @@ namespace ecs
 			optimize();
 		}
 
-		virtual void push_back_v(const EntityId id, void* pMem, size_t sizeOf, size_t alignOf)
+		virtual bool optimize_step_v(uint32_t maxEntitiesCount) override
+		{
+			return optimize(maxEntitiesCount);
+		}
+
+		virtual void optimize_order_v(const EntityId* order, uint32_t count) override
+		{
+			optimize(order, count);
+		}
+
+		virtual uint32_t fragmented_count_v() const override
+		{
+			return isCustomOrder ? 0 : (size() - sortedComponentsCount);
+		}
+
+		virtual void get_stats_v(StorageStats& r) const override
+		{
+			r = stats();
+		}
+
+		virtual void reset_stats_v() override
+		{
+			reset_stats();
+		}
+
+		virtual bool build_optimize_permutation_v(ecs::vector<uint32_t>& permutation, ecs::vector<uint32_t>& cycles) override
+		{
+			uint32_t componentsCount = size();
+			build_entities_order_permutation(permutation);
+
+			// find cycles (mark visited positions by the high bit)
+			const uint32_t visitedBit = 0x80000000;
+			cycles.clear();
+			for (uint32_t i = sortedComponentsCount; i < componentsCount; i++)
+			{
+				if ((permutation[i] & visitedBit) != 0 || permutation[i] == i)
+				{
+					continue;
+				}
+
+				cycles.push_back(i);
+				uint32_t cur = i;
+				do
+				{
+					uint32_t next = permutation[cur];
+					permutation[cur] |= visitedBit;
+					cur = next;
+				} while (cur != i);
+			}
+
+			for (uint32_t i = sortedComponentsCount; i < componentsCount; i++)
+			{
+				permutation[i] &= ~visitedBit;
+			}
+
+			return true;
+		}
+
+		virtual void apply_permutation_cycle_v(uint32_t* permutation, uint32_t start) override
+		{
+			apply_permutation_cycle(permutation, start);
+		}
+
+		virtual void finish_optimize_permutation_v() override
+		{
+			sortedComponentsCount = size();
+		}
+
+		virtual void flip_v() override
+		{
+			flip_components(dataBuffer);
+		}
+
+		virtual void release_memory_v() override
+		{
+			release_memory(dataBuffer);
+		}
+
+		virtual size_t trim_v(const TrimPolicy& policy) override
+		{
+			return trim(policy);
+		}
+
+		virtual void push_back_v(const EntityId id, void* pMem, size_t sizeOf, size_t alignOf) override
 		{
 			assert(sizeOf == sizeof(T));
-			assert(alignOf == __alignof(T));
+			assert(alignOf >= __alignof(T) && ((uintptr_t)pMem % __alignof(T)) == 0);
 			T& value = *(T*)pMem;
 			push_back(id, std::move(value));
 		}
 
+		virtual size_t component_size_v() const override
+		{
+			return sizeof(T);
+		}
+
+		// declared alignment (see ECS_DECLARE_COMPONENT_ALIGNMENT), components moved out of the storage must keep it
+		virtual size_t component_align_v() const override
+		{
+			return component_alignment<T>::value;
+		}
+
+		virtual bool is_trivially_copyable_v() const override
+		{
+			return std::is_trivially_copyable<T>::value;
+		}
+
+		virtual void move_out_v(const EntityId id, void* pMem) override
+		{
+			int32_t index = forwardIndex.get(id.u.index);
+			assert(index >= 0 && "Component of this type is not present in this entity.");
+			extract_component(dataBuffer, index, (T*)pMem);
+			erase(id);
+		}
+
+		virtual void destroy_value_v(void* pMem) override
+		{
+			T* p = (T*)pMem;
+			p->~T();
+		}
+
 
 
 
@@ -288,6 +1216,178 @@ namespace ecs
 	};
 
 
+	//
+	// Storage for the tag components
+	//
+	//  Tags have no data, so there is nothing to store: the component presence is the bit in the entity components mask.
+	//  The storage is not registered in the storage directory, so entity destruction and the Dispatcher skip it entirely.
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename T>
+	class ComponentsStorage<T, true> : public IComponentsStorage
+	{
+		// all entities share the same tag instance
+		T value;
+
+		// non copyable
+		ComponentsStorage(ComponentsStorage&);
+		void operator=(ComponentsStorage&);
+
+	public:
+
+		ComponentsStorage()
+		{
+			static_assert(std::is_default_constructible<T>::value, "Tag component must be default constructible");
+		}
+
+		void push_back(const EntityId /*id*/, T&& /*v*/)
+		{
+		}
+
+		void push_back(const EntityId* /*ids*/, T* /*values*/, uint32_t /*count*/)
+		{
+		}
+
+		void erase(const EntityId /*id*/)
+		{
+		}
+
+		void erase(const EntityId* /*ids*/, uint32_t /*count*/)
+		{
+		}
+
+		void optimize()
+		{
+		}
+
+		bool optimize(uint32_t /*maxEntitiesCount*/)
+		{
+			return true;
+		}
+
+		void optimize(const EntityId* /*order*/, uint32_t /*count*/)
+		{
+		}
+
+		template<typename TKeyFunc>
+		void sort_by(const TKeyFunc& /*keyFn*/, uint32_t /*threadsCount*/ = 1)
+		{
+		}
+
+		void mark_changed(const EntityId /*id*/)
+		{
+		}
+
+		uint32_t version(const ConstEntityId /*id*/) const
+		{
+			return 0;
+		}
+
+		bool changed_since(const ConstEntityId /*id*/, uint32_t /*frame*/) const
+		{
+			return false;
+		}
+
+		bool is_optimized() const
+		{
+			return true;
+		}
+
+		T* get(const EntityId id)
+		{
+			return internal::HasComponentBit(id, ecs::GetComponentTypeIndex<T>()) ? &value : nullptr;
+		}
+
+		const T* get(const ConstEntityId id) const
+		{
+			return internal::HasComponentBit(id, ecs::GetComponentTypeIndex<T>()) ? &value : nullptr;
+		}
+
+		virtual void erase_v(const EntityId /*id*/) override
+		{
+		}
+
+		virtual void optimize_v() override
+		{
+		}
+
+		virtual bool optimize_step_v(uint32_t /*maxEntitiesCount*/) override
+		{
+			return true;
+		}
+
+		virtual void optimize_order_v(const EntityId* /*order*/, uint32_t /*count*/) override
+		{
+		}
+
+		virtual uint32_t fragmented_count_v() const override
+		{
+			return 0;
+		}
+
+		virtual bool build_optimize_permutation_v(ecs::vector<uint32_t>& /*permutation*/, ecs::vector<uint32_t>& /*cycles*/) override
+		{
+			return false;
+		}
+
+		virtual void apply_permutation_cycle_v(uint32_t* /*permutation*/, uint32_t /*start*/) override
+		{
+		}
+
+		virtual void finish_optimize_permutation_v() override
+		{
+		}
+
+		virtual void flip_v() override
+		{
+		}
+
+		virtual void release_memory_v() override
+		{
+		}
+
+		virtual size_t trim_v(const TrimPolicy& /*policy*/) override
+		{
+			return 0;
+		}
+
+		virtual size_t component_size_v() const override
+		{
+			return 0;
+		}
+
+		virtual size_t component_align_v() const override
+		{
+			return 1;
+		}
+
+		virtual bool is_trivially_copyable_v() const override
+		{
+			return true;
+		}
+
+		virtual void move_out_v(const EntityId /*id*/, void* /*pMem*/) override
+		{
+		}
+
+		virtual void destroy_value_v(void* /*pMem*/) override
+		{
+		}
+
+		virtual void push_back_v(const EntityId /*id*/, void* /*pMem*/, size_t /*sizeOf*/, size_t /*alignOf*/) override
+		{
+		}
+
+		virtual void get_stats_v(StorageStats& r) const override
+		{
+			r = StorageStats();
+			r.componentTypeIndex = ecs::GetComponentTypeIndex<T>();
+		}
+
+		virtual void reset_stats_v() override
+		{
+		}
+	};
 
 }
 
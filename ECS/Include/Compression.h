@@ -0,0 +1,49 @@
+// The MIT License (MIT)
+//
+// 	Copyright (c) 2017 Sergey Makeev
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy
+// 	of this software and associated documentation files (the "Software"), to deal
+// 	in the Software without restriction, including without limitation the rights
+// 	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// 	copies of the Software, and to permit persons to whom the Software is
+// 	furnished to do so, subject to the following conditions:
+//
+//      The above copyright notice and this permission notice shall be included in
+// 	all copies or substantial portions of the Software.
+//
+// 	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// 	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// 	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// 	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// 	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// 	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// 	THE SOFTWARE.
+#pragma once
+
+
+
+#include <stdint.h>
+
+
+namespace ecs
+{
+	namespace lz
+	{
+		//
+		// Simple and fast LZ77 byte-oriented compression (LZ4-like format)
+		//
+		//  Used to store cold data (see ecs::Hibernate)
+		//
+		/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// maximum size of the compressed data
+		uint32_t CompressBound(uint32_t srcSize);
+
+		// returns the size of the compressed data or 0 if the data does not fit to dstCapacity
+		uint32_t Compress(const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t dstCapacity);
+
+		// returns false if the compressed data is corrupted or the decompressed size is not equal to dstSize
+		bool Decompress(const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t dstSize);
+	}
+}
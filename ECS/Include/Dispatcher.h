@@ -23,6 +23,8 @@
 
 #include <atomic>
 #include <memory>
+#include <cstring>
+#include <type_traits>
 #include "Memory.h"
 #include "EntityID.h"
 
@@ -334,12 +336,18 @@ namespace ecs
 						AddComponentBase* cmd = (AddComponentBase*)head;
 						currentOffset += cmd->commandSizeInBytes;
 
+						// tag components have no storage
 						IComponentsStorage* storage = cmd->storage;
+						if (storage)
+						{
+							storage->push_back_v(cmd->header.id, cmd->pComponent, cmd->sizeOf, cmd->alignOf);
+						}
 
-						storage->push_back_v(cmd->header.id, cmd->pComponent, cmd->sizeOf, cmd->alignOf);
-
-						//call dtor
-						cmd->destroyFunc(cmd->pComponent);
+						//call dtor (nullptr for trivially destructible runtime components)
+						if (cmd->destroyFunc)
+						{
+							cmd->destroyFunc(cmd->pComponent);
+						}
 
 						ecs::internal::SetComponentBit(cmd->header.id, cmd->componentTypeIndex);
 					}
@@ -349,7 +357,10 @@ namespace ecs
 						RemoveComponentCmd* cmd = (RemoveComponentCmd*)head;
 						currentOffset += sizeof(RemoveComponentCmd);
 						IComponentsStorage* storage = cmd->storage;
-						storage->erase_v(cmd->header.id);
+						if (storage)
+						{
+							storage->erase_v(cmd->header.id);
+						}
 
 						ecs::internal::ResetComponentBit(cmd->header.id, cmd->componentTypeIndex);
 					}
@@ -433,21 +444,21 @@ namespace ecs
 		{
 			assert(IsLocked() == true && "Dispatcher is not locked!");
 
-			ComponentsStorage<T>& storage = ecs::GetComponentStorage<std::remove_const<T>::type>();
+			ComponentsStorage<T>& storage = ecs::GetComponentStorage<typename std::remove_const<T>::type>();
 
 			typedef AddComponentCmd<T> CommandType;
 
 			CommandType* cmd = (CommandType*)alloc(sizeof(CommandType));
 			cmd->base.header.opcode = ADD_COMPONENT;
 			cmd->base.header.id = EntityId::internal::CreateFromConst(id);
-			cmd->base.storage = &storage;
+			cmd->base.storage = is_tag_component<T>::value ? nullptr : &storage;
 			cmd->base.sizeOf = sizeof(T);
 			cmd->base.alignOf = __alignof(T);
 			cmd->base.commandSizeInBytes = sizeof(CommandType);
-			cmd->base.componentTypeIndex = ecs::GetComponentTypeIndex<std::remove_const<T>::type>();
+			cmd->base.componentTypeIndex = ecs::GetComponentTypeIndex<typename std::remove_const<T>::type>();
 
-			// store func (unique for each type T) to deffered call dtor
-			cmd->base.destroyFunc = &CommandType::CallDtor;
+			// store func (unique for each type T) to deffered call dtor (no need to call trivial dtor)
+			cmd->base.destroyFunc = std::is_trivially_destructible<T>::value ? nullptr : &CommandType::CallDtor;
 
 			cmd->base.pComponent = (void *)::std::addressof(cmd->storage);
 			
@@ -460,13 +471,58 @@ namespace ecs
 		void Invoke_RemoveComponent(EntityId id)
 		{
 			assert(IsLocked() == true && "Dispatcher is not locked!");
-			ComponentsStorage<T>& storage = ecs::GetComponentStorage<std::remove_const<T>::type>();
+			ComponentsStorage<T>& storage = ecs::GetComponentStorage<typename std::remove_const<T>::type>();
+
+			RemoveComponentCmd* cmd = (RemoveComponentCmd*)alloc(sizeof(RemoveComponentCmd));
+			cmd->header.opcode = REMOVE_COMPONENT;
+			cmd->header.id = EntityId::internal::CreateFromConst(id);
+			cmd->storage = is_tag_component<T>::value ? nullptr : &storage;
+			cmd->componentTypeIndex = ecs::GetComponentTypeIndex<typename std::remove_const<T>::type>();
+		}
+
+		//
+		// Runtime-described component (value is move-constructed by moveFunc or copied if moveFunc is nullptr)
+		//
+		void Invoke_AddComponent(EntityId id, uint32_t componentTypeIndex, IComponentsStorage* storage, void* pValue,
+			uint32_t sizeOf, uint32_t alignOf, void(*moveFunc)(void*, void*), void(*destroyFunc)(void*))
+		{
+			assert(IsLocked() == true && "Dispatcher is not locked!");
+			assert(alignOf <= defaultAlignment && "Unsupported component alignment");
+
+			uint32_t valueOffset = Align(sizeof(AddComponentBase), alignOf);
+			uint32_t commandSize = valueOffset + sizeOf;
+
+			uint8_t* pMemory = alloc(commandSize);
+			AddComponentBase* cmd = (AddComponentBase*)pMemory;
+			cmd->header.opcode = ADD_COMPONENT;
+			cmd->header.id = EntityId::internal::CreateFromConst(id);
+			cmd->storage = storage;
+			cmd->sizeOf = sizeOf;
+			cmd->alignOf = alignOf;
+			cmd->commandSizeInBytes = commandSize;
+			cmd->componentTypeIndex = componentTypeIndex;
+			cmd->destroyFunc = destroyFunc;
+			cmd->pComponent = pMemory + valueOffset;
+
+			if (moveFunc)
+			{
+				moveFunc(cmd->pComponent, pValue);
+			}
+			else
+			{
+				std::memcpy(cmd->pComponent, pValue, sizeOf);
+			}
+		}
+
+		void Invoke_RemoveComponent(EntityId id, uint32_t componentTypeIndex, IComponentsStorage* storage)
+		{
+			assert(IsLocked() == true && "Dispatcher is not locked!");
 
 			RemoveComponentCmd* cmd = (RemoveComponentCmd*)alloc(sizeof(RemoveComponentCmd));
 			cmd->header.opcode = REMOVE_COMPONENT;
 			cmd->header.id = EntityId::internal::CreateFromConst(id);
-			cmd->storage = &storage;
-			cmd->componentTypeIndex = ecs::GetComponentTypeIndex<std::remove_const<T>::type>();
+			cmd->storage = storage;
+			cmd->componentTypeIndex = componentTypeIndex;
 		}
 
 
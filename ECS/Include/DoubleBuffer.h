@@ -0,0 +1,201 @@
+// The MIT License (MIT)
+//
+// 	Copyright (c) 2017 Sergey Makeev
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy
+// 	of this software and associated documentation files (the "Software"), to deal
+// 	in the Software without restriction, including without limitation the rights
+// 	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// 	copies of the Software, and to permit persons to whom the Software is
+// 	furnished to do so, subject to the following conditions:
+//
+//      The above copyright notice and this permission notice shall be included in
+// 	all copies or substantial portions of the Software.
+//
+// 	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// 	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// 	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// 	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// 	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// 	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// 	THE SOFTWARE.
+#pragma once
+
+
+
+#include <stdint.h>
+#include <assert.h>
+#include <algorithm>
+#include <utility>
+#include "ComponentTraits.h"
+#include "Memory.h"
+#include "Utils.h"
+
+
+namespace ecs
+{
+
+	//
+	// Double-buffered container
+	//
+	//  Keeps two copies of the components data: the previous frame (read-only) and the current frame (writable).
+	//  Read-only access returns the value of the previous frame, mutable access returns the value of the current frame,
+	//  so processes that read the previous frame and processes that write the current frame can run in parallel.
+	//
+	//  flip() is called at the end of ecs::Update, the current frame becomes the previous frame
+	//    and the new current frame starts from the same values.
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename T>
+	class double_buffer
+	{
+		typedef ecs::vector<T, component_alignment<T>::value> buffer_type;
+
+		buffer_type buffers[2];
+		uint32_t currentBuffer;
+
+		// non copyable
+		double_buffer(double_buffer&);
+		void operator=(double_buffer&);
+
+		buffer_type& current()
+		{
+			return buffers[currentBuffer];
+		}
+
+		buffer_type& previous()
+		{
+			return buffers[currentBuffer ^ 1];
+		}
+
+		const buffer_type& previous() const
+		{
+			return buffers[currentBuffer ^ 1];
+		}
+
+	public:
+
+		double_buffer()
+			: currentBuffer(0)
+		{
+		}
+
+		uint32_t size() const
+		{
+			assert(buffers[0].size() == buffers[1].size());
+			return narrow_cast<uint32_t>(buffers[0].size());
+		}
+
+		bool empty() const
+		{
+			return buffers[0].empty();
+		}
+
+		uint32_t capacity() const
+		{
+			return narrow_cast<uint32_t>(buffers[0].capacity());
+		}
+
+		// number of bytes used by both buffers
+		size_t memory_footprint() const
+		{
+			return (buffers[0].capacity() + buffers[1].capacity()) * sizeof(T);
+		}
+
+		void reserve(uint32_t newCapacity)
+		{
+			buffers[0].reserve(newCapacity);
+			buffers[1].reserve(newCapacity);
+		}
+
+		void push_back(T&& v)
+		{
+			// new component is visible in both frames
+			previous().push_back(v);
+			current().push_back(std::move(v));
+		}
+
+		void pop_back()
+		{
+			buffers[0].pop_back();
+			buffers[1].pop_back();
+		}
+
+		// dst = src
+		void move(uint32_t dstIndex, uint32_t srcIndex)
+		{
+			buffers[0][dstIndex] = std::move(buffers[0][srcIndex]);
+			buffers[1][dstIndex] = std::move(buffers[1][srcIndex]);
+		}
+
+		void swap(uint32_t indexA, uint32_t indexB)
+		{
+			std::swap(buffers[0][indexA], buffers[0][indexB]);
+			std::swap(buffers[1][indexA], buffers[1][indexB]);
+		}
+
+		// apply the cycle of the permutation to both buffers
+		void rotate(const uint32_t* permutation, uint32_t start)
+		{
+			rotate_components(buffers[0], permutation, start);
+			rotate_components(buffers[1], permutation, start);
+		}
+
+		// current frame becomes the previous frame
+		void flip()
+		{
+			currentBuffer ^= 1;
+
+			// new current frame starts from the values of the previous frame
+			std::copy(previous().begin(), previous().end(), current().begin());
+		}
+
+		// read-only access (previous frame)
+		const T& operator[] (uint32_t index) const
+		{
+			return previous()[index];
+		}
+
+		// write access (current frame)
+		T& operator[] (uint32_t index)
+		{
+			return current()[index];
+		}
+	};
+
+
+	//
+	// Element-wise operations used by ComponentsStorage<T>
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename T>
+	inline void move_component(double_buffer<T>& container, uint32_t dstIndex, uint32_t srcIndex)
+	{
+		container.move(dstIndex, srcIndex);
+	}
+
+	template<typename T>
+	inline void swap_components(double_buffer<T>& container, uint32_t indexA, uint32_t indexB)
+	{
+		container.swap(indexA, indexB);
+	}
+
+	template<typename T>
+	inline void rotate_components(double_buffer<T>& container, const uint32_t* permutation, uint32_t start)
+	{
+		container.rotate(permutation, start);
+	}
+
+	template<typename T>
+	inline size_t memory_footprint(const double_buffer<T>& container)
+	{
+		return container.memory_footprint();
+	}
+
+	template<typename T>
+	inline void flip_components(double_buffer<T>& container)
+	{
+		container.flip();
+	}
+
+}
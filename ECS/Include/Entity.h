@@ -25,15 +25,21 @@
 #include <stdint.h>
 
 #include "Component.h"
-#include "EntityId.h"
+#include "EntityID.h"
 #include "ComponentsStorage.h"
+#include "Platform.h"
 #include "BitSet.h"
+#include "Archetype.h"
 #include "Utils.h"
 #include "Memory.h"
 #include "Dispatcher.h"
+#include "RuntimeComponent.h"
 
 
-#define ecs_force_inline __forceinline
+// Store the entity arrays (Context::entitiesDesc / entitiesArchetypes) in virtual memory reserved arrays
+#ifndef ECS_RESERVED_ENTITY_STORAGE
+#define ECS_RESERVED_ENTITY_STORAGE (0)
+#endif
 
 
 
@@ -43,6 +49,7 @@ namespace ecs
 
 	// forward decl
 	uint32_t& GlobalIdCounter();
+	uint32_t& GlobalFrameIndex();
 	struct IProcessBase;
 
 	//list of constant entites id
@@ -111,7 +118,7 @@ namespace ecs
 				return *this;
 			}
 
-			ecs_force_inline typename TAspect operator* () const
+			ecs_force_inline TAspect operator* () const
 			{
 				const auto& id = entityList[index];
 				return TAspect::Create(id);
@@ -146,6 +153,98 @@ namespace ecs
 	};
 
 
+	//
+	// Entity enumerator (only entities with component TComponent changed at the frame 'sinceFrame' or later)
+	//
+	/////////////////////////////////////////////////////////////////////////////////
+	template<typename TAspect, typename TEntityList, typename TComponent>
+	class TChangedEntityEnumerator
+	{
+	protected:
+		const TEntityList& entityList;
+		const ComponentsStorage<TComponent>& storage;
+		uint32_t sinceFrame;
+		uint32_t firstValidElementIndex;
+		uint32_t firstInvalidElementIndex;
+
+	public:
+
+		/////////////////////////////////////////////////////////////////////////////////
+		struct iterator
+		{
+			const TChangedEntityEnumerator& enumerator;
+			uint32_t index;
+
+			iterator(const TChangedEntityEnumerator& _enumerator, uint32_t _index)
+				: enumerator(_enumerator)
+				, index(_index)
+			{
+				SkipUnchanged();
+			}
+
+			ecs_force_inline void SkipUnchanged()
+			{
+				while (index < enumerator.firstInvalidElementIndex && !enumerator.storage.changed_since(enumerator.entityList[index], enumerator.sinceFrame))
+				{
+					index++;
+				}
+			}
+
+			ecs_force_inline bool operator != (const iterator& other) const
+			{
+				if (&enumerator != &other.enumerator)
+					return true;
+
+				if (index != other.index)
+					return true;
+
+				return false;
+			}
+
+			ecs_force_inline iterator& operator++ ()
+			{
+				index++;
+				SkipUnchanged();
+				return *this;
+			}
+
+			ecs_force_inline TAspect operator* () const
+			{
+				const auto& id = enumerator.entityList[index];
+				return TAspect::Create(id);
+			}
+		};
+
+		TChangedEntityEnumerator(const TEntityList& list, uint32_t _sinceFrame, const Bucket* bucket)
+			: entityList(list)
+			, storage(GetComponentStorage<TComponent>())
+			, sinceFrame(_sinceFrame)
+		{
+			if (bucket)
+			{
+				firstValidElementIndex = bucket->from;
+				firstInvalidElementIndex = bucket->to + 1;
+			} else
+			{
+				firstValidElementIndex = 0;
+				firstInvalidElementIndex = narrow_cast<uint32_t>(list.size());
+			}
+
+			assert(firstInvalidElementIndex >= firstValidElementIndex);
+		}
+
+		inline iterator begin()
+		{
+			return iterator(*this, firstValidElementIndex);
+		}
+
+		inline iterator end()
+		{
+			return iterator(*this, firstInvalidElementIndex);
+		}
+	};
+
+
 	//
 	// internal
 	//
@@ -170,9 +269,11 @@ namespace ecs
 			// id
 			EntityId id;
 
-			// index inside usedEntitiesIds
+			// index inside usedEntitiesIds (or index inside hibernatedEntities if HibernatedFlag is set)
 			uint32_t usedIndex;
 
+			static const uint32_t HibernatedFlag = 0x80000000;
+
 			EntityDesc(EntityId _id, uint32_t _usedIndex)
 				: id(_id)
 				, usedIndex(_usedIndex)
@@ -181,16 +282,42 @@ namespace ecs
 		};
 		static_assert(sizeof(EntityDesc) <= 64, "sizeof(EntityDesc) > 64");
 
+#if ECS_RESERVED_ENTITY_STORAGE
+		// virtual memory reserved arrays (stable addresses, no reallocations, DestroyAll returns the memory to the OS)
+		typedef ecs::reserved_vector<EntityDesc> EntityStorage;
+		typedef ecs::reserved_vector<ArchetypeId> EntityArchetypeStorage;
+#else
 		typedef ecs::vector<EntityDesc> EntityStorage;
-		typedef ecs::vector<bitset> EntityMaskStorage;
+		typedef ecs::vector<ArchetypeId> EntityArchetypeStorage;
+#endif
 		typedef ecs::vector<IProcessBase*> ProcessList;
 
+		//
+		// Cold storage of the hibernated entity (see ecs::Hibernate)
+		//
+		//  data : table of components (type index, offset) + components data (optionally compressed)
+		//
+		struct HibernatedEntity
+		{
+			ArchetypeId archetype;
+			uint8_t* data;
+			uint32_t rawSize;
+			uint32_t storedSize;
+			// alignment of the raw (uncompressed) block, the largest alignment of the components
+			uint32_t alignment;
+			uint32_t componentsCount;
+			uint32_t isCompressed;
+			uint32_t isUsed;
+		};
+
+		typedef ecs::vector<HibernatedEntity> HibernatedEntityStorage;
+
 		struct Context
 		{
 			ContextState::Type state;
 			Dispatcher dispatcher;
 			EntityStorage entitiesDesc;
-			EntityMaskStorage entitiesMasks;
+			EntityArchetypeStorage entitiesArchetypes;
 			EntityList unorderedUsedEntitiesIds;
 			ConstEntityList changedEntitiesIds;
 			ProcessList processList;
@@ -199,6 +326,19 @@ namespace ecs
 			EntityList orderedUsedEntitiesIds;
 			bool needRebuildOrderedList;
 
+			// storage to continue incremental layout optimization from
+			uint32_t optimizeStorageIndex;
+
+			// hibernated entities and unused slots of hibernatedEntities
+			HibernatedEntityStorage hibernatedEntities;
+			ecs::vector<uint32_t> freeHibernatedSlots;
+
+			// unique components masks (entitiesArchetypes[] is the index inside this table)
+			archetype_table archetypes;
+
+			// worker threads of the parallel algorithms (see internal::ParallelFor)
+			worker_pool workers;
+
 			Context();
 
 			inline void NeedRebuildOrderedList()
@@ -229,6 +369,47 @@ namespace ecs
 
 		Context& GetContext();
 
+		// fwd decl
+		void DestroyHibernated(uint32_t index);
+		void DestroyAllHibernated();
+
+		////////////////////////////////////////////////////////////////////////////////////
+		inline void RemoveFromUsedList(uint32_t index)
+		{
+			internal::EntityStorage& entitiesDesc = internal::GetContext().entitiesDesc;
+			EntityList& unorderedUsedEntitiesIds = internal::GetContext().unorderedUsedEntitiesIds;
+
+			uint32_t usedIndex = entitiesDesc[index].usedIndex;
+			assert(!unorderedUsedEntitiesIds.empty());
+			uint32_t lastUsedIndex = narrow_cast<uint32_t>(unorderedUsedEntitiesIds.size()) - 1;
+
+			// Remove an element without preserving order of components.
+			// If the element is not the last element transfer the last element into its position
+			if (usedIndex != lastUsedIndex)
+			{
+				EntityId lastEntityId = unorderedUsedEntitiesIds[lastUsedIndex];
+				unorderedUsedEntitiesIds[usedIndex] = lastEntityId;
+
+				// update reverse index (usedIndex) to affected entity
+				entitiesDesc[lastEntityId.u.index].usedIndex = usedIndex;
+			}
+			unorderedUsedEntitiesIds.pop_back();
+
+			internal::GetContext().NeedRebuildOrderedList();
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////
+		inline void AddToUsedList(EntityId id)
+		{
+			internal::EntityStorage& entitiesDesc = internal::GetContext().entitiesDesc;
+			EntityList& unorderedUsedEntitiesIds = internal::GetContext().unorderedUsedEntitiesIds;
+
+			entitiesDesc[id.u.index].usedIndex = narrow_cast<uint32_t>(unorderedUsedEntitiesIds.size());
+			unorderedUsedEntitiesIds.push_back(id);
+
+			internal::GetContext().NeedRebuildOrderedList();
+		}
+
 		////////////////////////////////////////////////////////////////////////////////////
 		template<bool NEED_UPDATE_REVERSE_INDEX>
 		inline void Destroy(uint32_t index)
@@ -236,7 +417,7 @@ namespace ecs
 			assert(internal::GetContext().state == internal::ContextState::MUTABLE);
 
 			internal::EntityStorage& entitiesDesc = internal::GetContext().entitiesDesc;
-			internal::EntityMaskStorage& entitiesMasks = internal::GetContext().entitiesMasks;
+			internal::EntityArchetypeStorage& entitiesArchetypes = internal::GetContext().entitiesArchetypes;
 
 			// Copy actual entity Id
 			EntityId id = entitiesDesc[index].id;
@@ -244,46 +425,37 @@ namespace ecs
 			// Invalidate index
 			entitiesDesc[index].id.Invalidate();
 
+			// Hibernated entity (no components in the storages and not in the usedEntitiesIds)
+			if (entitiesDesc[index].usedIndex & EntityDesc::HibernatedFlag)
+			{
+				DestroyHibernated(index);
+			}
 			// Destroy from usedEntitiesIds (reverse index to O(1) mapping between EntityId -> usedEntitiesIds[])
-			if (NEED_UPDATE_REVERSE_INDEX)
+			else if (NEED_UPDATE_REVERSE_INDEX)
 			{
-				EntityList& unorderedUsedEntitiesIds = internal::GetContext().unorderedUsedEntitiesIds;
-
-				uint32_t usedIndex = entitiesDesc[index].usedIndex;
-				assert(!unorderedUsedEntitiesIds.empty());
-				uint32_t lastUsedIndex = narrow_cast<uint32_t>(unorderedUsedEntitiesIds.size()) - 1;
-
-				// Remove an element without preserving order of components.
-				// If the element is not the last element transfer the last element into its position
-				if (usedIndex != lastUsedIndex)
-				{
-					EntityId lastEntityId = unorderedUsedEntitiesIds[lastUsedIndex];
-					unorderedUsedEntitiesIds[usedIndex] = lastEntityId;
-
-					// update reverse index (usedIndex) to affected entity
-					entitiesDesc[lastEntityId.u.index].usedIndex = usedIndex;
-				}
-				unorderedUsedEntitiesIds.pop_back();
-
-				internal::GetContext().NeedRebuildOrderedList();
+				RemoveFromUsedList(index);
 			}
 
 			// Destroy all entity components
 			std::array<IComponentsStorage*, bitset::MaxBitCount::value>& storageDir = GetStorageDirectory();
 
-			const bitset& componentsMask = entitiesMasks[index];
+			const bitset& componentsMask = internal::GetContext().archetypes.mask(entitiesArchetypes[index]);
 			for (auto it = componentsMask.begin(); it != componentsMask.end(); ++it)
 			{
 				uint32_t componentTypeIndex = *it;
 				assert(componentTypeIndex < bitset::MaxBitCount::value && "Invalid component type index.");
 				IComponentsStorage* storage = storageDir[componentTypeIndex];
-				assert(storage);
-				storage->erase_v(id);
+
+				// tag components have no storage
+				if (storage)
+				{
+					storage->erase_v(id);
+				}
 			}
 
 			// Call dtor's
 			entitiesDesc[index].~EntityDesc();
-			entitiesMasks[index].~bitset();
+			entitiesArchetypes[index] = archetype_table::emptyArchetype;
 		}
 
 		////////////////////////////////////////////////////////////////////////////////////
@@ -293,7 +465,7 @@ namespace ecs
 
 			EntityList& unorderedUsedEntitiesIds = internal::GetContext().unorderedUsedEntitiesIds;
 			internal::EntityStorage& entitiesDesc = internal::GetContext().entitiesDesc;
-			internal::EntityMaskStorage& entitiesMasks = internal::GetContext().entitiesMasks;
+			internal::EntityArchetypeStorage& entitiesArchetypes = internal::GetContext().entitiesArchetypes;
 
 			// first free entity index
 			uint32_t maxEntityIndex = narrow_cast<uint32_t>(entitiesDesc.size());
@@ -302,7 +474,7 @@ namespace ecs
 			uint32_t maxUsedEntitiesIds = narrow_cast<uint32_t>(unorderedUsedEntitiesIds.size());
 
 			// sanity check
-			assert(entitiesDesc.size() == entitiesMasks.size());
+			assert(entitiesDesc.size() == entitiesArchetypes.size());
 
 			if (id.u.index < maxEntityIndex)
 			{
@@ -310,7 +482,7 @@ namespace ecs
 
 				//update entity data
 				entitiesDesc[id.u.index] = internal::EntityDesc(id, maxUsedEntitiesIds);
-				entitiesMasks[id.u.index].clear();
+				entitiesArchetypes[id.u.index] = archetype_table::emptyArchetype;
 
 				unorderedUsedEntitiesIds.push_back(id);
 				internal::GetContext().NeedRebuildOrderedList();
@@ -324,7 +496,7 @@ namespace ecs
 
 			//create new entity data
 			entitiesDesc.push_back(internal::EntityDesc(id, maxUsedEntitiesIds));
-			entitiesMasks.push_back(bitset());
+			entitiesArchetypes.push_back(archetype_table::emptyArchetype);
 
 			unorderedUsedEntitiesIds.push_back(id);
 
@@ -354,20 +526,28 @@ namespace ecs
 		inline void SetComponentBit(EntityId id, uint32_t componentTypeIndex)
 		{
 			assert(componentTypeIndex < bitset::MaxBitCount::value && "Invalid component type index.");
-			internal::EntityMaskStorage& entitiesMasks = internal::GetContext().entitiesMasks;
-			bitset& componentsMask = entitiesMasks[id.u.index];
-			assert(!componentsMask.get(componentTypeIndex) && "Component of this type already present in this entity.");
-			componentsMask.set(componentTypeIndex);
+			internal::Context& context = internal::GetContext();
+			ArchetypeId& archetype = context.entitiesArchetypes[id.u.index];
+			archetype = context.archetypes.add_component(archetype, componentTypeIndex);
 		}
 
 		////////////////////////////////////////////////////////////////////////////////////
 		inline void ResetComponentBit(EntityId id, uint32_t componentTypeIndex)
 		{
 			assert(componentTypeIndex < bitset::MaxBitCount::value && "Invalid component type index.");
-			internal::EntityMaskStorage& entitiesMasks = internal::GetContext().entitiesMasks;
-			bitset& componentsMask = entitiesMasks[id.u.index];
-			assert(componentsMask.get(componentTypeIndex) && "Component of this type is not present in this entity.");
-			componentsMask.reset(componentTypeIndex);
+			internal::Context& context = internal::GetContext();
+			ArchetypeId& archetype = context.entitiesArchetypes[id.u.index];
+			archetype = context.archetypes.remove_component(archetype, componentTypeIndex);
+		}
+
+
+
+		////////////////////////////////////////////////////////////////////////////////////
+		inline bool HasComponentBit(const ConstEntityId id, uint32_t componentTypeIndex)
+		{
+			assert(componentTypeIndex < bitset::MaxBitCount::value && "Invalid component type index.");
+			internal::Context& context = internal::GetContext();
+			return context.archetypes.mask(context.entitiesArchetypes[id.u.index]).get(componentTypeIndex);
 		}
 
 
@@ -378,10 +558,10 @@ namespace ecs
 		{
 			assert(internal::GetContext().state == internal::ContextState::MUTABLE);
 
-			uint32_t componentTypeIndex = ecs::GetComponentTypeIndex<std::remove_const<T>::type>();
+			uint32_t componentTypeIndex = ecs::GetComponentTypeIndex<typename std::remove_const<T>::type>();
 			internal::SetComponentBit(id, componentTypeIndex);
 
-			ComponentsStorage<T>& storage = ecs::GetComponentStorage<std::remove_const<T>::type>();
+			ComponentsStorage<T>& storage = ecs::GetComponentStorage<typename std::remove_const<T>::type>();
 			storage.push_back(id, std::move(defaultValue));
 		}
 
@@ -391,14 +571,77 @@ namespace ecs
 		{
 			assert(internal::GetContext().state == internal::ContextState::MUTABLE);
 
-			uint32_t componentTypeIndex = ecs::GetComponentTypeIndex<std::remove_const<T>::type>();
+			uint32_t componentTypeIndex = ecs::GetComponentTypeIndex<typename std::remove_const<T>::type>();
 			internal::ResetComponentBit(id, componentTypeIndex);
 
-			ComponentsStorage<T>& storage = ecs::GetComponentStorage<std::remove_const<T>::type>();
+			ComponentsStorage<T>& storage = ecs::GetComponentStorage<typename std::remove_const<T>::type>();
 			storage.erase(id);
 			
 		}
 
+		////////////////////////////////////////////////////////////////////////////////////
+		inline void CreateEntities(EntityId* ids, uint32_t count)
+		{
+			assert(internal::GetContext().state == internal::ContextState::MUTABLE);
+
+			reserve_additional(internal::GetContext().entitiesDesc, count);
+			reserve_additional(internal::GetContext().entitiesArchetypes, count);
+			reserve_additional(internal::GetContext().unorderedUsedEntitiesIds, count);
+			if (!internal::GetContext().IsOrderedListNeedRebuild())
+			{
+				reserve_additional(internal::GetContext().orderedUsedEntitiesIds, count);
+			}
+
+			for (uint32_t i = 0; i < count; i++)
+			{
+				ids[i] = CreateEntity();
+			}
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////
+		template<typename T>
+		inline void AddComponentBatch(const EntityId* ids, T* values, uint32_t count)
+		{
+			assert(internal::GetContext().state == internal::ContextState::MUTABLE);
+
+			// set mask bits (single pass)
+			uint32_t componentTypeIndex = ecs::GetComponentTypeIndex<typename std::remove_const<T>::type>();
+			for (uint32_t i = 0; i < count; i++)
+			{
+				internal::SetComponentBit(ids[i], componentTypeIndex);
+			}
+
+			ComponentsStorage<T>& storage = ecs::GetComponentStorage<typename std::remove_const<T>::type>();
+			storage.push_back(ids, values, count);
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////
+		template<typename T>
+		inline void RemoveComponentBatch(const EntityId* ids, uint32_t count)
+		{
+			assert(internal::GetContext().state == internal::ContextState::MUTABLE);
+
+			uint32_t componentTypeIndex = ecs::GetComponentTypeIndex<typename std::remove_const<T>::type>();
+			for (uint32_t i = 0; i < count; i++)
+			{
+				internal::ResetComponentBit(ids[i], componentTypeIndex);
+			}
+
+			ComponentsStorage<T>& storage = ecs::GetComponentStorage<typename std::remove_const<T>::type>();
+			storage.erase(ids, count);
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////
+		inline void NotifyChangesBatch(const EntityId* ids, uint32_t count)
+		{
+			ConstEntityList& changedEntitiesIds = internal::GetContext().changedEntitiesIds;
+			reserve_additional(changedEntitiesIds, count);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				changedEntitiesIds.push_back(ids[i]);
+			}
+		}
+
 	} // namespace internal
 
 
@@ -482,7 +725,7 @@ namespace ecs
 		assert(internal::GetContext().state == internal::ContextState::MUTABLE);
 
 		internal::EntityStorage& entitiesDesc = internal::GetContext().entitiesDesc;
-		internal::EntityMaskStorage& entitiesMasks = internal::GetContext().entitiesMasks;
+		internal::EntityArchetypeStorage& entitiesArchetypes = internal::GetContext().entitiesArchetypes;
 		IdGenerator& idGen = internal::GetContext().dispatcher.GetIdGenerator();
 
 		EntityList& unorderedUsedEntitiesIds = internal::GetContext().unorderedUsedEntitiesIds;
@@ -509,12 +752,26 @@ namespace ecs
 			changedEntitiesIds.push_back(id);
 		}
 
+		// Destroy all hibernated entities
+		internal::DestroyAllHibernated();
+
 		// destroy
 		idGen.clear();
 		unorderedUsedEntitiesIds.clear();
 		orderedUsedEntitiesIds.clear();
 		entitiesDesc.clear();
-		entitiesMasks.clear();
+		entitiesArchetypes.clear();
+
+		// note: archetypes are kept (the set of used masks is usually the same after reload and match caches stay valid)
+
+		// return unused memory back to the OS
+		release_memory(entitiesDesc);
+		release_memory(entitiesArchetypes);
+		ecs::vector<IComponentsStorage*>& storages = GetStorageLinearDirectory();
+		for (auto it = storages.begin(); it != storages.end(); ++it)
+		{
+			(*it)->release_memory_v();
+		}
 	}
 
 	//
@@ -605,6 +862,30 @@ namespace ecs
 
 
 
+	//
+	// Create count new entities (ids must point to the array of count elements)
+	//
+	////////////////////////////////////////////////////////////////////////////////////
+	inline void CreateEntities(EntityId* ids, uint32_t count)
+	{
+		Dispatcher& dispatcher = internal::GetContext().dispatcher;
+		if (dispatcher.IsLocked())
+		{
+			for (uint32_t i = 0; i < count; i++)
+			{
+				ids[i] = dispatcher.Invoke_CreateEntity();
+				dispatcher.Invoke_NotifyChanges(ids[i]);
+			}
+			return;
+		}
+		assert(internal::GetContext().state == internal::ContextState::MUTABLE);
+
+		internal::CreateEntities(ids, count);
+		internal::NotifyChangesBatch(ids, count);
+	}
+
+
+
 	//
 	// Get entity component (return nullptr if component of such type is not added to entity)
 	//
@@ -614,9 +895,12 @@ namespace ecs
 	{
 		assert(IsValid(id) && "Invalid entity ID");
 
-		typedef std::remove_const<T>::type TYPE;
+		typedef typename std::remove_const<T>::type TYPE;
 
-		ComponentsStorage<TYPE>& storage = ecs::GetComponentStorage<TYPE>();
+		// read-only access must use the const storage interface (shared components are not copied on read)
+		typedef typename std::conditional<std::is_const<T>::value, const ComponentsStorage<TYPE>, ComponentsStorage<TYPE>>::type TStorage;
+
+		TStorage& storage = ecs::GetComponentStorage<TYPE>();
 		T* v = storage.get(id);
 		return v;
 	}
@@ -631,13 +915,115 @@ namespace ecs
 	{
 		assert(IsValid(id) && "Invalid entity ID");
 
-		typedef std::remove_const<T>::type TYPE;
+		typedef typename std::remove_const<T>::type TYPE;
 
 		ComponentsStorage<TYPE>& storage = ecs::GetComponentStorage<TYPE>();
 		const T* v = storage.get(id);
 		return v;
 	}
 
+	//
+	// Add runtime-described component to entity (see ecs::RegisterComponentType)
+	//   the value is moved from pValue, caller still owns pValue and must destroy it
+	//
+	////////////////////////////////////////////////////////////////////////////////////
+	inline void AddRuntimeComponent(EntityId id, uint32_t componentTypeIndex, void* pValue)
+	{
+		RuntimeComponentsStorage& storage = ecs::GetRuntimeComponentStorage(componentTypeIndex);
+
+		Dispatcher& dispatcher = internal::GetContext().dispatcher;
+		if (dispatcher.IsLocked())
+		{
+			const ComponentTypeDesc& desc = storage.type_desc();
+			dispatcher.Invoke_AddComponent(id, componentTypeIndex, &storage, pValue, desc.size, desc.align, desc.moveFunc, desc.destroyFunc);
+			dispatcher.Invoke_NotifyChanges(id);
+			return;
+		}
+		assert(internal::GetContext().state == internal::ContextState::MUTABLE);
+		assert(IsValid(id) && "Invalid entity ID");
+
+		internal::SetComponentBit(id, componentTypeIndex);
+		storage.push_back(id, pValue);
+		NotifyChanges(id);
+	}
+
+	//
+	// Remove runtime-described component from entity
+	//
+	////////////////////////////////////////////////////////////////////////////////////
+	inline void RemoveRuntimeComponent(EntityId id, uint32_t componentTypeIndex)
+	{
+		RuntimeComponentsStorage& storage = ecs::GetRuntimeComponentStorage(componentTypeIndex);
+
+		Dispatcher& dispatcher = internal::GetContext().dispatcher;
+		if (dispatcher.IsLocked())
+		{
+			dispatcher.Invoke_RemoveComponent(id, componentTypeIndex, &storage);
+			dispatcher.Invoke_NotifyChanges(id);
+			return;
+		}
+		assert(internal::GetContext().state == internal::ContextState::MUTABLE);
+		assert(IsValid(id) && "Invalid entity ID");
+
+		internal::ResetComponentBit(id, componentTypeIndex);
+		storage.erase(id);
+		NotifyChanges(id);
+	}
+
+	//
+	// Get runtime-described component (return nullptr if component of such type is not added to entity)
+	//
+	////////////////////////////////////////////////////////////////////////////////////
+	inline void* GetRuntimeComponent(EntityId id, uint32_t componentTypeIndex)
+	{
+		assert(IsValid(id) && "Invalid entity ID");
+		return ecs::GetRuntimeComponentStorage(componentTypeIndex).get(id);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////
+	inline const void* GetRuntimeComponent(const ConstEntityId id, uint32_t componentTypeIndex)
+	{
+		assert(IsValid(id) && "Invalid entity ID");
+		const RuntimeComponentsStorage& storage = ecs::GetRuntimeComponentStorage(componentTypeIndex);
+		return storage.get(id);
+	}
+
+	//
+	// Current frame index (incremented at the end of each ecs::Update)
+	//
+	////////////////////////////////////////////////////////////////////////////////////
+	inline uint32_t GetFrameIndex()
+	{
+		return GlobalFrameIndex();
+	}
+
+	//
+	// Mark entity component as changed in the current frame
+	//   (any mutable access to the component does it automatically)
+	//
+	////////////////////////////////////////////////////////////////////////////////////
+	template<typename T>
+	inline void MarkChanged(EntityId id)
+	{
+		assert(IsValid(id) && "Invalid entity ID");
+
+		ComponentsStorage<T>& storage = ecs::GetComponentStorage<T>();
+		storage.mark_changed(id);
+	}
+
+	//
+	// Check if the entity component was changed at the frame 'sinceFrame' or later
+	//
+	////////////////////////////////////////////////////////////////////////////////////
+	template<typename T>
+	inline bool IsChangedSince(const ConstEntityId id, uint32_t sinceFrame)
+	{
+		assert(IsValid(id) && "Invalid entity ID");
+
+		const ComponentsStorage<T>& storage = ecs::GetComponentStorage<T>();
+		return storage.changed_since(id, sinceFrame);
+	}
+
 	//
 	// Add component to the entity
 	//
@@ -708,6 +1094,36 @@ namespace ecs
 
 
 
+	//
+	// Add component to the batch of entities (values[i] is moved to the entity ids[i])
+	//
+	////////////////////////////////////////////////////////////////////////////////////
+	template<typename T>
+	inline void AddComponentBatch(const EntityId* ids, T* values, uint32_t count)
+	{
+		Dispatcher& dispatcher = internal::GetContext().dispatcher;
+		if (dispatcher.IsLocked())
+		{
+			for (uint32_t i = 0; i < count; i++)
+			{
+				dispatcher.Invoke_AddComponent(ids[i], std::move(values[i]));
+				dispatcher.Invoke_NotifyChanges(ids[i]);
+			}
+			return;
+		}
+		assert(internal::GetContext().state == internal::ContextState::MUTABLE);
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			assert(IsValid(ids[i]) && "Invalid entity ID");
+		}
+
+		internal::AddComponentBatch<T>(ids, values, count);
+		internal::NotifyChangesBatch(ids, count);
+	}
+
+
+
 	//
 	// Remove component from entity
 	//
@@ -771,6 +1187,34 @@ namespace ecs
 		NotifyChanges(id);
 	}
 
+	//
+	// Remove component from the batch of entities
+	//
+	////////////////////////////////////////////////////////////////////////////////////
+	template<typename T>
+	inline void RemoveComponentBatch(const EntityId* ids, uint32_t count)
+	{
+		Dispatcher& dispatcher = internal::GetContext().dispatcher;
+		if (dispatcher.IsLocked())
+		{
+			for (uint32_t i = 0; i < count; i++)
+			{
+				dispatcher.Invoke_RemoveComponent<T>(ids[i]);
+				dispatcher.Invoke_NotifyChanges(ids[i]);
+			}
+			return;
+		}
+		assert(internal::GetContext().state == internal::ContextState::MUTABLE);
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			assert(IsValid(ids[i]) && "Invalid entity ID");
+		}
+
+		internal::RemoveComponentBatch<T>(ids, count);
+		internal::NotifyChangesBatch(ids, count);
+	}
+
 
 
 
@@ -794,6 +1238,87 @@ namespace ecs
 		}
 	}
 
+	////////////////////////////////////////////////////////////////////////////////////
+	// Time-sliced version of OptimizeLayoutForCache (call it once per frame)
+	//   returns true if all the storages are fully optimized
+	bool OptimizeLayoutForCache(uint32_t maxMicroseconds);
+
+	////////////////////////////////////////////////////////////////////////////////////
+	// Parallel version of OptimizeLayoutForCache
+	//   storages are handed to threadsCount workers (largest first, 0 - number of hardware threads),
+	//   very large storages are split into the independent permutation cycles shared by all workers,
+	//   workers are persistent threads of the context (created on the first call)
+	void OptimizeLayoutForCacheParallel(uint32_t threadsCount = 0);
+
+	////////////////////////////////////////////////////////////////////////////////////
+	// Store the components of the given types in the order of the entity list
+	//   (e.g. the ordered working set of the process, to make the process update a linear scan)
+	//
+	//   A storage keeps only one custom order: if several processes use the same component type, the last caller wins.
+	//   OptimizeLayoutForCache skips the storage in the custom order until the next add/remove of the component.
+	inline void OptimizeLayoutForProcess(const EntityList& order, const bitset& componentsMask)
+	{
+		std::array<IComponentsStorage*, bitset::MaxBitCount::value>& storageDir = GetStorageDirectory();
+		for (auto it = componentsMask.begin(); it != componentsMask.end(); ++it)
+		{
+			uint32_t componentTypeIndex = *it;
+			assert(componentTypeIndex < bitset::MaxBitCount::value && "Invalid component type index.");
+			IComponentsStorage* storage = storageDir[componentTypeIndex];
+
+			// tag components have no storage
+			if (storage)
+			{
+				storage->optimize_order_v(order.data(), narrow_cast<uint32_t>(order.size()));
+			}
+		}
+	}
+
+	//
+	// Hibernate entity
+	//
+	//  All entity components are moved from the storages to the compact cold block (LZ-compressed if possible),
+	//  the entity is removed from the active list and is not visible to processes, but EntityId stays valid.
+	//
+	////////////////////////////////////////////////////////////////////////////////////
+	void Hibernate(EntityId id, bool compress = true);
+
+	//
+	// Wake hibernated entity (restore entity components)
+	//
+	////////////////////////////////////////////////////////////////////////////////////
+	void Wake(EntityId id);
+
+	////////////////////////////////////////////////////////////////////////////////////
+	inline bool IsHibernated(const ConstEntityId id)
+	{
+		assert(IsValid(id) && "Invalid entity ID");
+		const internal::EntityStorage& entitiesDesc = internal::GetContext().entitiesDesc;
+		return (entitiesDesc[id.u.index].usedIndex & internal::EntityDesc::HibernatedFlag) != 0;
+	}
+
+	//
+	// Release excess memory after the mass destruction (entity arrays, component storages and processes)
+	//
+	//  Forward indices are shrunk down to the highest entity index in use,
+	//  all the other arrays release the capacity according to the policy.
+	//  Returns number of bytes reclaimed
+	//
+	////////////////////////////////////////////////////////////////////////////////////
+	size_t Trim(const TrimPolicy& policy = TrimPolicy());
+
+	////////////////////////////////////////////////////////////////////////////////////
+	//
+	// Memory and occupancy statistics of all the component storages
+	//
+	//  Returns the totals over all the storages,
+	//  pStorages (optional) receives the statistics of every storage in the order of registration.
+	//
+	////////////////////////////////////////////////////////////////////////////////////
+	StorageStats GetComponentsStats(ecs::vector<StorageStats>* pStorages = nullptr);
+
+	// reset push/erase counters of all the component storages
+	void ResetComponentsStats();
+
 	////////////////////////////////////////////////////////////////////////////////////
 	void RegisterProcess(IProcessBase* pProcess);
 	////////////////////////////////////////////////////////////////////////////////////
@@ -804,15 +1329,69 @@ namespace ecs
 	////////////////////////////////////////////////////////////////////////////////////
 	inline bool IsMatchAspect(const ConstEntityId id, const bitset& aspectMask)
 	{
-		if (!IsValid(id))
+		// hibernated entities have no components in the storages and don't match any aspect
+		if (!IsValid(id) || IsHibernated(id))
+		{
+			return false;
+		}
+
+		internal::Context& context = internal::GetContext();
+		return context.archetypes.mask(context.entitiesArchetypes[id.u.index]).contains(aspectMask);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////
+	// IsMatchAspect with the excluded / any-of components (see Without, AnyOf)
+	inline bool IsMatchAspect(const ConstEntityId id, const aspect_filter& filter)
+	{
+		if (!IsValid(id) || IsHibernated(id))
+		{
+			return false;
+		}
+
+		internal::Context& context = internal::GetContext();
+		return filter.match(context.archetypes.mask(context.entitiesArchetypes[id.u.index]));
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////
+	// IsMatchAspect using the per-archetype cached results (the cache is updated if new archetypes were created)
+	inline bool IsMatchAspect(const ConstEntityId id, archetype_match_cache& cache)
+	{
+		if (!IsValid(id) || IsHibernated(id))
 		{
 			return false;
 		}
 
-		internal::EntityMaskStorage& entitiesMasks = internal::GetContext().entitiesMasks;
-		return entitiesMasks[id.u.index].contains(aspectMask);
+		internal::Context& context = internal::GetContext();
+		cache.update(context.archetypes);
+		return cache.is_match(context.entitiesArchetypes[id.u.index]);
 	}
 
+	////////////////////////////////////////////////////////////////////////////////////
+	// Number of unique components masks (see archetype_table)
+	inline uint32_t GetArchetypesCount()
+	{
+		return internal::GetContext().archetypes.size();
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////
+	//
+	// Batch versions of IsMatchAspect
+	//
+	//  Entities are matched through their archetypes (see archetype_match_cache): the SIMD kernels (ecs::internal::MatchMasks)
+	//  test the filter against the new archetypes only, then every entity is a single table lookup.
+	//
+	//  MatchAspect(list, mask, pResult) - writes the matching entities of the list to pResult (compacted, in the order of the list)
+	//                                     and returns the number of matches. pResult must have room for list.size() ids.
+	//  MatchAspect(list, mask, bitmap)  - bit i of the bitmap is set if list[i] matches
+	//  MatchAspectAll(mask, bitmap)     - bit i of the bitmap is set if the alive entity with index i matches (whole entity array)
+	//
+	//  mask is the components mask or the aspect_filter (required + excluded + any-of components)
+	//
+	////////////////////////////////////////////////////////////////////////////////////
+	uint32_t MatchAspect(const ConstEntityList& entities, const aspect_filter& filter, ConstEntityId* pResult);
+	void MatchAspect(const ConstEntityList& entities, const aspect_filter& filter, ecs::vector<uint64_t>& bitmap);
+	void MatchAspectAll(const aspect_filter& filter, ecs::vector<uint64_t>& bitmap);
+
 
 	//
 	// The EntityList is guaranteed to be ordered by the entity index.
@@ -860,16 +1439,22 @@ namespace ecs
 	}
 
 
-	// fwd decl (implementation in macro ECS_IMPLEMENT_COMPONENT_META)
+	//
+	// Create enumerator for entities with component TComponent changed at the frame 'sinceFrame' or later
+	//
 	////////////////////////////////////////////////////////////////////////////////////
-	template<typename TComponent>
-	ecs::ComponentsStorage<TComponent>& GetComponentStorage();
+	template<typename TAspect, typename TComponent>
+	inline TChangedEntityEnumerator<TAspect, EntityList, TComponent> CreateChangedEnumerator(const EntityList& list, uint32_t sinceFrame, const Bucket* bucket = nullptr)
+	{
+		return TChangedEntityEnumerator<TAspect, EntityList, TComponent>(list, sinceFrame, bucket);
+	}
 
-	// fwd decl (implementation in macro ECS_IMPLEMENT_COMPONENT_META)
 	////////////////////////////////////////////////////////////////////////////////////
-	template<typename TComponent>
-	uint32_t GetComponentTypeIndex();
-
+	template<typename TAspect, typename TComponent>
+	inline TChangedEntityEnumerator<TAspect, ConstEntityList, TComponent> CreateChangedEnumerator(const ConstEntityList& list, uint32_t sinceFrame, const Bucket* bucket = nullptr)
+	{
+		return TChangedEntityEnumerator<TAspect, ConstEntityList, TComponent>(list, sinceFrame, bucket);
+	}
 
 
 
@@ -22,6 +22,14 @@
 #pragma once
 
 
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <iterator>
+#include <utility>
+#include <type_traits>
+
+
 #ifndef _UNUSED
 #define _UNUSED(T) (void)(T)
 #endif
@@ -33,6 +41,12 @@ namespace ecs
 	{
 		void* Alloc(size_t bytesCount, size_t align);
 		void Free(void* p);
+
+		// virtual memory (reserve address range, then commit/decommit physical pages inside the range)
+		void* ReserveAddressSpace(size_t bytesCount);
+		void ReleaseAddressSpace(void* p, size_t bytesCount);
+		void CommitPages(void* p, size_t bytesCount);
+		void DecommitPages(void* p, size_t bytesCount);
 	}
 
 
@@ -80,10 +94,11 @@ namespace ecs
 			return !(*this == other);
 		}
 
-		void construct(T * const p, const T& t) const
+		template <typename U, typename... Args>
+		void construct(U * const p, Args&&... args) const
 		{
 			void * const pv = static_cast<void *>(p);
-			new (pv) T(t);
+			new (pv) U(std::forward<Args>(args)...);
 		}
 
 		void destroy(T * const p) const
@@ -165,16 +180,86 @@ namespace ecs
 	};
 
 
-	template<class T>
-	class vector : public std::vector<T, aligned_allocator<T, 16>>
+	namespace internal
+	{
+		// natural alignment of the type, but at least 16 bytes (SSE)
+		template<typename T>
+		struct default_alignment : public std::integral_constant<uint32_t, (alignof(T) > 16) ? uint32_t(alignof(T)) : 16>
+		{
+		};
+	}
+
+
+	//
+	// Vector with aligned memory buffer
+	//
+	//  Elements are packed with the stride of sizeof(T) (any size is allowed), Alignment is the alignment of the buffer.
+	//  For the types which size is a multiple of Alignment every element is aligned too.
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<class T, uint32_t Alignment = internal::default_alignment<T>::value>
+	class vector : public std::vector<T, aligned_allocator<T, Alignment>>
 	{
 	public:
 		~vector()
 		{
-			static_assert( (sizeof(T) % 16 == 0) || (16 % sizeof(T) == 0), "Can't use aligned vector with not aligned type" );
+			static_assert((Alignment & (Alignment - 1)) == 0, "Alignment must be a power of two");
+			static_assert(Alignment >= alignof(T), "Alignment can't be less than the natural alignment of the type");
 		}
 	};
 
+
+	//
+	// Shrink policy (see ecs::Trim)
+	//
+	//  Excess capacity is released only if capacity > size * (1 + hysteresis),
+	//  so the containers which size oscillates around some value are not reallocated every time.
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	struct TrimPolicy
+	{
+		float hysteresis;
+
+		// capacity is never shrunk below this number of elements
+		uint32_t minCapacity;
+
+		TrimPolicy(float _hysteresis = 0.5f, uint32_t _minCapacity = 0)
+			: hysteresis(_hysteresis)
+			, minCapacity(_minCapacity)
+		{
+		}
+
+		// returns new capacity or capacity if no need to shrink
+		size_t shrink_capacity(size_t size, size_t capacity) const
+		{
+			size_t newCapacity = (size > minCapacity) ? size : minCapacity;
+			if (capacity <= newCapacity || float(capacity) <= float(size) * (1.0f + hysteresis))
+			{
+				return capacity;
+			}
+			return newCapacity;
+		}
+	};
+
+
+	// release excess capacity, returns number of bytes reclaimed
+	template<class T, uint32_t Alignment>
+	inline size_t trim_capacity(ecs::vector<T, Alignment>& container, const TrimPolicy& policy)
+	{
+		size_t capacity = container.capacity();
+		size_t newCapacity = policy.shrink_capacity(container.size(), capacity);
+		if (newCapacity == capacity)
+		{
+			return 0;
+		}
+
+		ecs::vector<T, Alignment> tmp;
+		tmp.reserve(newCapacity);
+		tmp.insert(tmp.end(), std::make_move_iterator(container.begin()), std::make_move_iterator(container.end()));
+		container.swap(tmp);
+		return (capacity - container.capacity()) * sizeof(T);
+	}
+
 }
 
 
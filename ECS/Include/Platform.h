@@ -0,0 +1,118 @@
+// The MIT License (MIT)
+//
+// 	Copyright (c) 2017 Sergey Makeev
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy
+// 	of this software and associated documentation files (the "Software"), to deal
+// 	in the Software without restriction, including without limitation the rights
+// 	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// 	copies of the Software, and to permit persons to whom the Software is
+// 	furnished to do so, subject to the following conditions:
+//
+//      The above copyright notice and this permission notice shall be included in
+// 	all copies or substantial portions of the Software.
+//
+// 	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// 	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// 	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// 	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// 	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// 	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// 	THE SOFTWARE.
+#pragma once
+
+
+#include <stdint.h>
+#include <assert.h>
+
+
+//
+// Supported targets: x86 / x64 only (MSVC, GCC, Clang)
+//   component masks are stored in SSE2 registers (see ecs::bitset), cpuid/xgetbv are used for the SIMD level detection.
+//   Other architectures would need the scalar bitset and the scalar match kernels.
+//
+#if !(defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__))
+#error "ECS supports only x86 / x64 targets"
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+
+//
+// Force inline
+//
+#if defined(_MSC_VER)
+#define ecs_force_inline __forceinline
+#else
+#define ecs_force_inline inline __attribute__((always_inline))
+#endif
+
+
+//
+// Enable the instruction set for the single function (runtime dispatched kernels, see ecs::GetSimdLevel)
+//   MSVC doesn't need it, all the intrinsics are always available
+//
+#if defined(_MSC_VER)
+#define ECS_TARGET_AVX2
+#define ECS_TARGET_AVX512
+#else
+#define ECS_TARGET_AVX2 __attribute__((target("avx2")))
+#define ECS_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+
+
+// Build the AVX-512 kernels (AVX-512 intrinsics are available in MSVC starting from VS2017 15.3)
+#ifndef ECS_AVX512_KERNELS
+#if defined(_MSC_VER) && (_MSC_VER < 1911)
+#define ECS_AVX512_KERNELS (0)
+#else
+#define ECS_AVX512_KERNELS (1)
+#endif
+#endif
+
+
+
+namespace ecs
+{
+	//
+	// SIMD instruction set used by the runtime dispatched kernels
+	//
+	struct SimdLevel
+	{
+		enum Type
+		{
+			SSE2 = 0,
+			AVX2 = 1,
+			AVX512 = 2,
+
+			COUNT
+		};
+	};
+
+	// best instruction set supported by the CPU and the OS (cpuid, detected once)
+	SimdLevel::Type GetSimdLevel();
+
+	const char* GetSimdLevelName(SimdLevel::Type level);
+
+
+	namespace internal
+	{
+		// index of the lowest set bit (tzcnt/bsf), v must be non zero
+		ecs_force_inline uint32_t BitScanForward(uint32_t v)
+		{
+			assert(v != 0);
+#if defined(_MSC_VER)
+			unsigned long index;
+			_BitScanForward(&index, v);
+			return (uint32_t)index;
+#else
+			return (uint32_t)__builtin_ctz(v);
+#endif
+		}
+	}
+
+}
@@ -22,7 +22,7 @@
 #pragma once
 
 #include <stdint.h>
-#include "EntityId.h"
+#include "EntityID.h"
 #include "BitSet.h"
 #include "Aspect.h"
 
@@ -80,6 +80,12 @@ namespace ecs
 
 		virtual void ReMap(const ConstEntityList& entities, uint32_t maxEntityIndex) = 0;
 
+		// release excess memory (see ecs::Trim), returns number of bytes reclaimed
+		virtual size_t Trim(const TrimPolicy& /*policy*/)
+		{
+			return 0;
+		}
+
 		//
 		virtual void Update(float deltaTime) = 0;
 	};
@@ -0,0 +1,180 @@
+// The MIT License (MIT)
+//
+// 	Copyright (c) 2017 Sergey Makeev
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy
+// 	of this software and associated documentation files (the "Software"), to deal
+// 	in the Software without restriction, including without limitation the rights
+// 	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// 	copies of the Software, and to permit persons to whom the Software is
+// 	furnished to do so, subject to the following conditions:
+//
+//      The above copyright notice and this permission notice shall be included in
+// 	all copies or substantial portions of the Software.
+//
+// 	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// 	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// 	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// 	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// 	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// 	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// 	THE SOFTWARE.
+#pragma once
+
+
+
+#include <stdint.h>
+#include <assert.h>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <type_traits>
+#include "Memory.h"
+#include "Utils.h"
+
+
+namespace ecs
+{
+
+	//
+	// Sort item (key + payload index)
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename TKey>
+	struct sort_item
+	{
+		TKey key;
+		uint32_t index;
+	};
+
+
+	namespace internal
+	{
+		static const uint32_t radixBits = 8;
+		static const uint32_t radixSize = (1 << radixBits);
+
+		template<typename TKey>
+		inline void RadixHistogram(const sort_item<TKey>* items, uint32_t first, uint32_t last, uint32_t shift, uint32_t* histogram)
+		{
+			std::memset(histogram, 0, radixSize * sizeof(uint32_t));
+			for (uint32_t i = first; i < last; i++)
+			{
+				histogram[(items[i].key >> shift) & (radixSize - 1)]++;
+			}
+		}
+
+		template<typename TKey>
+		inline void RadixScatter(const sort_item<TKey>* src, sort_item<TKey>* dst, uint32_t first, uint32_t last, uint32_t shift, uint32_t* offsets)
+		{
+			for (uint32_t i = first; i < last; i++)
+			{
+				const sort_item<TKey>& item = src[i];
+				dst[offsets[(item.key >> shift) & (radixSize - 1)]++] = item;
+			}
+		}
+	}
+
+
+	//
+	// Stable LSD radix sort (8 bits per pass)
+	//
+	//  items and tmp must point to arrays of count elements, the result is stored in items.
+	//  Passes where all the keys have the same digit are skipped.
+	//
+	//  If threadsCount > 1 histograms and scatter are split between threads (each thread sorts its own range of input,
+	//  per thread offsets keep the sort stable).
+	//
+	//  Worst/Best/Average-case performance is O(n * sizeof(TKey))
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename TKey>
+	void radix_sort(sort_item<TKey>* items, sort_item<TKey>* tmp, uint32_t count, uint32_t threadsCount = 1)
+	{
+		static_assert(std::is_unsigned<TKey>::value, "Radix sort key must be unsigned integer");
+
+		if (threadsCount == 0)
+		{
+			threadsCount = 1;
+		}
+
+		// not worth it for the small arrays
+		if (count < threadsCount * 4096)
+		{
+			threadsCount = 1;
+		}
+
+		uint32_t itemsPerThread = (count + threadsCount - 1) / threadsCount;
+
+		// histograms[thread][digit]
+		std::vector<uint32_t> histograms(threadsCount * internal::radixSize);
+
+		sort_item<TKey>* src = items;
+		sort_item<TKey>* dst = tmp;
+
+		for (uint32_t shift = 0; shift < sizeof(TKey) * 8; shift += internal::radixBits)
+		{
+			if (threadsCount > 1)
+			{
+				internal::ParallelFor(threadsCount, [&](uint32_t threadIndex)
+				{
+					uint32_t first = std::min(count, threadIndex * itemsPerThread);
+					uint32_t last = std::min(count, first + itemsPerThread);
+					internal::RadixHistogram(src, first, last, shift, &histograms[threadIndex * internal::radixSize]);
+				});
+			}
+			else
+			{
+				internal::RadixHistogram(src, 0, count, shift, &histograms[0]);
+			}
+
+			// convert histograms to the starting offsets (digit major, thread minor)
+			uint32_t currentOffset = 0;
+			bool isSingleDigit = false;
+			for (uint32_t digit = 0; digit < internal::radixSize; digit++)
+			{
+				uint32_t digitStart = currentOffset;
+				for (uint32_t threadIndex = 0; threadIndex < threadsCount; threadIndex++)
+				{
+					uint32_t& v = histograms[threadIndex * internal::radixSize + digit];
+					uint32_t digitCount = v;
+					v = currentOffset;
+					currentOffset += digitCount;
+				}
+
+				if (currentOffset - digitStart == count)
+				{
+					isSingleDigit = true;
+				}
+			}
+
+			// all keys have the same digit, nothing to do for this pass
+			if (isSingleDigit)
+			{
+				continue;
+			}
+
+			if (threadsCount > 1)
+			{
+				internal::ParallelFor(threadsCount, [&](uint32_t threadIndex)
+				{
+					uint32_t first = std::min(count, threadIndex * itemsPerThread);
+					uint32_t last = std::min(count, first + itemsPerThread);
+					internal::RadixScatter(src, dst, first, last, shift, &histograms[threadIndex * internal::radixSize]);
+				});
+			}
+			else
+			{
+				internal::RadixScatter(src, dst, 0, count, shift, &histograms[0]);
+			}
+
+			std::swap(src, dst);
+		}
+
+		if (src != items)
+		{
+			std::memcpy(items, src, sizeof(sort_item<TKey>) * count);
+		}
+	}
+
+}
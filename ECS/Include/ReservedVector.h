@@ -0,0 +1,254 @@
+// The MIT License (MIT)
+//
+// 	Copyright (c) 2017 Sergey Makeev
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy
+// 	of this software and associated documentation files (the "Software"), to deal
+// 	in the Software without restriction, including without limitation the rights
+// 	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// 	copies of the Software, and to permit persons to whom the Software is
+// 	furnished to do so, subject to the following conditions:
+//
+//      The above copyright notice and this permission notice shall be included in
+// 	all copies or substantial portions of the Software.
+//
+// 	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// 	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// 	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// 	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// 	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// 	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// 	THE SOFTWARE.
+#pragma once
+
+
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <new>
+#include <utility>
+#include <algorithm>
+#include "ComponentTraits.h"
+#include "Memory.h"
+#include "Utils.h"
+
+
+namespace ecs
+{
+
+	//
+	// Virtual memory reserved vector
+	//
+	//  Reserves the address range for MAX_COUNT elements up front and commits pages as it grows.
+	//  Growth never moves or copies existing elements, so element addresses are stable.
+	//  release_memory() returns unused committed pages back to the OS (see ecs::DestroyAll)
+	//
+	//  Default MAX_COUNT covers the whole entity index space (20 bits, see EntityId::index in EntityID.h)
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename T, uint32_t MAX_COUNT>
+	class reserved_vector
+	{
+		// commit granularity
+		static const size_t commitChunkSize = 64 * 1024;
+
+		T* data;
+		uint32_t count;
+		size_t reservedBytes;
+		size_t committedBytes;
+
+		// non copyable
+		reserved_vector(reserved_vector&);
+		void operator=(reserved_vector&);
+
+		void commit(size_t bytesCount)
+		{
+			if (bytesCount <= committedBytes)
+			{
+				return;
+			}
+
+			if (data == nullptr)
+			{
+				reservedBytes = (sizeof(T) * size_t(MAX_COUNT) + (commitChunkSize - 1)) & ~(commitChunkSize - 1);
+				data = (T*)memory::ReserveAddressSpace(reservedBytes);
+				assert(data != nullptr && "Can't reserve address space");
+			}
+
+			size_t newCommittedBytes = (bytesCount + (commitChunkSize - 1)) & ~(commitChunkSize - 1);
+			assert(newCommittedBytes <= reservedBytes && "reserved_vector overflow");
+
+			memory::CommitPages((uint8_t*)data + committedBytes, newCommittedBytes - committedBytes);
+			committedBytes = newCommittedBytes;
+		}
+
+	public:
+
+		typedef T value_type;
+		typedef T* iterator;
+		typedef const T* const_iterator;
+
+		reserved_vector()
+			: data(nullptr)
+			, count(0)
+			, reservedBytes(0)
+			, committedBytes(0)
+		{
+		}
+
+		~reserved_vector()
+		{
+			clear();
+			if (data)
+			{
+				memory::ReleaseAddressSpace(data, reservedBytes);
+				data = nullptr;
+			}
+		}
+
+		uint32_t size() const
+		{
+			return count;
+		}
+
+		bool empty() const
+		{
+			return (count == 0);
+		}
+
+		uint32_t capacity() const
+		{
+			// committed pages are rounded up to the commit granularity, never report more than MAX_COUNT
+			return narrow_cast<uint32_t>(std::min(committedBytes / sizeof(T), size_t(MAX_COUNT)));
+		}
+
+		// number of bytes of the physical memory used
+		size_t committed_bytes() const
+		{
+			return committedBytes;
+		}
+
+		// requests above MAX_COUNT are clamped (geometric growth, see ecs::reserve_additional)
+		void reserve(uint32_t newCapacity)
+		{
+			commit(sizeof(T) * size_t(std::min(newCapacity, MAX_COUNT)));
+		}
+
+		void push_back(T&& v)
+		{
+			assert(count < MAX_COUNT && "reserved_vector overflow");
+			commit(sizeof(T) * (size_t(count) + 1));
+			new (data + count) T(std::move(v));
+			count++;
+		}
+
+		void push_back(const T& v)
+		{
+			assert(count < MAX_COUNT && "reserved_vector overflow");
+			commit(sizeof(T) * (size_t(count) + 1));
+			new (data + count) T(v);
+			count++;
+		}
+
+		void pop_back()
+		{
+			assert(count > 0);
+			count--;
+			data[count].~T();
+		}
+
+		void clear()
+		{
+			while (count > 0)
+			{
+				pop_back();
+			}
+		}
+
+		// return committed memory above newCapacity back to the OS (address range stays reserved)
+		//   returns number of bytes reclaimed
+		size_t shrink(uint32_t newCapacity)
+		{
+			if (newCapacity < count)
+			{
+				newCapacity = count;
+			}
+
+			size_t usedBytes = (sizeof(T) * size_t(newCapacity) + (commitChunkSize - 1)) & ~(commitChunkSize - 1);
+			if (usedBytes >= committedBytes)
+			{
+				return 0;
+			}
+
+			size_t bytesCount = committedBytes - usedBytes;
+			memory::DecommitPages((uint8_t*)data + usedBytes, bytesCount);
+			committedBytes = usedBytes;
+			return bytesCount;
+		}
+
+		// return committed memory that is not used by elements back to the OS
+		void release_memory()
+		{
+			shrink(count);
+		}
+
+		T& operator[] (uint32_t index)
+		{
+			assert(index < count);
+			return data[index];
+		}
+
+		const T& operator[] (uint32_t index) const
+		{
+			assert(index < count);
+			return data[index];
+		}
+
+		iterator begin()
+		{
+			return data;
+		}
+
+		iterator end()
+		{
+			return data + count;
+		}
+
+		const_iterator begin() const
+		{
+			return data;
+		}
+
+		const_iterator end() const
+		{
+			return data + count;
+		}
+	};
+
+
+	//
+	// Element-wise operations used by ComponentsStorage<T>
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename T, uint32_t MAX_COUNT>
+	inline void release_memory(reserved_vector<T, MAX_COUNT>& container)
+	{
+		container.release_memory();
+	}
+
+	template<typename T, uint32_t MAX_COUNT>
+	inline size_t trim_capacity(reserved_vector<T, MAX_COUNT>& container, const TrimPolicy& policy)
+	{
+		size_t newCapacity = policy.shrink_capacity(container.size(), container.capacity());
+		return container.shrink(narrow_cast<uint32_t>(newCapacity));
+	}
+
+	// only the committed pages count (the reserved address range is not backed by the physical memory)
+	template<typename T, uint32_t MAX_COUNT>
+	inline size_t memory_footprint(const reserved_vector<T, MAX_COUNT>& container)
+	{
+		return container.committed_bytes();
+	}
+
+}
@@ -0,0 +1,398 @@
+// The MIT License (MIT)
+//
+// 	Copyright (c) 2017 Sergey Makeev
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy
+// 	of this software and associated documentation files (the "Software"), to deal
+// 	in the Software without restriction, including without limitation the rights
+// 	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// 	copies of the Software, and to permit persons to whom the Software is
+// 	furnished to do so, subject to the following conditions:
+//
+//      The above copyright notice and this permission notice shall be included in
+// 	all copies or substantial portions of the Software.
+//
+// 	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// 	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// 	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// 	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// 	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// 	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// 	THE SOFTWARE.
+#pragma once
+
+
+
+#include <stdint.h>
+#include <assert.h>
+#include "Memory.h"
+#include "Utils.h"
+#include "EntityID.h"
+#include "SparseIndex.h"
+#include "ComponentsStorage.h"
+
+
+namespace ecs
+{
+
+	//
+	// Runtime description of the component type (e.g. loaded from data files)
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	struct ComponentTypeDesc
+	{
+		// debug name (optional)
+		const char* name;
+
+		uint32_t size;
+		uint32_t align;
+
+		// move-construct the component at pDst (uninitialized memory) from pSrc (nullptr - trivially copyable, memcpy is used)
+		void(*moveFunc)(void* pDst, void* pSrc);
+
+		// destroy the component (nullptr - trivially destructible)
+		void(*destroyFunc)(void* p);
+	};
+
+
+	//
+	// Contiguous array of the runtime-described components (in the storage order)
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	struct component_span
+	{
+		uint8_t* data;
+		uint32_t size;
+
+		// distance between the components in bytes
+		uint32_t stride;
+
+		void* operator[] (uint32_t index) const
+		{
+			assert(index < size);
+			return data + size_t(index) * stride;
+		}
+	};
+
+
+	//
+	// Type-erased components storage for the runtime-described component types
+	//
+	//  Same layout and behavior as ComponentsStorage<T>: components are stored contiguously (stride = size aligned to align),
+	//  erase moves the last component into the hole, optimize() sorts the components in the order of entities.
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	class RuntimeComponentsStorage : public IComponentsStorage
+	{
+		ComponentTypeDesc desc;
+		uint32_t componentTypeIndex;
+		uint32_t stride;
+
+		// components data
+		uint8_t* dataBuffer;
+		uint32_t count;
+		uint32_t capacityCount;
+
+		// temporary component used to swap components
+		uint8_t* swapBuffer;
+
+		// translate EntityId to component index or -1 if no component present for this entity.
+		ecs::sparse_index forwardIndex;
+
+		// translate component index to EntityId
+		ecs::vector<EntityId> backIndex;
+
+		// component index -> frame index of the last write access
+		ecs::vector<uint32_t> versions;
+
+		// global frame counter
+		const uint32_t* frameIndex;
+
+		// Components [0 .. sortedComponentsCount) are stored in the order of entities (see ComponentsStorage<T>)
+		uint32_t sortedComponentsCount;
+		bool isCustomOrder;
+
+		// number of components added / removed since the last reset_stats
+		uint64_t pushCount;
+		uint64_t eraseCount;
+
+		// non copyable
+		RuntimeComponentsStorage(RuntimeComponentsStorage&);
+		void operator=(RuntimeComponentsStorage&);
+
+		uint8_t* at(uint32_t index) const
+		{
+			return dataBuffer + size_t(index) * stride;
+		}
+
+		// pDst = move(pSrc), destroy pSrc
+		void relocate(void* pDst, void* pSrc)
+		{
+			if (desc.moveFunc == nullptr)
+			{
+				std::memcpy(pDst, pSrc, desc.size);
+				return;
+			}
+
+			desc.moveFunc(pDst, pSrc);
+			if (desc.destroyFunc)
+			{
+				desc.destroyFunc(pSrc);
+			}
+		}
+
+		void move_construct(void* pDst, void* pSrc)
+		{
+			if (desc.moveFunc == nullptr)
+			{
+				std::memcpy(pDst, pSrc, desc.size);
+				return;
+			}
+			desc.moveFunc(pDst, pSrc);
+		}
+
+		void destroy(void* p)
+		{
+			if (desc.destroyFunc)
+			{
+				desc.destroyFunc(p);
+			}
+		}
+
+		void grow(uint32_t newCapacity);
+		void swap_components(uint32_t indexA, uint32_t indexB);
+		void on_push_back(const EntityId id, uint32_t componentIndex);
+
+	public:
+
+		RuntimeComponentsStorage(uint32_t _componentTypeIndex, const ComponentTypeDesc& _desc);
+		virtual ~RuntimeComponentsStorage();
+
+		const ComponentTypeDesc& type_desc() const
+		{
+			return desc;
+		}
+
+		uint32_t type_index() const
+		{
+			return componentTypeIndex;
+		}
+
+		uint32_t size() const
+		{
+			return count;
+		}
+
+		bool empty() const
+		{
+			return (count == 0);
+		}
+
+		uint32_t capacity() const
+		{
+			return capacityCount;
+		}
+
+		void reserve(uint32_t newCapacity)
+		{
+			if (newCapacity > capacityCount)
+			{
+				grow(newCapacity);
+			}
+		}
+
+		void* get(const EntityId id)
+		{
+			int32_t index = forwardIndex.get(id.u.index);
+			if (index < 0)
+			{
+				return nullptr;
+			}
+
+			// write access, update component version
+			versions[index] = *frameIndex;
+			return at(index);
+		}
+
+		const void* get(const ConstEntityId id) const
+		{
+			int32_t index = forwardIndex.get(id.u.index);
+			if (index < 0)
+			{
+				return nullptr;
+			}
+			return at(index);
+		}
+
+		// frame index of the last write access to the component (0 if no component present for this entity)
+		uint32_t version(const ConstEntityId id) const
+		{
+			int32_t index = forwardIndex.get(id.u.index);
+			return (index < 0) ? 0 : versions[index];
+		}
+
+		// component index (position in the storage) for the entity or -1 if no component present for this entity.
+		int32_t index_of(const ConstEntityId id) const
+		{
+			return forwardIndex.get(id.u.index);
+		}
+
+		// entity of the component stored at the index
+		EntityId entity_at(uint32_t index) const
+		{
+			assert(index < count);
+			return backIndex[index];
+		}
+
+		// all the components of the storage (note: span access does not update component versions)
+		component_span span()
+		{
+			component_span r;
+			r.data = dataBuffer;
+			r.size = count;
+			r.stride = stride;
+			return r;
+		}
+
+		// move-construct the component from pValue (caller still owns pValue and must destroy it)
+		void push_back(const EntityId id, void* pValue);
+
+		void erase(const EntityId id);
+
+		// see ComponentsStorage<T>::optimize
+		void optimize()
+		{
+			optimize(UINT32_MAX);
+		}
+
+		bool optimize(uint32_t maxEntitiesCount);
+		void optimize(const EntityId* order, uint32_t count);
+
+		bool is_optimized() const
+		{
+			return (sortedComponentsCount == count) || isCustomOrder;
+		}
+
+		size_t trim(const TrimPolicy& policy);
+
+		// memory and occupancy statistics (data bytes include the swap buffer)
+		StorageStats stats() const;
+
+		void reset_stats()
+		{
+			pushCount = 0;
+			eraseCount = 0;
+		}
+
+
+		virtual void erase_v(const EntityId id) override
+		{
+			erase(id);
+		}
+
+		virtual void optimize_v() override
+		{
+			optimize();
+		}
+
+		virtual bool optimize_step_v(uint32_t maxEntitiesCount) override
+		{
+			return optimize(maxEntitiesCount);
+		}
+
+		virtual void optimize_order_v(const EntityId* order, uint32_t count) override
+		{
+			optimize(order, count);
+		}
+
+		virtual uint32_t fragmented_count_v() const override
+		{
+			return isCustomOrder ? 0 : (count - sortedComponentsCount);
+		}
+
+		// can't be split (swap uses the shared swap buffer), optimized by a single worker
+		virtual bool build_optimize_permutation_v(ecs::vector<uint32_t>& /*permutation*/, ecs::vector<uint32_t>& /*cycles*/) override
+		{
+			return false;
+		}
+
+		virtual void apply_permutation_cycle_v(uint32_t* /*permutation*/, uint32_t /*start*/) override
+		{
+		}
+
+		virtual void finish_optimize_permutation_v() override
+		{
+		}
+
+		virtual void flip_v() override
+		{
+		}
+
+		virtual void release_memory_v() override
+		{
+		}
+
+		virtual size_t trim_v(const TrimPolicy& policy) override
+		{
+			return trim(policy);
+		}
+
+		virtual void get_stats_v(StorageStats& r) const override
+		{
+			r = stats();
+		}
+
+		virtual void reset_stats_v() override
+		{
+			reset_stats();
+		}
+
+		virtual void push_back_v(const EntityId id, void* pMem, size_t sizeOf, size_t alignOf) override
+		{
+			assert(sizeOf == desc.size);
+			assert(alignOf == desc.align);
+			(void)sizeOf;
+			(void)alignOf;
+			push_back(id, pMem);
+		}
+
+		virtual size_t component_size_v() const override
+		{
+			return desc.size;
+		}
+
+		virtual size_t component_align_v() const override
+		{
+			return desc.align;
+		}
+
+		virtual bool is_trivially_copyable_v() const override
+		{
+			return (desc.moveFunc == nullptr && desc.destroyFunc == nullptr);
+		}
+
+		virtual void move_out_v(const EntityId id, void* pMem) override
+		{
+			int32_t index = forwardIndex.get(id.u.index);
+			assert(index >= 0 && "Component of this type is not present in this entity.");
+			move_construct(pMem, at(index));
+			erase(id);
+		}
+
+		virtual void destroy_value_v(void* pMem) override
+		{
+			destroy(pMem);
+		}
+	};
+
+
+	//
+	// Register the runtime-described component type, returns component type index
+	//   (the storage lives until the program exit)
+	//
+	uint32_t RegisterComponentType(const ComponentTypeDesc& desc);
+
+	// storage of the runtime-described component type
+	RuntimeComponentsStorage& GetRuntimeComponentStorage(uint32_t componentTypeIndex);
+
+}
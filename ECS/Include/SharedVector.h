@@ -0,0 +1,420 @@
+// The MIT License (MIT)
+//
+// 	Copyright (c) 2017 Sergey Makeev
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy
+// 	of this software and associated documentation files (the "Software"), to deal
+// 	in the Software without restriction, including without limitation the rights
+// 	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// 	copies of the Software, and to permit persons to whom the Software is
+// 	furnished to do so, subject to the following conditions:
+//
+//      The above copyright notice and this permission notice shall be included in
+// 	all copies or substantial portions of the Software.
+//
+// 	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// 	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// 	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// 	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// 	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// 	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// 	THE SOFTWARE.
+#pragma once
+
+
+
+#include <stdint.h>
+#include <assert.h>
+#include <new>
+#include <utility>
+#include <unordered_map>
+#include "ComponentTraits.h"
+#include "Memory.h"
+#include "Utils.h"
+
+
+namespace ecs
+{
+
+	//
+	// Shared (flyweight) container
+	//
+	//  Slots store handles of deduplicated, reference counted values.
+	//  Equal values (see component_hash<T> / component_equal<T>) added to the container share the same instance.
+	//
+	//  Read-only access returns the shared instance.
+	//  Mutable access makes a private copy of the value if the value is shared (copy on write) and flags the value as dirty,
+	//    dirty values are not used for deduplication (they can be modified by the caller at any time).
+	//  reintern() (called by ecs::Trim) rehashes dirty values and merges them with the equal shared values again.
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename T>
+	class shared_vector
+	{
+		static const uint32_t invalidHandle = UINT32_MAX;
+
+		struct value_desc
+		{
+			T value;
+			uint64_t hash;
+			uint32_t refCount;
+			bool isInterned;
+			bool isDirty;
+
+			value_desc(T&& v, uint64_t _hash)
+				: value(std::move(v))
+				, hash(_hash)
+				, refCount(1)
+				, isInterned(false)
+				, isDirty(false)
+			{
+			}
+		};
+
+		// slot -> value handle
+		ecs::vector<uint32_t> handles;
+
+		// value handle -> value
+		ecs::vector<value_desc*> values;
+
+		// unused value handles
+		ecs::vector<uint32_t> freeHandles;
+
+		// value hash -> value handle (only values that can be shared)
+		std::unordered_multimap<uint64_t, uint32_t> lookup;
+
+		// number of unique values
+		uint32_t valuesCount;
+
+		// number of values that were accessed for write since the last reintern()
+		uint32_t dirtyCount;
+
+		// non copyable
+		shared_vector(shared_vector&);
+		void operator=(shared_vector&);
+
+		uint32_t create_value(T&& v, uint64_t hash)
+		{
+			value_desc* desc = (value_desc*)memory::Alloc(sizeof(value_desc), alignof(value_desc) > 16 ? alignof(value_desc) : 16);
+			new (desc) value_desc(std::move(v), hash);
+
+			uint32_t handle;
+			if (freeHandles.empty())
+			{
+				handle = narrow_cast<uint32_t>(values.size());
+				values.push_back(desc);
+			}
+			else
+			{
+				handle = freeHandles.back();
+				freeHandles.pop_back();
+				values[handle] = desc;
+			}
+
+			valuesCount++;
+			return handle;
+		}
+
+		void remove_from_lookup(uint32_t handle)
+		{
+			value_desc* desc = values[handle];
+			if (!desc->isInterned)
+			{
+				return;
+			}
+
+			auto range = lookup.equal_range(desc->hash);
+			for (auto it = range.first; it != range.second; ++it)
+			{
+				if (it->second == handle)
+				{
+					lookup.erase(it);
+					break;
+				}
+			}
+			desc->isInterned = false;
+		}
+
+		void release_value(uint32_t handle)
+		{
+			if (handle == invalidHandle)
+			{
+				return;
+			}
+
+			value_desc* desc = values[handle];
+			assert(desc->refCount > 0);
+			desc->refCount--;
+			if (desc->refCount > 0)
+			{
+				return;
+			}
+
+			remove_from_lookup(handle);
+			if (desc->isDirty)
+			{
+				dirtyCount--;
+			}
+			desc->~value_desc();
+			memory::Free(desc);
+			values[handle] = nullptr;
+			freeHandles.push_back(handle);
+			valuesCount--;
+		}
+
+	public:
+
+		shared_vector()
+			: valuesCount(0)
+			, dirtyCount(0)
+		{
+		}
+
+		~shared_vector()
+		{
+			clear();
+		}
+
+		uint32_t size() const
+		{
+			return narrow_cast<uint32_t>(handles.size());
+		}
+
+		bool empty() const
+		{
+			return handles.empty();
+		}
+
+		uint32_t capacity() const
+		{
+			return narrow_cast<uint32_t>(handles.capacity());
+		}
+
+		void reserve(uint32_t newCapacity)
+		{
+			handles.reserve(newCapacity);
+		}
+
+		// number of bytes used by the handles, unique values and the lookup table (approximate, node overhead is not known)
+		size_t memory_footprint() const
+		{
+			return handles.capacity() * sizeof(uint32_t) +
+				values.capacity() * sizeof(value_desc*) +
+				freeHandles.capacity() * sizeof(uint32_t) +
+				size_t(valuesCount) * sizeof(value_desc) +
+				lookup.bucket_count() * sizeof(void*) +
+				lookup.size() * (sizeof(std::pair<const uint64_t, uint32_t>) + sizeof(void*));
+		}
+
+		// number of unique values stored in the container
+		uint32_t unique_count() const
+		{
+			return valuesCount;
+		}
+
+		void push_back(T&& v)
+		{
+			uint64_t hash = component_hash<T>()(v);
+
+			// find the same value
+			auto range = lookup.equal_range(hash);
+			for (auto it = range.first; it != range.second; ++it)
+			{
+				value_desc* desc = values[it->second];
+				if (!desc->isDirty && component_equal<T>()(desc->value, v))
+				{
+					desc->refCount++;
+					handles.push_back(it->second);
+					return;
+				}
+			}
+
+			uint32_t handle = create_value(std::move(v), hash);
+			lookup.insert(std::make_pair(hash, handle));
+			values[handle]->isInterned = true;
+			handles.push_back(handle);
+		}
+
+		void pop_back()
+		{
+			assert(!handles.empty());
+			release_value(handles.back());
+			handles.pop_back();
+		}
+
+		void clear()
+		{
+			while (!handles.empty())
+			{
+				pop_back();
+			}
+			assert(valuesCount == 0 && dirtyCount == 0);
+		}
+
+		// merge the dirty values with the equal shared values (or share them again if there is no equal value)
+		//   returns number of released values
+		uint32_t reintern()
+		{
+			if (dirtyCount == 0)
+			{
+				return 0;
+			}
+
+			uint32_t releasedCount = 0;
+			for (size_t i = 0; i < handles.size() && dirtyCount > 0; i++)
+			{
+				uint32_t handle = handles[i];
+				if (handle == invalidHandle || !values[handle]->isDirty)
+				{
+					continue;
+				}
+
+				// dirty values are never shared (copy on write)
+				value_desc* desc = values[handle];
+				assert(desc->refCount == 1);
+				remove_from_lookup(handle);
+				desc->isDirty = false;
+				dirtyCount--;
+
+				uint64_t hash = component_hash<T>()(desc->value);
+				uint32_t sharedHandle = invalidHandle;
+				auto range = lookup.equal_range(hash);
+				for (auto it = range.first; it != range.second; ++it)
+				{
+					value_desc* sharedDesc = values[it->second];
+					if (!sharedDesc->isDirty && component_equal<T>()(sharedDesc->value, desc->value))
+					{
+						sharedHandle = it->second;
+						break;
+					}
+				}
+
+				if (sharedHandle == invalidHandle)
+				{
+					desc->hash = hash;
+					lookup.insert(std::make_pair(hash, handle));
+					desc->isInterned = true;
+					continue;
+				}
+
+				values[sharedHandle]->refCount++;
+				handles[i] = sharedHandle;
+				release_value(handle);
+				releasedCount++;
+			}
+
+			assert(dirtyCount == 0);
+			return releasedCount;
+		}
+
+		// value descriptor size (used to report memory reclaimed by reintern)
+		static size_t value_size()
+		{
+			return sizeof(value_desc);
+		}
+
+		// dst = src (src slot becomes empty, it must be removed using pop_back)
+		void move(uint32_t dstIndex, uint32_t srcIndex)
+		{
+			assert(dstIndex < handles.size() && srcIndex < handles.size());
+			release_value(handles[dstIndex]);
+			handles[dstIndex] = handles[srcIndex];
+			handles[srcIndex] = invalidHandle;
+		}
+
+		void swap(uint32_t indexA, uint32_t indexB)
+		{
+			assert(indexA < handles.size() && indexB < handles.size());
+			std::swap(handles[indexA], handles[indexB]);
+		}
+
+		// apply the cycle of the permutation (only the handles are moved)
+		void rotate(const uint32_t* permutation, uint32_t start)
+		{
+			uint32_t tmp = handles[start];
+			uint32_t cur = start;
+			for (uint32_t next = permutation[cur]; next != start; next = permutation[cur])
+			{
+				handles[cur] = handles[next];
+				cur = next;
+			}
+			handles[cur] = tmp;
+		}
+
+		// true if the value of the slot is shared with other slots
+		bool is_shared(uint32_t index) const
+		{
+			assert(index < handles.size());
+			return (values[handles[index]]->refCount > 1);
+		}
+
+		// read-only access (shared instance)
+		const T& operator[] (uint32_t index) const
+		{
+			assert(index < handles.size() && handles[index] != invalidHandle);
+			return values[handles[index]]->value;
+		}
+
+		// write access (copy on write)
+		T& operator[] (uint32_t index)
+		{
+			assert(index < handles.size() && handles[index] != invalidHandle);
+			uint32_t handle = handles[index];
+			value_desc* desc = values[handle];
+
+			if (desc->refCount > 1)
+			{
+				// make a private copy
+				T copy(desc->value);
+				desc->refCount--;
+				handle = create_value(std::move(copy), desc->hash);
+				handles[index] = handle;
+				desc = values[handle];
+			}
+
+			// the value can be modified by the caller, exclude it from deduplication until the next reintern()
+			if (!desc->isDirty)
+			{
+				desc->isDirty = true;
+				dirtyCount++;
+			}
+			return desc->value;
+		}
+	};
+
+
+	//
+	// Element-wise operations used by ComponentsStorage<T>
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename T>
+	inline void move_component(shared_vector<T>& container, uint32_t dstIndex, uint32_t srcIndex)
+	{
+		container.move(dstIndex, srcIndex);
+	}
+
+	template<typename T>
+	inline void swap_components(shared_vector<T>& container, uint32_t indexA, uint32_t indexB)
+	{
+		container.swap(indexA, indexB);
+	}
+
+	template<typename T>
+	inline void rotate_components(shared_vector<T>& container, const uint32_t* permutation, uint32_t start)
+	{
+		container.rotate(permutation, start);
+	}
+
+	template<typename T>
+	inline size_t memory_footprint(const shared_vector<T>& container)
+	{
+		return container.memory_footprint();
+	}
+
+	template<typename T>
+	inline size_t trim_capacity(shared_vector<T>& container, const TrimPolicy& /*policy*/)
+	{
+		return size_t(container.reintern()) * shared_vector<T>::value_size();
+	}
+
+}
@@ -0,0 +1,367 @@
+// The MIT License (MIT)
+//
+// 	Copyright (c) 2017 Sergey Makeev
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy
+// 	of this software and associated documentation files (the "Software"), to deal
+// 	in the Software without restriction, including without limitation the rights
+// 	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// 	copies of the Software, and to permit persons to whom the Software is
+// 	furnished to do so, subject to the following conditions:
+//
+//      The above copyright notice and this permission notice shall be included in
+// 	all copies or substantial portions of the Software.
+//
+// 	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// 	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// 	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// 	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// 	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// 	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// 	THE SOFTWARE.
+#pragma once
+
+
+#include <stdint.h>
+#include <assert.h>
+#include <cstring>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+#include "ComponentTraits.h"
+#include "Memory.h"
+#include "Utils.h"
+
+
+namespace ecs
+{
+
+	//
+	// Contiguous array of the component field values (in the storage order)
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename TField>
+	struct field_span
+	{
+		TField* data;
+		uint32_t size;
+
+		TField* begin() const
+		{
+			return data;
+		}
+
+		TField* end() const
+		{
+			return data + size;
+		}
+
+		TField& operator[] (uint32_t index) const
+		{
+			assert(index < size);
+			return data[index];
+		}
+	};
+
+
+	namespace internal
+	{
+		template<typename TMember>
+		struct member_type;
+
+		template<typename TClass, typename TField>
+		struct member_type<TField TClass::*>
+		{
+			typedef TField type;
+		};
+	}
+
+
+	//
+	// Structure-of-arrays container
+	//
+	//  Keeps one array per component field (declared by ECS_DECLARE_COMPONENT_SOA).
+	//  Every array is aligned to the cache line and the capacity is always a multiple of 16 elements,
+	//  so SIMD kernels can safely process the tail of the array with full-width loads/stores.
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename T>
+	class soa_vector
+	{
+		typedef typename component_fields<T>::members_type members_type;
+
+	public:
+
+		static const uint32_t fieldsCount = std::tuple_size<members_type>::value;
+
+		template<uint32_t FIELD>
+		struct field_type
+		{
+			typedef typename internal::member_type<typename std::tuple_element<FIELD, members_type>::type>::type type;
+		};
+
+	private:
+
+		static const uint32_t fieldAlignment = 64;
+		static const uint32_t maxFieldSize = 64;
+		static const uint32_t simdWidth = 16;
+
+		uint8_t* fieldsData[fieldsCount];
+		uint32_t fieldsSize[fieldsCount];
+		uint32_t count;
+		uint32_t capacityCount;
+
+		// non copyable
+		soa_vector(soa_vector&);
+		void operator=(soa_vector&);
+
+		template<size_t... FIELDS>
+		void init_fields_size(std::index_sequence<FIELDS...>)
+		{
+			uint32_t sizes[] = { narrow_cast<uint32_t>(sizeof(typename field_type<FIELDS>::type))... };
+			for (uint32_t i = 0; i < fieldsCount; i++)
+			{
+				fieldsSize[i] = sizes[i];
+			}
+		}
+
+		template<size_t... FIELDS>
+		void store_fields(uint32_t index, const T& v, std::index_sequence<FIELDS...>)
+		{
+			const members_type members = component_fields<T>::members();
+			int dummy[] = { 0, (store_field<FIELDS>(index, v.*std::get<FIELDS>(members)), 0)... };
+			(void)dummy;
+		}
+
+		template<size_t... FIELDS>
+		void load_fields(uint32_t index, T* pDst, std::index_sequence<FIELDS...>) const
+		{
+			const members_type members = component_fields<T>::members();
+			int dummy[] = { 0, (std::memcpy(&(pDst->*std::get<FIELDS>(members)), field_data<FIELDS>() + index, sizeof(typename field_type<FIELDS>::type)), 0)... };
+			(void)dummy;
+		}
+
+		template<uint32_t FIELD, typename TField>
+		void store_field(uint32_t index, const TField& v)
+		{
+			static_assert(std::is_trivially_copyable<TField>::value, "SoA fields must be trivially copyable");
+			static_assert(sizeof(TField) <= maxFieldSize, "SoA field is too big");
+			field_data<FIELD>()[index] = v;
+		}
+
+		void grow(uint32_t newCapacity)
+		{
+			// round up to the SIMD width
+			newCapacity = (newCapacity + (simdWidth - 1)) & ~(simdWidth - 1);
+			assert(newCapacity > capacityCount);
+
+			for (uint32_t i = 0; i < fieldsCount; i++)
+			{
+				uint8_t* pNewData = (uint8_t*)memory::Alloc(size_t(newCapacity) * fieldsSize[i], fieldAlignment);
+				if (fieldsData[i])
+				{
+					std::memcpy(pNewData, fieldsData[i], size_t(count) * fieldsSize[i]);
+					memory::Free(fieldsData[i]);
+				}
+				fieldsData[i] = pNewData;
+			}
+
+			capacityCount = newCapacity;
+		}
+
+	public:
+
+		soa_vector()
+			: count(0)
+			, capacityCount(0)
+		{
+			static_assert(fieldsCount > 0, "SoA component must declare at least one field");
+			for (uint32_t i = 0; i < fieldsCount; i++)
+			{
+				fieldsData[i] = nullptr;
+			}
+			init_fields_size(std::make_index_sequence<fieldsCount>());
+		}
+
+		~soa_vector()
+		{
+			for (uint32_t i = 0; i < fieldsCount; i++)
+			{
+				memory::Free(fieldsData[i]);
+				fieldsData[i] = nullptr;
+			}
+		}
+
+		uint32_t size() const
+		{
+			return count;
+		}
+
+		bool empty() const
+		{
+			return (count == 0);
+		}
+
+		uint32_t capacity() const
+		{
+			return capacityCount;
+		}
+
+		void reserve(uint32_t newCapacity)
+		{
+			if (newCapacity > capacityCount)
+			{
+				grow(newCapacity);
+			}
+		}
+
+		// number of bytes used by the fields arrays
+		size_t memory_footprint() const
+		{
+			size_t bytesCount = 0;
+			for (uint32_t i = 0; i < fieldsCount; i++)
+			{
+				bytesCount += size_t(capacityCount) * fieldsSize[i];
+			}
+			return bytesCount;
+		}
+
+		void push_back(T&& v)
+		{
+			if (count == capacityCount)
+			{
+				grow(capacityCount < simdWidth ? simdWidth : capacityCount * 2);
+			}
+
+			store_fields(count, v, std::make_index_sequence<fieldsCount>());
+			count++;
+		}
+
+		void pop_back()
+		{
+			assert(count > 0);
+			count--;
+		}
+
+		// assemble the component from the fields (pDst points to the uninitialized memory)
+		void load(uint32_t index, T* pDst) const
+		{
+			assert(index < count);
+			load_fields(index, pDst, std::make_index_sequence<fieldsCount>());
+		}
+
+		// dst = src
+		void move(uint32_t dstIndex, uint32_t srcIndex)
+		{
+			assert(dstIndex < count && srcIndex < count);
+			for (uint32_t i = 0; i < fieldsCount; i++)
+			{
+				uint32_t fieldSize = fieldsSize[i];
+				std::memcpy(fieldsData[i] + size_t(dstIndex) * fieldSize, fieldsData[i] + size_t(srcIndex) * fieldSize, fieldSize);
+			}
+		}
+
+		// apply the cycle of the permutation, field by field (every value is moved exactly once)
+		void rotate(const uint32_t* permutation, uint32_t start)
+		{
+			uint8_t tmp[maxFieldSize];
+			for (uint32_t i = 0; i < fieldsCount; i++)
+			{
+				uint32_t fieldSize = fieldsSize[i];
+				uint8_t* data = fieldsData[i];
+				std::memcpy(tmp, data + size_t(start) * fieldSize, fieldSize);
+				uint32_t cur = start;
+				for (uint32_t next = permutation[cur]; next != start; next = permutation[cur])
+				{
+					std::memcpy(data + size_t(cur) * fieldSize, data + size_t(next) * fieldSize, fieldSize);
+					cur = next;
+				}
+				std::memcpy(data + size_t(cur) * fieldSize, tmp, fieldSize);
+			}
+		}
+
+		void swap(uint32_t indexA, uint32_t indexB)
+		{
+			assert(indexA < count && indexB < count);
+
+			uint8_t tmp[maxFieldSize];
+			for (uint32_t i = 0; i < fieldsCount; i++)
+			{
+				uint32_t fieldSize = fieldsSize[i];
+				uint8_t* a = fieldsData[i] + size_t(indexA) * fieldSize;
+				uint8_t* b = fieldsData[i] + size_t(indexB) * fieldSize;
+				std::memcpy(tmp, a, fieldSize);
+				std::memcpy(a, b, fieldSize);
+				std::memcpy(b, tmp, fieldSize);
+			}
+		}
+
+		template<uint32_t FIELD>
+		typename field_type<FIELD>::type* field_data()
+		{
+			static_assert(FIELD < fieldsCount, "Invalid field index");
+			return (typename field_type<FIELD>::type*)fieldsData[FIELD];
+		}
+
+		template<uint32_t FIELD>
+		const typename field_type<FIELD>::type* field_data() const
+		{
+			static_assert(FIELD < fieldsCount, "Invalid field index");
+			return (const typename field_type<FIELD>::type*)fieldsData[FIELD];
+		}
+
+		template<uint32_t FIELD>
+		field_span<typename field_type<FIELD>::type> field()
+		{
+			field_span<typename field_type<FIELD>::type> r;
+			r.data = field_data<FIELD>();
+			r.size = count;
+			return r;
+		}
+
+		template<uint32_t FIELD>
+		field_span<const typename field_type<FIELD>::type> field() const
+		{
+			field_span<const typename field_type<FIELD>::type> r;
+			r.data = field_data<FIELD>();
+			r.size = count;
+			return r;
+		}
+
+		template<typename TIndex>
+		T& operator[] (TIndex)
+		{
+			static_assert(sizeof(TIndex) == 0, "SoA components can't be accessed by pointer, use ComponentsStorage<T>::field<N>() instead");
+		}
+	};
+
+
+	//
+	// Element-wise operations used by ComponentsStorage<T>
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	template<typename T>
+	inline void move_component(soa_vector<T>& container, uint32_t dstIndex, uint32_t srcIndex)
+	{
+		container.move(dstIndex, srcIndex);
+	}
+
+	template<typename T>
+	inline void swap_components(soa_vector<T>& container, uint32_t indexA, uint32_t indexB)
+	{
+		container.swap(indexA, indexB);
+	}
+
+	template<typename T>
+	inline void rotate_components(soa_vector<T>& container, const uint32_t* permutation, uint32_t start)
+	{
+		container.rotate(permutation, start);
+	}
+
+	template<typename T>
+	inline size_t memory_footprint(const soa_vector<T>& container)
+	{
+		return container.memory_footprint();
+	}
+
+}
@@ -0,0 +1,245 @@
+// The MIT License (MIT)
+//
+// 	Copyright (c) 2017 Sergey Makeev
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy
+// 	of this software and associated documentation files (the "Software"), to deal
+// 	in the Software without restriction, including without limitation the rights
+// 	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// 	copies of the Software, and to permit persons to whom the Software is
+// 	furnished to do so, subject to the following conditions:
+//
+//      The above copyright notice and this permission notice shall be included in
+// 	all copies or substantial portions of the Software.
+//
+// 	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// 	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// 	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// 	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// 	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// 	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// 	THE SOFTWARE.
+#pragma once
+
+
+#include <stdint.h>
+#include <assert.h>
+#include <cstring>
+#include <vector>
+#include "Memory.h"
+#include "Utils.h"
+
+
+namespace ecs
+{
+	// forward decl
+	int32_t* GetEmptyIndexPage();
+
+
+	//
+	// Paged sparse index (entity index -> component index)
+	//
+	//  The index space is split into fixed-size pages which are allocated on demand.
+	//  All pages that do not contain any valid value point to the one shared read-only "all -1" page,
+	//  so a component type used by a few high-index entities costs only a few pages instead of 4 bytes * max entity index.
+	//
+	//  Lookup is O(1): one page table read + one page read.
+	//
+	/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	class sparse_index
+	{
+	public:
+
+		// 1024 elements * 4 bytes = 4Kb per page
+		static const uint32_t pageSizeLog2 = 10;
+		static const uint32_t pageSize = (1 << pageSizeLog2);
+		static const uint32_t pageMask = (pageSize - 1);
+
+	private:
+
+		// page table (unallocated pages point to the shared empty page)
+		ecs::vector<int32_t*> pages;
+
+		// shared read-only page (all values are -1)
+		int32_t* emptyPage;
+
+		// number of pages owned by this index
+		uint32_t allocatedPagesCount;
+
+		// non copyable
+		sparse_index(sparse_index&);
+		void operator=(sparse_index&);
+
+		int32_t* acquire_page(uint32_t pageIndex)
+		{
+			if (pageIndex >= pages.size())
+			{
+				pages.resize(pageIndex + 1, emptyPage);
+			}
+
+			int32_t* page = pages[pageIndex];
+			if (page != emptyPage)
+			{
+				return page;
+			}
+
+			// copy on write (allocate a new page)
+			page = (int32_t*)memory::Alloc(pageSize * sizeof(int32_t), 16);
+			std::memset(page, 0xFF, pageSize * sizeof(int32_t));
+			pages[pageIndex] = page;
+			allocatedPagesCount++;
+			return page;
+		}
+
+	public:
+
+		sparse_index()
+			: emptyPage(GetEmptyIndexPage())
+			, allocatedPagesCount(0)
+		{
+		}
+
+		~sparse_index()
+		{
+			clear();
+		}
+
+		// translate index to value or -1 if no value present for this index
+		int32_t get(uint32_t index) const
+		{
+			uint32_t pageIndex = (index >> pageSizeLog2);
+			if (pageIndex >= pages.size())
+			{
+				return -1;
+			}
+
+			return pages[pageIndex][index & pageMask];
+		}
+
+		// grow the page table to cover indices [0 .. indexCount)
+		void reserve(uint32_t indexCount)
+		{
+			uint32_t pagesCount = (indexCount + pageMask) >> pageSizeLog2;
+			if (pagesCount > pages.size())
+			{
+				pages.resize(pagesCount, emptyPage);
+			}
+		}
+
+		void set(uint32_t index, int32_t value)
+		{
+			assert(value >= 0 && "Use reset() to remove the value");
+			int32_t* page = acquire_page(index >> pageSizeLog2);
+			page[index & pageMask] = value;
+		}
+
+		void reset(uint32_t index)
+		{
+			uint32_t pageIndex = (index >> pageSizeLog2);
+			if (pageIndex >= pages.size())
+			{
+				return;
+			}
+
+			int32_t* page = pages[pageIndex];
+			if (page == emptyPage)
+			{
+				return;
+			}
+
+			page[index & pageMask] = -1;
+		}
+
+		// upper bound of the index space covered by the page table
+		uint32_t size() const
+		{
+			return narrow_cast<uint32_t>(pages.size()) << pageSizeLog2;
+		}
+
+		uint32_t pages_count() const
+		{
+			return narrow_cast<uint32_t>(pages.size());
+		}
+
+		// true if the page does not contain any valid value (and can be skipped)
+		bool is_empty_page(uint32_t pageIndex) const
+		{
+			assert(pageIndex < pages.size());
+			return (pages[pageIndex] == emptyPage);
+		}
+
+		// free all the pages above indexCount and all the pages without valid values,
+		//   returns number of bytes reclaimed
+		size_t trim(uint32_t indexCount)
+		{
+			size_t oldFootprint = memory_footprint();
+
+			uint32_t pagesCount = narrow_cast<uint32_t>(pages.size());
+			uint32_t newPagesCount = 0;
+			for (uint32_t pageIndex = 0; pageIndex < pagesCount; pageIndex++)
+			{
+				int32_t* page = pages[pageIndex];
+				if (page == emptyPage)
+				{
+					continue;
+				}
+
+				bool isUsed = false;
+				if ((pageIndex << pageSizeLog2) < indexCount)
+				{
+					for (uint32_t i = 0; i < pageSize; i++)
+					{
+						if (page[i] >= 0)
+						{
+							isUsed = true;
+							break;
+						}
+					}
+				}
+
+				if (isUsed)
+				{
+					newPagesCount = pageIndex + 1;
+					continue;
+				}
+
+				memory::Free(page);
+				pages[pageIndex] = emptyPage;
+				allocatedPagesCount--;
+			}
+
+			// shrink page table
+			if (newPagesCount < pages.capacity())
+			{
+				ecs::vector<int32_t*> newTable;
+				newTable.reserve(newPagesCount);
+				newTable.insert(newTable.end(), pages.begin(), pages.begin() + newPagesCount);
+				pages.swap(newTable);
+			}
+
+			return oldFootprint - memory_footprint();
+		}
+
+		// number of bytes used by this index (page table + allocated pages)
+		size_t memory_footprint() const
+		{
+			return (pages.capacity() * sizeof(int32_t*)) + (size_t(allocatedPagesCount) * pageSize * sizeof(int32_t));
+		}
+
+		void clear()
+		{
+			for (auto it = pages.begin(); it != pages.end(); ++it)
+			{
+				if (*it != emptyPage)
+				{
+					memory::Free(*it);
+				}
+			}
+			// release page table memory
+			ecs::vector<int32_t*> emptyTable;
+			pages.swap(emptyTable);
+			allocatedPagesCount = 0;
+		}
+	};
+
+}
@@ -21,6 +21,14 @@
 // 	THE SOFTWARE.
 #pragma once
 
+#include <stdint.h>
+#include <algorithm>
+#include <type_traits>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
 
 namespace ecs
 {
@@ -31,4 +39,77 @@ namespace ecs
 		static_assert(std::is_integral<TInput>::value, "TInput must be numeric type");
 		return TOutput(value);
 	}
+
+	// reserve memory for additionalCount new elements (keeps geometric growth of the container)
+	template<typename TContainer>
+	inline void reserve_additional(TContainer& container, size_t additionalCount)
+	{
+		size_t requiredCapacity = size_t(container.size()) + additionalCount;
+		size_t capacity = size_t(container.capacity());
+		if (requiredCapacity > capacity)
+		{
+			container.reserve(narrow_cast<uint32_t>(std::max(requiredCapacity, capacity * 2)));
+		}
+	}
+
+	namespace internal
+	{
+		//
+		// Persistent worker threads (owned by the context)
+		//
+		//  Threads are created on the first use and sleep between the jobs.
+		//  Nested or concurrent run() calls are executed on the calling thread.
+		//
+		/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+		class worker_pool
+		{
+		public:
+
+			typedef void (*JobFunc)(void* userData, uint32_t threadIndex);
+
+		private:
+
+			std::vector<std::thread> threads;
+			std::mutex lock;
+			std::condition_variable jobStarted;
+			std::condition_variable jobFinished;
+
+			JobFunc jobFunc;
+			void* jobData;
+			uint32_t jobThreadsCount;
+			uint32_t jobGeneration;
+			uint32_t pendingCount;
+			bool isBusy;
+			bool isExiting;
+
+			// non copyable
+			worker_pool(worker_pool&);
+			void operator=(worker_pool&);
+
+			void worker_thread(uint32_t threadIndex, uint32_t generation);
+
+		public:
+
+			worker_pool();
+			~worker_pool();
+
+			// run func(userData, threadIndex) on threadsCount threads (the calling thread executes thread 0)
+			void run(uint32_t threadsCount, JobFunc func, void* userData);
+		};
+
+		worker_pool& GetWorkerPool();
+
+		template<typename TFunc>
+		inline void ParallelForJob(void* userData, uint32_t threadIndex)
+		{
+			(*(const TFunc*)userData)(threadIndex);
+		}
+
+		// run func(threadIndex) on threadsCount threads (the calling thread executes thread 0)
+		template<typename TFunc>
+		inline void ParallelFor(uint32_t threadsCount, const TFunc& func)
+		{
+			GetWorkerPool().run(threadsCount, &ParallelForJob<TFunc>, (void*)&func);
+		}
+	}
 }
@@ -0,0 +1,111 @@
+// The MIT License (MIT)
+//
+// 	Copyright (c) 2017 Sergey Makeev
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy
+// 	of this software and associated documentation files (the "Software"), to deal
+// 	in the Software without restriction, including without limitation the rights
+// 	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// 	copies of the Software, and to permit persons to whom the Software is
+// 	furnished to do so, subject to the following conditions:
+//
+//      The above copyright notice and this permission notice shall be included in
+// 	all copies or substantial portions of the Software.
+//
+// 	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// 	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// 	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// 	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// 	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// 	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// 	THE SOFTWARE.
+#include <stdint.h>
+#include <assert.h>
+#include <cstring>
+#include <Archetype.h>
+
+
+namespace ecs
+{
+	const ArchetypeId archetype_table::emptyArchetype;
+
+	/////////////////////////////////////////////////////////////////////////////////
+	archetype_table::archetype_table()
+		: generation(0)
+	{
+		intern(bitset());
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	uint64_t archetype_table::hash(const bitset& mask)
+	{
+		// FNV-1a
+		const uint8_t* bytes = (const uint8_t*)&mask;
+		uint64_t h = 14695981039346656037ULL;
+		for (size_t i = 0; i < sizeof(bitset); i++)
+		{
+			h ^= bytes[i];
+			h *= 1099511628211ULL;
+		}
+		return h;
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	ArchetypeId archetype_table::intern(const bitset& mask)
+	{
+		uint64_t maskHash = hash(mask);
+		auto range = lookup.equal_range(maskHash);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			if (std::memcmp(&masks[it->second], &mask, sizeof(bitset)) == 0)
+			{
+				return it->second;
+			}
+		}
+
+		assert(masks.size() <= UINT16_MAX && "Too many archetypes");
+		ArchetypeId archetype = narrow_cast<ArchetypeId>(masks.size());
+		masks.push_back(mask);
+		lookup.insert(std::make_pair(maskHash, archetype));
+		return archetype;
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	ArchetypeId archetype_table::transition(ArchetypeId archetype, uint32_t componentTypeIndex, bool isRemove)
+	{
+		uint32_t key = transition_key(archetype, componentTypeIndex, isRemove);
+		auto it = transitions.find(key);
+		if (it != transitions.end())
+		{
+			return it->second;
+		}
+
+		// slow path: build the mask and intern it (copy, intern can reallocate the masks array)
+		bitset newMask = mask(archetype);
+		if (isRemove)
+		{
+			assert(newMask.get(componentTypeIndex) && "Component of this type is not present in this entity.");
+			newMask.reset(componentTypeIndex);
+		}
+		else
+		{
+			assert(!newMask.get(componentTypeIndex) && "Component of this type already present in this entity.");
+			newMask.set(componentTypeIndex);
+		}
+
+		ArchetypeId newArchetype = intern(newMask);
+		transitions.insert(std::make_pair(key, newArchetype));
+		return newArchetype;
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	void archetype_table::clear()
+	{
+		masks.clear();
+		lookup.clear();
+		transitions.clear();
+		generation++;
+		intern(bitset());
+	}
+
+}
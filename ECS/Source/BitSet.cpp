@@ -0,0 +1,230 @@
+// The MIT License (MIT)
+//
+// 	Copyright (c) 2017 Sergey Makeev
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy
+// 	of this software and associated documentation files (the "Software"), to deal
+// 	in the Software without restriction, including without limitation the rights
+// 	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// 	copies of the Software, and to permit persons to whom the Software is
+// 	furnished to do so, subject to the following conditions:
+//
+//      The above copyright notice and this permission notice shall be included in
+// 	all copies or substantial portions of the Software.
+//
+// 	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// 	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// 	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// 	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// 	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// 	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// 	THE SOFTWARE.
+#include <stdint.h>
+#include <assert.h>
+#include <BitSet.h>
+
+#if !defined(_MSC_VER)
+#include <immintrin.h>
+#endif
+
+
+namespace ecs
+{
+	namespace internal
+	{
+		static const uint32_t qwordsCount = bitset::qwordsCount;
+
+#if ECS_COMPONENT_MASK_BITS < 128
+
+		/////////////////////////////////////////////////////////////////////////////////
+		// scalar kernel (64 bit mask, one general purpose register)
+		static void MatchMasksScalar(const aspect_filter& filter, const bitset* masks, uint32_t count, uint8_t* results)
+		{
+			const uint64_t* required = filter.required.data();
+			const uint64_t* excluded = filter.excluded.data();
+			const uint64_t* anyOf = filter.anyOf.data();
+			uint64_t noAnyOf = filter.anyOf.empty() ? 1 : 0;
+
+			for (uint32_t n = 0; n < count; n++)
+			{
+				const uint64_t* m = masks[n].data();
+				uint64_t missing = 0;
+				uint64_t hit = noAnyOf;
+				for (uint32_t i = 0; i < qwordsCount; i++)
+				{
+					missing |= (required[i] & ~m[i]) | (excluded[i] & m[i]);
+					hit |= (anyOf[i] & m[i]);
+				}
+				results[n] = uint8_t((missing == 0) & (hit != 0));
+			}
+		}
+
+#else
+
+		static const uint32_t xmmCount = qwordsCount / 2;
+
+		/////////////////////////////////////////////////////////////////////////////////
+		// SSE2 kernel (128 bit registers)
+		static void MatchMasksSSE2(const aspect_filter& filter, const bitset* masks, uint32_t count, uint8_t* results)
+		{
+			__m128i required[xmmCount];
+			__m128i excluded[xmmCount];
+			__m128i anyOf[xmmCount];
+			for (uint32_t i = 0; i < xmmCount; i++)
+			{
+				required[i] = _mm_loadu_si128((const __m128i*)filter.required.data() + i);
+				excluded[i] = _mm_loadu_si128((const __m128i*)filter.excluded.data() + i);
+				anyOf[i] = _mm_loadu_si128((const __m128i*)filter.anyOf.data() + i);
+			}
+			bool noAnyOf = filter.anyOf.empty();
+
+			__m128i zero = _mm_setzero_si128();
+			for (uint32_t n = 0; n < count; n++)
+			{
+				const __m128i* m = (const __m128i*)masks[n].data();
+				__m128i missing = zero;
+				__m128i hit = zero;
+				for (uint32_t i = 0; i < xmmCount; i++)
+				{
+					__m128i v = _mm_loadu_si128(m + i);
+					missing = _mm_or_si128(missing, _mm_or_si128(_mm_andnot_si128(v, required[i]), _mm_and_si128(v, excluded[i])));
+					hit = _mm_or_si128(hit, _mm_and_si128(v, anyOf[i]));
+				}
+				bool isMissing = (_mm_movemask_epi8(_mm_cmpeq_epi32(missing, zero)) != 0xFFFF);
+				bool isHit = (_mm_movemask_epi8(_mm_cmpeq_epi32(hit, zero)) != 0xFFFF);
+				results[n] = uint8_t(!isMissing && (isHit || noAnyOf));
+			}
+		}
+
+#endif
+
+#if ECS_COMPONENT_MASK_BITS >= 256
+
+		static const uint32_t ymmCount = qwordsCount / 4;
+		static const uint32_t xmmTail = (qwordsCount % 4) / 2;
+
+		/////////////////////////////////////////////////////////////////////////////////
+		// AVX2 kernel (256 bit registers + 128 bit register for the tail)
+		ECS_TARGET_AVX2 static void MatchMasksAVX2(const aspect_filter& filter, const bitset* masks, uint32_t count, uint8_t* results)
+		{
+			__m256i required[ymmCount];
+			__m256i excluded[ymmCount];
+			__m256i anyOf[ymmCount];
+			for (uint32_t i = 0; i < ymmCount; i++)
+			{
+				required[i] = _mm256_loadu_si256((const __m256i*)filter.required.data() + i);
+				excluded[i] = _mm256_loadu_si256((const __m256i*)filter.excluded.data() + i);
+				anyOf[i] = _mm256_loadu_si256((const __m256i*)filter.anyOf.data() + i);
+			}
+
+			const uint32_t tailOffset = ymmCount * 2;
+			__m128i requiredTail = xmmTail ? _mm_loadu_si128((const __m128i*)filter.required.data() + tailOffset) : _mm_setzero_si128();
+			__m128i excludedTail = xmmTail ? _mm_loadu_si128((const __m128i*)filter.excluded.data() + tailOffset) : _mm_setzero_si128();
+			__m128i anyOfTail = xmmTail ? _mm_loadu_si128((const __m128i*)filter.anyOf.data() + tailOffset) : _mm_setzero_si128();
+			int noAnyOf = filter.anyOf.empty() ? 1 : 0;
+
+			for (uint32_t n = 0; n < count; n++)
+			{
+				const __m256i* m = (const __m256i*)masks[n].data();
+				int res = 1;
+				int hit = noAnyOf;
+				for (uint32_t i = 0; i < ymmCount; i++)
+				{
+					__m256i v = _mm256_loadu_si256(m + i);
+					res &= _mm256_testc_si256(v, required[i]);
+					res &= _mm256_testz_si256(v, excluded[i]);
+					hit |= (1 - _mm256_testz_si256(v, anyOf[i]));
+				}
+				if (xmmTail)
+				{
+					__m128i v = _mm_loadu_si128((const __m128i*)masks[n].data() + tailOffset);
+					res &= _mm_testc_si128(v, requiredTail);
+					res &= _mm_testz_si128(v, excludedTail);
+					hit |= (1 - _mm_testz_si128(v, anyOfTail));
+				}
+				results[n] = uint8_t(res & hit);
+			}
+		}
+
+#endif
+
+#if ECS_COMPONENT_MASK_BITS >= 128 && ECS_AVX512_KERNELS
+
+		static const uint32_t zmmCount = (qwordsCount + 7) / 8;
+		static const uint32_t tailDwords = ((qwordsCount % 8) * 2);
+
+		/////////////////////////////////////////////////////////////////////////////////
+		// AVX-512 kernel (512 bit registers, masked load of the tail)
+		ECS_TARGET_AVX512 static void MatchMasksAVX512(const aspect_filter& filter, const bitset* masks, uint32_t count, uint8_t* results)
+		{
+			__m512i required[zmmCount];
+			__m512i excluded[zmmCount];
+			__m512i anyOf[zmmCount];
+			__mmask16 loadMask[zmmCount];
+			for (uint32_t i = 0; i < zmmCount; i++)
+			{
+				loadMask[i] = (i == zmmCount - 1 && tailDwords != 0) ? __mmask16((1 << tailDwords) - 1) : __mmask16(0xFFFF);
+				required[i] = _mm512_maskz_loadu_epi32(loadMask[i], filter.required.data() + i * 8);
+				excluded[i] = _mm512_maskz_loadu_epi32(loadMask[i], filter.excluded.data() + i * 8);
+				anyOf[i] = _mm512_maskz_loadu_epi32(loadMask[i], filter.anyOf.data() + i * 8);
+			}
+			int noAnyOf = filter.anyOf.empty() ? 1 : 0;
+
+			for (uint32_t n = 0; n < count; n++)
+			{
+				const uint64_t* m = masks[n].data();
+				__mmask16 missing = 0;
+				__mmask16 hit = 0;
+				for (uint32_t i = 0; i < zmmCount; i++)
+				{
+					__m512i v = _mm512_maskz_loadu_epi32(loadMask[i], m + i * 8);
+					missing |= _mm512_cmpneq_epi32_mask(_mm512_and_si512(v, required[i]), required[i]);
+					missing |= _mm512_test_epi32_mask(v, excluded[i]);
+					hit |= _mm512_test_epi32_mask(v, anyOf[i]);
+				}
+				results[n] = uint8_t((missing == 0) & ((hit != 0) | noAnyOf));
+			}
+		}
+
+#endif
+
+		/////////////////////////////////////////////////////////////////////////////////
+		MatchMasksFunc GetMatchMasksKernel(SimdLevel::Type level)
+		{
+			switch (level)
+			{
+			case SimdLevel::SSE2:
+#if ECS_COMPONENT_MASK_BITS >= 128
+				return MatchMasksSSE2;
+#else
+				return MatchMasksScalar;
+#endif
+			case SimdLevel::AVX2:
+#if ECS_COMPONENT_MASK_BITS >= 256
+				return MatchMasksAVX2;
+#elif ECS_COMPONENT_MASK_BITS >= 128
+				// single 128 bit register, nothing to win
+				return MatchMasksSSE2;
+#else
+				return MatchMasksScalar;
+#endif
+			case SimdLevel::AVX512:
+#if ECS_COMPONENT_MASK_BITS >= 128 && ECS_AVX512_KERNELS
+				return MatchMasksAVX512;
+#else
+				return GetMatchMasksKernel(SimdLevel::AVX2);
+#endif
+			default:
+				return nullptr;
+			}
+		}
+
+		/////////////////////////////////////////////////////////////////////////////////
+		void MatchMasks(const aspect_filter& filter, const bitset* masks, uint32_t count, uint8_t* results)
+		{
+			static const MatchMasksFunc kernel = GetMatchMasksKernel(GetSimdLevel());
+			kernel(filter, masks, count, results);
+		}
+	}
+
+}
@@ -0,0 +1,232 @@
+// The MIT License (MIT)
+//
+// 	Copyright (c) 2017 Sergey Makeev
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy
+// 	of this software and associated documentation files (the "Software"), to deal
+// 	in the Software without restriction, including without limitation the rights
+// 	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// 	copies of the Software, and to permit persons to whom the Software is
+// 	furnished to do so, subject to the following conditions:
+//
+//      The above copyright notice and this permission notice shall be included in
+// 	all copies or substantial portions of the Software.
+//
+// 	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// 	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// 	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// 	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// 	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// 	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// 	THE SOFTWARE.
+
+#include <stdint.h>
+#include <assert.h>
+#include <cstring>
+#include <Compression.h>
+
+
+namespace ecs
+{
+	namespace lz
+	{
+		//
+		// Compressed stream is a list of sequences
+		//
+		//  [token] [literals length ext] [literals] [match offset] [match length ext]
+		//
+		//  token : 4 high bits - literals length, 4 low bits - match length (minus minMatch)
+		//          value 15 means that the length is continued in the following bytes (255 - continue)
+		//
+		//  The last sequence contains only literals.
+		//
+		static const uint32_t minMatch = 4;
+		static const uint32_t maxOffset = 65535;
+		static const uint32_t hashLog = 12;
+		static const uint32_t hashSize = (1 << hashLog);
+
+
+		/////////////////////////////////////////////////////////////////////////////////
+		static inline uint32_t Read32(const uint8_t* p)
+		{
+			uint32_t v;
+			std::memcpy(&v, p, sizeof(uint32_t));
+			return v;
+		}
+
+		/////////////////////////////////////////////////////////////////////////////////
+		static inline uint32_t Hash(uint32_t v)
+		{
+			return (v * 2654435761u) >> (32 - hashLog);
+		}
+
+		/////////////////////////////////////////////////////////////////////////////////
+		static inline bool WriteLength(uint8_t*& op, const uint8_t* opEnd, uint32_t length)
+		{
+			for (; length >= 255; length -= 255)
+			{
+				if (op >= opEnd)
+					return false;
+				*op++ = 255;
+			}
+
+			if (op >= opEnd)
+				return false;
+			*op++ = (uint8_t)length;
+			return true;
+		}
+
+		/////////////////////////////////////////////////////////////////////////////////
+		static inline bool ReadLength(const uint8_t*& ip, const uint8_t* ipEnd, uint32_t& length)
+		{
+			uint8_t v;
+			do
+			{
+				if (ip >= ipEnd)
+					return false;
+				v = *ip++;
+				length += v;
+			} while (v == 255);
+			return true;
+		}
+
+		/////////////////////////////////////////////////////////////////////////////////
+		static bool WriteSequence(uint8_t*& op, const uint8_t* opEnd, const uint8_t* literals, uint32_t literalsCount, uint32_t offset, uint32_t matchLength)
+		{
+			if (op >= opEnd)
+				return false;
+
+			uint32_t matchCode = (matchLength >= minMatch) ? (matchLength - minMatch) : 0;
+
+			uint8_t* token = op++;
+			*token = (uint8_t)(((literalsCount < 15 ? literalsCount : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+
+			if (literalsCount >= 15 && !WriteLength(op, opEnd, literalsCount - 15))
+				return false;
+
+			if ((uint32_t)(opEnd - op) < literalsCount)
+				return false;
+			std::memcpy(op, literals, literalsCount);
+			op += literalsCount;
+
+			// last sequence
+			if (matchLength == 0)
+				return true;
+
+			if ((opEnd - op) < 2)
+				return false;
+			*op++ = (uint8_t)(offset & 0xFF);
+			*op++ = (uint8_t)(offset >> 8);
+
+			if (matchCode >= 15 && !WriteLength(op, opEnd, matchCode - 15))
+				return false;
+
+			return true;
+		}
+
+		/////////////////////////////////////////////////////////////////////////////////
+		uint32_t CompressBound(uint32_t srcSize)
+		{
+			return srcSize + (srcSize / 255) + 16;
+		}
+
+		/////////////////////////////////////////////////////////////////////////////////
+		uint32_t Compress(const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t dstCapacity)
+		{
+			// position + 1 of the last occurrence of the hash (0 - empty)
+			uint32_t hashTable[hashSize];
+			std::memset(&hashTable[0], 0, sizeof(hashTable));
+
+			uint8_t* op = dst;
+			const uint8_t* opEnd = dst + dstCapacity;
+
+			uint32_t anchor = 0;
+			uint32_t ip = 0;
+			while (ip + minMatch <= srcSize)
+			{
+				uint32_t sequence = Read32(src + ip);
+				uint32_t h = Hash(sequence);
+				uint32_t ref = hashTable[h];
+				hashTable[h] = ip + 1;
+
+				if (ref == 0 || (ip - (ref - 1)) > maxOffset || Read32(src + ref - 1) != sequence)
+				{
+					ip++;
+					continue;
+				}
+
+				uint32_t matchPos = ref - 1;
+				uint32_t matchLength = minMatch;
+				while (ip + matchLength < srcSize && src[matchPos + matchLength] == src[ip + matchLength])
+				{
+					matchLength++;
+				}
+
+				if (!WriteSequence(op, opEnd, src + anchor, ip - anchor, ip - matchPos, matchLength))
+					return 0;
+
+				ip += matchLength;
+				anchor = ip;
+			}
+
+			// last literals
+			if (!WriteSequence(op, opEnd, src + anchor, srcSize - anchor, 0, 0))
+				return 0;
+
+			return (uint32_t)(op - dst);
+		}
+
+		/////////////////////////////////////////////////////////////////////////////////
+		bool Decompress(const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t dstSize)
+		{
+			const uint8_t* ip = src;
+			const uint8_t* ipEnd = src + srcSize;
+			uint8_t* op = dst;
+			const uint8_t* opEnd = dst + dstSize;
+
+			while (ip < ipEnd)
+			{
+				uint8_t token = *ip++;
+
+				// literals
+				uint32_t literalsCount = (token >> 4);
+				if (literalsCount == 15 && !ReadLength(ip, ipEnd, literalsCount))
+					return false;
+
+				if ((uint32_t)(ipEnd - ip) < literalsCount || (uint32_t)(opEnd - op) < literalsCount)
+					return false;
+				std::memcpy(op, ip, literalsCount);
+				ip += literalsCount;
+				op += literalsCount;
+
+				// last sequence
+				if (ip == ipEnd)
+					break;
+
+				// match
+				if ((ipEnd - ip) < 2)
+					return false;
+				uint32_t offset = (uint32_t)ip[0] | ((uint32_t)ip[1] << 8);
+				ip += 2;
+
+				uint32_t matchLength = (token & 15);
+				if (matchLength == 15 && !ReadLength(ip, ipEnd, matchLength))
+					return false;
+				matchLength += minMatch;
+
+				if (offset == 0 || offset > (uint32_t)(op - dst) || (uint32_t)(opEnd - op) < matchLength)
+					return false;
+
+				// byte by byte copy (source and destination can overlap)
+				const uint8_t* match = op - offset;
+				for (uint32_t i = 0; i < matchLength; i++)
+				{
+					op[i] = match[i];
+				}
+				op += matchLength;
+			}
+
+			return (op == opEnd);
+		}
+	}
+}
@@ -20,11 +20,29 @@
 // 	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // 	THE SOFTWARE.
 #include <stdint.h>
+#include <assert.h>
 #include <array>
 #include <vector>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <algorithm>
 #include <BitSet.h>
 #include <Entity.h>
 #include <Process.h>
+#include <Compression.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
 
 
 class IComponentsStorage;
@@ -45,6 +63,68 @@ namespace ecs
 		{
 			_mm_free(p);
 		}
+
+#ifdef _WIN32
+
+		/////////////////////////////////////////////////////////////////////////////////
+		void* ReserveAddressSpace(size_t bytesCount)
+		{
+			return VirtualAlloc(nullptr, bytesCount, MEM_RESERVE, PAGE_NOACCESS);
+		}
+
+		/////////////////////////////////////////////////////////////////////////////////
+		void ReleaseAddressSpace(void* p, size_t /*bytesCount*/)
+		{
+			VirtualFree(p, 0, MEM_RELEASE);
+		}
+
+		/////////////////////////////////////////////////////////////////////////////////
+		void CommitPages(void* p, size_t bytesCount)
+		{
+			void* pCommitted = VirtualAlloc(p, bytesCount, MEM_COMMIT, PAGE_READWRITE);
+			assert(pCommitted != nullptr && "Can't commit memory");
+			(void)pCommitted;
+		}
+
+		/////////////////////////////////////////////////////////////////////////////////
+		void DecommitPages(void* p, size_t bytesCount)
+		{
+			VirtualFree(p, bytesCount, MEM_DECOMMIT);
+		}
+
+#else
+
+		/////////////////////////////////////////////////////////////////////////////////
+		void* ReserveAddressSpace(size_t bytesCount)
+		{
+			void* p = mmap(nullptr, bytesCount, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+			return (p == MAP_FAILED) ? nullptr : p;
+		}
+
+		/////////////////////////////////////////////////////////////////////////////////
+		void ReleaseAddressSpace(void* p, size_t bytesCount)
+		{
+			munmap(p, bytesCount);
+		}
+
+		/////////////////////////////////////////////////////////////////////////////////
+		void CommitPages(void* p, size_t bytesCount)
+		{
+			// physical pages are allocated by the OS on the first access
+			int res = mprotect(p, bytesCount, PROT_READ | PROT_WRITE);
+			assert(res == 0 && "Can't commit memory");
+			(void)res;
+		}
+
+		/////////////////////////////////////////////////////////////////////////////////
+		void DecommitPages(void* p, size_t bytesCount)
+		{
+			// return physical pages to the OS and keep the address range reserved
+			madvise(p, bytesCount, MADV_DONTNEED);
+			mprotect(p, bytesCount, PROT_NONE);
+		}
+
+#endif
 	}
 
 
@@ -56,6 +136,14 @@ namespace ecs
 		return globalCounter;
 	}
 
+	/////////////////////////////////////////////////////////////////////////////////
+	uint32_t& GlobalFrameIndex()
+	{
+		// frame 0 is reserved for 'never changed'
+		static uint32_t frameIndex = 1;
+		return frameIndex;
+	}
+
 	/////////////////////////////////////////////////////////////////////////////////
 	std::array<IComponentsStorage*, bitset::MaxBitCount::value>& GetStorageDirectory()
 	{
@@ -71,6 +159,25 @@ namespace ecs
 	}
 
 
+	/////////////////////////////////////////////////////////////////////////////////
+	int32_t* GetEmptyIndexPage()
+	{
+		// shared read-only page for all sparse indices (all values are -1)
+		struct EmptyPage
+		{
+			int32_t data[sparse_index::pageSize];
+
+			EmptyPage()
+			{
+				std::memset(&data[0], 0xFF, sizeof(data));
+			}
+		};
+
+		static EmptyPage emptyPage;
+		return &emptyPage.data[0];
+	}
+
+
 	static const size_t dispatcherBufferSize = 4 * 1024 * 1024;
 
 	/////////////////////////////////////////////////////////////////////////////////
@@ -80,12 +187,13 @@ namespace ecs
 		state = ContextState::MUTABLE;
 
 		needRebuildOrderedList = false;
+		optimizeStorageIndex = 0;
 
 		// make initial memory reservation
-		const size_t initialEntitiesCount = 1024;
+		const uint32_t initialEntitiesCount = 1024;
 
 		entitiesDesc.reserve(initialEntitiesCount);
-		entitiesMasks.reserve(initialEntitiesCount);
+		entitiesArchetypes.reserve(initialEntitiesCount);
 
 		unorderedUsedEntitiesIds.reserve(initialEntitiesCount);
 
@@ -101,6 +209,242 @@ namespace ecs
 		return context;
 	}
 
+	internal::worker_pool& internal::GetWorkerPool()
+	{
+		return internal::GetContext().workers;
+	}
+
+	// component record of the hibernated entity data
+	struct HibernatedComponent
+	{
+		uint32_t componentTypeIndex;
+		uint32_t offset;
+	};
+
+	/////////////////////////////////////////////////////////////////////////////////
+	static void ReleaseHibernatedSlot(uint32_t slot)
+	{
+		internal::HibernatedEntity& hibernated = internal::GetContext().hibernatedEntities[slot];
+		assert(hibernated.data != nullptr || hibernated.rawSize == 0);
+
+		// compressed data contains only trivially copyable components (no need to call dtors)
+		if (!hibernated.isCompressed)
+		{
+			std::array<IComponentsStorage*, bitset::MaxBitCount::value>& storageDir = GetStorageDirectory();
+			const HibernatedComponent* table = (const HibernatedComponent*)hibernated.data;
+			for (uint32_t i = 0; i < hibernated.componentsCount; i++)
+			{
+				IComponentsStorage* storage = storageDir[table[i].componentTypeIndex];
+				storage->destroy_value_v(hibernated.data + table[i].offset);
+			}
+		}
+
+		memory::Free(hibernated.data);
+		hibernated.data = nullptr;
+		hibernated.rawSize = 0;
+		hibernated.storedSize = 0;
+		hibernated.alignment = 0;
+		hibernated.componentsCount = 0;
+		hibernated.isCompressed = 0;
+		hibernated.isUsed = 0;
+		hibernated.archetype = archetype_table::emptyArchetype;
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	void internal::DestroyHibernated(uint32_t index)
+	{
+		internal::EntityDesc& desc = internal::GetContext().entitiesDesc[index];
+		assert(desc.usedIndex & internal::EntityDesc::HibernatedFlag);
+
+		uint32_t slot = desc.usedIndex & ~internal::EntityDesc::HibernatedFlag;
+		ReleaseHibernatedSlot(slot);
+		internal::GetContext().freeHibernatedSlots.push_back(slot);
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	void internal::DestroyAllHibernated()
+	{
+		internal::HibernatedEntityStorage& hibernatedEntities = internal::GetContext().hibernatedEntities;
+		ecs::vector<uint32_t>& freeHibernatedSlots = internal::GetContext().freeHibernatedSlots;
+
+		uint32_t slotsCount = narrow_cast<uint32_t>(hibernatedEntities.size());
+		for (uint32_t slot = 0; slot < slotsCount; slot++)
+		{
+			if (hibernatedEntities[slot].isUsed)
+			{
+				ReleaseHibernatedSlot(slot);
+			}
+		}
+
+		hibernatedEntities.clear();
+		freeHibernatedSlots.clear();
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	void Hibernate(EntityId id, bool compress)
+	{
+		assert(!internal::GetContext().dispatcher.IsLocked() && "Can't hibernate entity during update");
+		assert(internal::GetContext().state == internal::ContextState::MUTABLE);
+		assert(IsValid(id) && "Invalid entity ID");
+		assert(!IsHibernated(id) && "Entity is already hibernated");
+
+		internal::Context& context = internal::GetContext();
+		ArchetypeId& archetype = context.entitiesArchetypes[id.u.index];
+		const bitset componentsMask = context.archetypes.mask(archetype);
+		std::array<IComponentsStorage*, bitset::MaxBitCount::value>& storageDir = GetStorageDirectory();
+
+		// calculate data layout
+		uint32_t componentsCount = 0;
+		bool isTriviallyCopyable = true;
+		for (auto it = componentsMask.begin(); it != componentsMask.end(); ++it)
+		{
+			// tag components have no storage (only the mask bit)
+			IComponentsStorage* storage = storageDir[*it];
+			if (storage)
+			{
+				componentsCount++;
+				isTriviallyCopyable &= storage->is_trivially_copyable_v();
+			}
+		}
+
+		size_t rawSize = componentsCount * sizeof(HibernatedComponent);
+		size_t blockAlign = 64;
+		for (auto it = componentsMask.begin(); it != componentsMask.end(); ++it)
+		{
+			IComponentsStorage* storage = storageDir[*it];
+			if (storage)
+			{
+				size_t alignOf = storage->component_align_v();
+				blockAlign = std::max(blockAlign, alignOf);
+				rawSize = (rawSize + (alignOf - 1)) & ~(alignOf - 1);
+				rawSize += storage->component_size_v();
+			}
+		}
+
+		// move components out of the storages
+		uint8_t* rawData = (rawSize > 0) ? (uint8_t*)memory::Alloc(rawSize, blockAlign) : nullptr;
+		HibernatedComponent* table = (HibernatedComponent*)rawData;
+		size_t offset = componentsCount * sizeof(HibernatedComponent);
+		uint32_t componentIndex = 0;
+		for (auto it = componentsMask.begin(); it != componentsMask.end(); ++it)
+		{
+			uint32_t componentTypeIndex = *it;
+			IComponentsStorage* storage = storageDir[componentTypeIndex];
+			if (storage)
+			{
+				size_t alignOf = storage->component_align_v();
+				offset = (offset + (alignOf - 1)) & ~(alignOf - 1);
+
+				table[componentIndex].componentTypeIndex = componentTypeIndex;
+				table[componentIndex].offset = narrow_cast<uint32_t>(offset);
+				storage->move_out_v(id, rawData + offset);
+
+				offset += storage->component_size_v();
+				componentIndex++;
+			}
+		}
+		assert(offset == rawSize);
+
+		internal::HibernatedEntity hibernated;
+		hibernated.archetype = archetype;
+		hibernated.data = rawData;
+		hibernated.rawSize = narrow_cast<uint32_t>(rawSize);
+		hibernated.storedSize = narrow_cast<uint32_t>(rawSize);
+		hibernated.alignment = narrow_cast<uint32_t>(blockAlign);
+		hibernated.componentsCount = componentsCount;
+		hibernated.isCompressed = 0;
+		hibernated.isUsed = 1;
+
+		// compress (it is safe to move trivially copyable components using memcpy)
+		if (compress && isTriviallyCopyable && rawSize > 0)
+		{
+			uint32_t bound = lz::CompressBound(hibernated.rawSize);
+			uint8_t* compressedData = (uint8_t*)memory::Alloc(bound, 16);
+			uint32_t compressedSize = lz::Compress(rawData, hibernated.rawSize, compressedData, bound);
+			if (compressedSize > 0 && compressedSize < hibernated.rawSize)
+			{
+				hibernated.data = (uint8_t*)memory::Alloc(compressedSize, 16);
+				std::memcpy(hibernated.data, compressedData, compressedSize);
+				hibernated.storedSize = compressedSize;
+				hibernated.isCompressed = 1;
+				memory::Free(rawData);
+			}
+			memory::Free(compressedData);
+		}
+
+		// store cold block
+		uint32_t slot;
+		if (context.freeHibernatedSlots.empty())
+		{
+			slot = narrow_cast<uint32_t>(context.hibernatedEntities.size());
+			context.hibernatedEntities.push_back(hibernated);
+		}
+		else
+		{
+			slot = context.freeHibernatedSlots.back();
+			context.freeHibernatedSlots.pop_back();
+			context.hibernatedEntities[slot] = hibernated;
+		}
+
+		// remove entity from the active list
+		internal::RemoveFromUsedList(id.u.index);
+		context.entitiesDesc[id.u.index].usedIndex = internal::EntityDesc::HibernatedFlag | slot;
+		archetype = archetype_table::emptyArchetype;
+
+		NotifyChanges(id);
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	void Wake(EntityId id)
+	{
+		assert(!internal::GetContext().dispatcher.IsLocked() && "Can't wake entity during update");
+		assert(internal::GetContext().state == internal::ContextState::MUTABLE);
+		assert(IsValid(id) && "Invalid entity ID");
+		assert(IsHibernated(id) && "Entity is not hibernated");
+
+		internal::Context& context = internal::GetContext();
+		uint32_t slot = context.entitiesDesc[id.u.index].usedIndex & ~internal::EntityDesc::HibernatedFlag;
+		internal::HibernatedEntity& hibernated = context.hibernatedEntities[slot];
+
+		uint8_t* rawData = hibernated.data;
+		if (hibernated.isCompressed)
+		{
+			rawData = (uint8_t*)memory::Alloc(hibernated.rawSize, hibernated.alignment);
+			bool isDecompressed = lz::Decompress(hibernated.data, hibernated.storedSize, rawData, hibernated.rawSize);
+			assert(isDecompressed && "Corrupted hibernated entity data");
+			(void)isDecompressed;
+		}
+
+		// move components back to the storages
+		std::array<IComponentsStorage*, bitset::MaxBitCount::value>& storageDir = GetStorageDirectory();
+		const HibernatedComponent* table = (const HibernatedComponent*)rawData;
+		for (uint32_t i = 0; i < hibernated.componentsCount; i++)
+		{
+			IComponentsStorage* storage = storageDir[table[i].componentTypeIndex];
+			void* pComponent = rawData + table[i].offset;
+			storage->push_back_v(id, pComponent, storage->component_size_v(), storage->component_align_v());
+			storage->destroy_value_v(pComponent);
+		}
+
+		context.entitiesArchetypes[id.u.index] = hibernated.archetype;
+
+		if (rawData != hibernated.data)
+		{
+			memory::Free(rawData);
+		}
+		memory::Free(hibernated.data);
+		hibernated.data = nullptr;
+		hibernated.isCompressed = 0;
+		hibernated.componentsCount = 0;
+		hibernated.isUsed = 0;
+		context.freeHibernatedSlots.push_back(slot);
+
+		// return entity to the active list
+		internal::AddToUsedList(id);
+
+		NotifyChanges(id);
+	}
+
 	/////////////////////////////////////////////////////////////////////////////////
 	void RegisterProcess(IProcessBase* pProcess)
 	{
@@ -122,6 +466,352 @@ namespace ecs
 		newProcessList.erase(std::remove(newProcessList.begin(), newProcessList.end(), pProcess), newProcessList.end());
 	}
 
+	/////////////////////////////////////////////////////////////////////////////////
+	bool OptimizeLayoutForCache(uint32_t maxMicroseconds)
+	{
+		assert(internal::GetContext().state == internal::ContextState::MUTABLE);
+
+		// number of entities to process between the timer checks
+		const uint32_t entitiesPerStep = 4096;
+
+		typedef std::chrono::steady_clock Clock;
+		Clock::time_point deadline = Clock::now() + std::chrono::microseconds(maxMicroseconds);
+
+		ecs::vector<IComponentsStorage*>& componentStorages = GetStorageLinearDirectory();
+		uint32_t storagesCount = narrow_cast<uint32_t>(componentStorages.size());
+		uint32_t& storageIndex = internal::GetContext().optimizeStorageIndex;
+
+		// continue from the storage we stopped at the previous call, visit every storage at most once
+		uint32_t optimizedStoragesCount = 0;
+		while (optimizedStoragesCount < storagesCount)
+		{
+			if (storageIndex >= storagesCount)
+			{
+				storageIndex = 0;
+			}
+
+			// already optimized storages cost nothing, skip them without reading the clock
+			IComponentsStorage* storage = componentStorages[storageIndex];
+			if (storage->fragmented_count_v() == 0)
+			{
+				storageIndex++;
+				optimizedStoragesCount++;
+				continue;
+			}
+
+			if (storage->optimize_step_v(entitiesPerStep))
+			{
+				storageIndex++;
+				optimizedStoragesCount++;
+			}
+
+			// check the budget after every step (a lot of small storages can each be finished in one step)
+			if (Clock::now() >= deadline)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	namespace internal
+	{
+		struct OptimizeLayoutTask
+		{
+			IComponentsStorage* storage;
+			uint32_t fragmentedCount;
+			bool isSplit;
+			ecs::vector<uint32_t> permutation;
+			ecs::vector<uint32_t> cycles;
+		};
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	void OptimizeLayoutForCacheParallel(uint32_t threadsCount)
+	{
+		assert(internal::GetContext().state == internal::ContextState::MUTABLE);
+
+		// storages with less fragmented components are optimized by a single worker
+		const uint32_t splitThreshold = 64 * 1024;
+
+		if (threadsCount == 0)
+		{
+			threadsCount = std::max(1u, std::thread::hardware_concurrency());
+		}
+
+		ecs::vector<IComponentsStorage*>& componentStorages = GetStorageLinearDirectory();
+
+		std::vector<internal::OptimizeLayoutTask> tasks;
+		for (auto it = componentStorages.begin(); it != componentStorages.end(); ++it)
+		{
+			IComponentsStorage* storage = *it;
+			uint32_t fragmentedCount = storage->fragmented_count_v();
+			if (fragmentedCount == 0)
+			{
+				continue;
+			}
+
+			tasks.emplace_back();
+			internal::OptimizeLayoutTask& task = tasks.back();
+			task.storage = storage;
+			task.fragmentedCount = fragmentedCount;
+			task.isSplit = false;
+		}
+
+		if (tasks.empty())
+		{
+			return;
+		}
+
+		// largest first
+		std::sort(tasks.begin(), tasks.end(), [](const internal::OptimizeLayoutTask& a, const internal::OptimizeLayoutTask& b)
+		{
+			return a.fragmentedCount > b.fragmentedCount;
+		});
+
+		// no need for more workers than storages (unless the largest storage is split)
+		if (tasks[0].fragmentedCount < splitThreshold)
+		{
+			threadsCount = std::min(threadsCount, narrow_cast<uint32_t>(tasks.size()));
+		}
+
+		// optimize small storages, build permutation cycles for the large storages
+		std::atomic<uint32_t> nextTask(0);
+		internal::ParallelFor(threadsCount, [&](uint32_t /*threadIndex*/)
+		{
+			for (uint32_t taskIndex = nextTask.fetch_add(1); taskIndex < tasks.size(); taskIndex = nextTask.fetch_add(1))
+			{
+				internal::OptimizeLayoutTask& task = tasks[taskIndex];
+				if (threadsCount > 1 && task.fragmentedCount >= splitThreshold)
+				{
+					task.isSplit = task.storage->build_optimize_permutation_v(task.permutation, task.cycles);
+				}
+
+				if (!task.isSplit)
+				{
+					task.storage->optimize_v();
+				}
+			}
+		});
+
+		// share the cycles of the large storages between all workers
+		std::vector<std::pair<uint32_t, uint32_t>> cycles;
+		for (uint32_t taskIndex = 0; taskIndex < tasks.size(); taskIndex++)
+		{
+			const internal::OptimizeLayoutTask& task = tasks[taskIndex];
+			for (uint32_t cycleIndex = 0; cycleIndex < task.cycles.size(); cycleIndex++)
+			{
+				cycles.emplace_back(taskIndex, task.cycles[cycleIndex]);
+			}
+		}
+
+		if (!cycles.empty())
+		{
+			// workers grab the cycles in chunks (most of the cycles are short)
+			uint32_t cyclesCount = narrow_cast<uint32_t>(cycles.size());
+			uint32_t chunkSize = std::max(1u, std::min(256u, cyclesCount / (threadsCount * 8)));
+
+			std::atomic<uint32_t> nextCycle(0);
+			internal::ParallelFor(threadsCount, [&](uint32_t /*threadIndex*/)
+			{
+				for (uint32_t first = nextCycle.fetch_add(chunkSize); first < cyclesCount; first = nextCycle.fetch_add(chunkSize))
+				{
+					uint32_t last = std::min(cyclesCount, first + chunkSize);
+					for (uint32_t i = first; i < last; i++)
+					{
+						internal::OptimizeLayoutTask& task = tasks[cycles[i].first];
+						task.storage->apply_permutation_cycle_v(task.permutation.data(), cycles[i].second);
+					}
+				}
+			});
+		}
+
+		for (auto it = tasks.begin(); it != tasks.end(); ++it)
+		{
+			if (it->isSplit)
+			{
+				it->storage->finish_optimize_permutation_v();
+			}
+		}
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	size_t Trim(const TrimPolicy& policy)
+	{
+		assert(internal::GetContext().state == internal::ContextState::MUTABLE);
+		internal::Context& context = internal::GetContext();
+
+		size_t bytesCount = 0;
+
+		// entity arrays (entity index space can't be shrunk, it is owned by IdGenerator)
+		bytesCount += trim_capacity(context.entitiesDesc, policy);
+		bytesCount += trim_capacity(context.entitiesArchetypes, policy);
+		bytesCount += trim_capacity(context.unorderedUsedEntitiesIds, policy);
+		bytesCount += trim_capacity(context.orderedUsedEntitiesIds, policy);
+		bytesCount += trim_capacity(context.changedEntitiesIds, policy);
+		bytesCount += trim_capacity(context.hibernatedEntities, policy);
+		bytesCount += trim_capacity(context.freeHibernatedSlots, policy);
+
+		// component storages
+		ecs::vector<IComponentsStorage*>& componentStorages = GetStorageLinearDirectory();
+		for (auto it = componentStorages.begin(); it != componentStorages.end(); ++it)
+		{
+			IComponentsStorage* storage = *it;
+			bytesCount += storage->trim_v(policy);
+		}
+
+		// processes
+		internal::ProcessList& processList = context.processList;
+		for (auto it = processList.begin(); it != processList.end(); ++it)
+		{
+			IProcessBase* pProcess = *it;
+			bytesCount += pProcess->Trim(policy);
+		}
+
+		return bytesCount;
+	}
+
+	namespace internal
+	{
+		// number of list entries to prefetch ahead (archetype ids and descriptors are accessed by the entity index)
+		static const uint32_t matchPrefetchDistance = 8;
+
+		// IsMatchAspect for 64 (or less) entities of the list, bit i of the result = entities[i] matches
+		//  isMatch - per-archetype results (see archetype_match_cache)
+		static inline uint64_t MatchAspectBlock(const ConstEntityId* entities, uint32_t count, uint32_t prefetchCount, const uint8_t* isMatch)
+		{
+			const internal::EntityStorage& entitiesDesc = internal::GetContext().entitiesDesc;
+			const internal::EntityArchetypeStorage& entitiesArchetypes = internal::GetContext().entitiesArchetypes;
+			uint32_t entitiesCount = narrow_cast<uint32_t>(entitiesDesc.size());
+
+			uint64_t bits = 0;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				if (i + matchPrefetchDistance < prefetchCount)
+				{
+					uint32_t prefetchIndex = entities[i + matchPrefetchDistance].u.index;
+					if (prefetchIndex < entitiesCount)
+					{
+						_mm_prefetch((const char*)&entitiesArchetypes[prefetchIndex], _MM_HINT_T0);
+						_mm_prefetch((const char*)&entitiesDesc[prefetchIndex], _MM_HINT_T0);
+					}
+				}
+
+				const ConstEntityId id = entities[i];
+				uint32_t index = id.u.index;
+				bool isEntityMatch = (index < entitiesCount) && (entitiesDesc[index].id.u.generation == id.u.generation) &&
+					((entitiesDesc[index].usedIndex & internal::EntityDesc::HibernatedFlag) == 0) && (isMatch[entitiesArchetypes[index]] != 0);
+				bits |= uint64_t(isEntityMatch) << i;
+			}
+			return bits;
+		}
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	uint32_t MatchAspect(const ConstEntityList& entities, const aspect_filter& filter, ConstEntityId* pResult)
+	{
+		// O(archetypes) mask tests, then one table lookup per entity
+		archetype_match_cache cache(filter);
+		cache.update(internal::GetContext().archetypes);
+
+		uint32_t count = narrow_cast<uint32_t>(entities.size());
+		const ConstEntityId* ids = entities.data();
+		uint32_t resultCount = 0;
+		for (uint32_t first = 0; first < count; first += 64)
+		{
+			uint32_t blockSize = std::min(count - first, 64u);
+			uint64_t bits = internal::MatchAspectBlock(ids + first, blockSize, count - first, cache.data());
+
+			// branchless compaction
+			for (uint32_t i = 0; i < blockSize; i++)
+			{
+				pResult[resultCount] = ids[first + i];
+				resultCount += uint32_t((bits >> i) & 1);
+			}
+		}
+		return resultCount;
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	void MatchAspect(const ConstEntityList& entities, const aspect_filter& filter, ecs::vector<uint64_t>& bitmap)
+	{
+		archetype_match_cache cache(filter);
+		cache.update(internal::GetContext().archetypes);
+
+		uint32_t count = narrow_cast<uint32_t>(entities.size());
+		const ConstEntityId* ids = entities.data();
+		bitmap.resize((count + 63) / 64);
+		for (uint32_t first = 0; first < count; first += 64)
+		{
+			uint32_t blockSize = std::min(count - first, 64u);
+			bitmap[first / 64] = internal::MatchAspectBlock(ids + first, blockSize, count - first, cache.data());
+		}
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	void MatchAspectAll(const aspect_filter& filter, ecs::vector<uint64_t>& bitmap)
+	{
+		const internal::EntityStorage& entitiesDesc = internal::GetContext().entitiesDesc;
+		const internal::EntityArchetypeStorage& entitiesArchetypes = internal::GetContext().entitiesArchetypes;
+
+		archetype_match_cache cache(filter);
+		cache.update(internal::GetContext().archetypes);
+		const uint8_t* isMatch = cache.data();
+
+		// sequential pass over the whole array (destroyed entities have invalidated descriptors, hibernated entities never match)
+		uint32_t count = narrow_cast<uint32_t>(entitiesArchetypes.size());
+		bitmap.resize((count + 63) / 64);
+		for (uint32_t first = 0; first < count; first += 64)
+		{
+			uint32_t blockSize = std::min(count - first, 64u);
+
+			uint64_t bits = 0;
+			for (uint32_t i = 0; i < blockSize; i++)
+			{
+				uint32_t index = first + i;
+				const internal::EntityDesc& desc = entitiesDesc[index];
+				bool isEntityMatch = desc.id.IsValid() && ((desc.usedIndex & internal::EntityDesc::HibernatedFlag) == 0) && (isMatch[entitiesArchetypes[index]] != 0);
+				bits |= uint64_t(isEntityMatch) << i;
+			}
+			bitmap[first / 64] = bits;
+		}
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	StorageStats GetComponentsStats(ecs::vector<StorageStats>* pStorages)
+	{
+		ecs::vector<IComponentsStorage*>& componentStorages = GetStorageLinearDirectory();
+		if (pStorages)
+		{
+			pStorages->resize(componentStorages.size());
+		}
+
+		StorageStats total;
+		for (size_t i = 0; i < componentStorages.size(); i++)
+		{
+			StorageStats stats;
+			componentStorages[i]->get_stats_v(stats);
+			total.accumulate(stats);
+			if (pStorages)
+			{
+				(*pStorages)[i] = stats;
+			}
+		}
+		return total;
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	void ResetComponentsStats()
+	{
+		ecs::vector<IComponentsStorage*>& componentStorages = GetStorageLinearDirectory();
+		for (auto it = componentStorages.begin(); it != componentStorages.end(); ++it)
+		{
+			IComponentsStorage* storage = *it;
+			storage->reset_stats_v();
+		}
+	}
+
 	/////////////////////////////////////////////////////////////////////////////////
 	void Update(float deltaTime)
 	{
@@ -181,6 +871,17 @@ namespace ecs
 		assert(internal::GetContext().state == internal::ContextState::UPDATE);
 		internal::GetContext().state = internal::ContextState::MUTABLE;
 		dispatcher.unlock();
+
+		// flip double-buffered components
+		ecs::vector<IComponentsStorage*>& componentStorages = GetStorageLinearDirectory();
+		for (auto it = componentStorages.begin(); it != componentStorages.end(); ++it)
+		{
+			IComponentsStorage* storage = *it;
+			storage->flip_v();
+		}
+
+		// next frame
+		GlobalFrameIndex()++;
 	}
 
 
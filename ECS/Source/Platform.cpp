@@ -0,0 +1,125 @@
+// The MIT License (MIT)
+//
+// 	Copyright (c) 2017 Sergey Makeev
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy
+// 	of this software and associated documentation files (the "Software"), to deal
+// 	in the Software without restriction, including without limitation the rights
+// 	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// 	copies of the Software, and to permit persons to whom the Software is
+// 	furnished to do so, subject to the following conditions:
+//
+//      The above copyright notice and this permission notice shall be included in
+// 	all copies or substantial portions of the Software.
+//
+// 	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// 	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// 	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// 	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// 	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// 	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// 	THE SOFTWARE.
+#include <stdint.h>
+#include <Platform.h>
+
+#if !defined(_MSC_VER)
+#include <cpuid.h>
+#endif
+
+
+namespace ecs
+{
+	namespace internal
+	{
+		/////////////////////////////////////////////////////////////////////////////////
+		static void CpuId(uint32_t info[4], uint32_t leaf, uint32_t subleaf)
+		{
+#if defined(_MSC_VER)
+			__cpuidex((int*)info, (int)leaf, (int)subleaf);
+#else
+			__cpuid_count(leaf, subleaf, info[0], info[1], info[2], info[3]);
+#endif
+		}
+
+		/////////////////////////////////////////////////////////////////////////////////
+		// register state enabled by the OS (XCR0)
+		static uint64_t GetEnabledRegisterState()
+		{
+#if defined(_MSC_VER)
+			return _xgetbv(0);
+#else
+			uint32_t eax, edx;
+			__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+			return ((uint64_t)edx << 32) | eax;
+#endif
+		}
+
+		/////////////////////////////////////////////////////////////////////////////////
+		static SimdLevel::Type DetectSimdLevel()
+		{
+			uint32_t info[4];
+			CpuId(info, 0, 0);
+			if (info[0] < 7)
+			{
+				return SimdLevel::SSE2;
+			}
+
+			// AVX + OSXSAVE
+			CpuId(info, 1, 0);
+			const uint32_t osxsaveBit = (1 << 27);
+			const uint32_t avxBit = (1 << 28);
+			if ((info[2] & (osxsaveBit | avxBit)) != (osxsaveBit | avxBit))
+			{
+				return SimdLevel::SSE2;
+			}
+
+			// XMM + YMM state
+			uint64_t registerState = GetEnabledRegisterState();
+			if ((registerState & 0x06) != 0x06)
+			{
+				return SimdLevel::SSE2;
+			}
+
+			CpuId(info, 7, 0);
+			const uint32_t avx2Bit = (1 << 5);
+			const uint32_t avx512fBit = (1 << 16);
+
+			// XMM + YMM + opmask + ZMM state
+			if (ECS_AVX512_KERNELS && (info[1] & avx512fBit) && (registerState & 0xE6) == 0xE6)
+			{
+				return SimdLevel::AVX512;
+			}
+
+			if (info[1] & avx2Bit)
+			{
+				return SimdLevel::AVX2;
+			}
+
+			return SimdLevel::SSE2;
+		}
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	SimdLevel::Type GetSimdLevel()
+	{
+		static const SimdLevel::Type level = internal::DetectSimdLevel();
+		return level;
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	const char* GetSimdLevelName(SimdLevel::Type level)
+	{
+		switch (level)
+		{
+		case SimdLevel::SSE2:
+			return "SSE2";
+		case SimdLevel::AVX2:
+			return "AVX2";
+		case SimdLevel::AVX512:
+			return "AVX-512";
+		default:
+			return "Unknown";
+		}
+	}
+
+}
@@ -0,0 +1,398 @@
+// The MIT License (MIT)
+//
+// 	Copyright (c) 2017 Sergey Makeev
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy
+// 	of this software and associated documentation files (the "Software"), to deal
+// 	in the Software without restriction, including without limitation the rights
+// 	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// 	copies of the Software, and to permit persons to whom the Software is
+// 	furnished to do so, subject to the following conditions:
+//
+//      The above copyright notice and this permission notice shall be included in
+// 	all copies or substantial portions of the Software.
+//
+// 	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// 	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// 	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// 	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// 	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// 	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// 	THE SOFTWARE.
+
+#include <stdint.h>
+#include <assert.h>
+#include <cstring>
+#include <array>
+#include <Entity.h>
+#include <RuntimeComponent.h>
+
+
+namespace ecs
+{
+
+	/////////////////////////////////////////////////////////////////////////////////
+	RuntimeComponentsStorage::RuntimeComponentsStorage(uint32_t _componentTypeIndex, const ComponentTypeDesc& _desc)
+		: desc(_desc)
+		, componentTypeIndex(_componentTypeIndex)
+		, dataBuffer(nullptr)
+		, count(0)
+		, capacityCount(0)
+		, frameIndex(&ecs::GlobalFrameIndex())
+		, sortedComponentsCount(0)
+		, isCustomOrder(false)
+		, pushCount(0)
+		, eraseCount(0)
+	{
+		assert(desc.size > 0 && "Runtime component can't be empty");
+		assert(desc.align > 0 && (desc.align & (desc.align - 1)) == 0 && "Alignment must be a power of two");
+
+		stride = (desc.size + (desc.align - 1)) & ~(desc.align - 1);
+		swapBuffer = (uint8_t*)memory::Alloc(stride, desc.align < 16 ? 16 : desc.align);
+
+		// register storage
+		std::array<IComponentsStorage*, ecs::bitset::MaxBitCount::value>& storageDir = ecs::GetStorageDirectory();
+		storageDir[componentTypeIndex] = this;
+
+		ecs::vector<IComponentsStorage*>& linearStorageDir = ecs::GetStorageLinearDirectory();
+		linearStorageDir.push_back(this);
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	RuntimeComponentsStorage::~RuntimeComponentsStorage()
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			destroy(at(i));
+		}
+		count = 0;
+
+		memory::Free(dataBuffer);
+		dataBuffer = nullptr;
+
+		memory::Free(swapBuffer);
+		swapBuffer = nullptr;
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	void RuntimeComponentsStorage::grow(uint32_t newCapacity)
+	{
+		assert(newCapacity >= count);
+
+		uint8_t* pNewData = nullptr;
+		if (newCapacity > 0)
+		{
+			pNewData = (uint8_t*)memory::Alloc(size_t(newCapacity) * stride, desc.align < 16 ? 16 : desc.align);
+		}
+
+		if (desc.moveFunc == nullptr)
+		{
+			if (count > 0)
+			{
+				std::memcpy(pNewData, dataBuffer, size_t(count) * stride);
+			}
+		}
+		else
+		{
+			for (uint32_t i = 0; i < count; i++)
+			{
+				relocate(pNewData + size_t(i) * stride, at(i));
+			}
+		}
+
+		memory::Free(dataBuffer);
+		dataBuffer = pNewData;
+		capacityCount = newCapacity;
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	void RuntimeComponentsStorage::swap_components(uint32_t indexA, uint32_t indexB)
+	{
+		uint8_t* a = at(indexA);
+		uint8_t* b = at(indexB);
+		relocate(swapBuffer, a);
+		relocate(a, b);
+		relocate(b, swapBuffer);
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	void RuntimeComponentsStorage::on_push_back(const EntityId id, uint32_t componentIndex)
+	{
+		isCustomOrder = false;
+
+		if (sortedComponentsCount > 0 && backIndex[sortedComponentsCount - 1].u.index > id.u.index)
+		{
+			// the new component belongs inside the sorted range, shrink the sorted range up to this position
+			auto it = std::lower_bound(backIndex.begin(), backIndex.begin() + sortedComponentsCount, id, [](const EntityId& a, const EntityId& b)
+			{
+				return a.u.index < b.u.index;
+			});
+			sortedComponentsCount = narrow_cast<uint32_t>(it - backIndex.begin());
+		}
+		else if (sortedComponentsCount == componentIndex)
+		{
+			// adding to the end of sorted storage
+			sortedComponentsCount++;
+		}
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	void RuntimeComponentsStorage::push_back(const EntityId id, void* pValue)
+	{
+		if (count == capacityCount)
+		{
+			grow(capacityCount < 16 ? 16 : capacityCount * 2);
+		}
+
+		uint32_t componentIndex = count;
+		on_push_back(id, componentIndex);
+
+		move_construct(at(componentIndex), pValue);
+		count++;
+
+		backIndex.push_back(id);
+		versions.push_back(*frameIndex);
+		forwardIndex.set(id.u.index, componentIndex);
+		pushCount++;
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	void RuntimeComponentsStorage::erase(const EntityId id)
+	{
+		int32_t componentIndex = forwardIndex.get(id.u.index);
+		if (componentIndex < 0)
+		{
+			return;
+		}
+
+		uint32_t index = componentIndex;
+		assert(index < count);
+
+		uint32_t lastIndex = count - 1;
+		eraseCount++;
+
+		// update fragmented range
+		isCustomOrder = false;
+		if (index < sortedComponentsCount)
+		{
+			sortedComponentsCount = index;
+		}
+
+		// Remove an element without preserving order of components.
+		// If the element is not the last element transfer the last element into its position
+		destroy(at(index));
+		if (index != lastIndex)
+		{
+			relocate(at(index), at(lastIndex));
+			backIndex[index] = backIndex[lastIndex];
+			versions[index] = versions[lastIndex];
+
+			// update forward index for moved component
+			EntityId movedEntityId = backIndex[index];
+			forwardIndex.set(movedEntityId.u.index, index);
+		}
+
+		count--;
+		backIndex.pop_back();
+		versions.pop_back();
+		forwardIndex.reset(id.u.index);
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	StorageStats RuntimeComponentsStorage::stats() const
+	{
+		StorageStats r;
+		r.componentTypeIndex = componentTypeIndex;
+		r.componentSize = narrow_cast<uint32_t>(desc.size);
+		r.count = count;
+		r.capacity = capacityCount;
+		r.unsortedTailCount = fragmented_count_v();
+		r.misplacedCount = isCustomOrder ? 0 : internal::CountMisplacedComponents(backIndex, sortedComponentsCount);
+		r.dataBytes = (size_t(capacityCount) + 1) * stride;
+		r.forwardIndexBytes = forwardIndex.memory_footprint();
+		r.backIndexBytes = memory_footprint(backIndex);
+		r.versionsBytes = memory_footprint(versions);
+		r.pushCount = pushCount;
+		r.eraseCount = eraseCount;
+		return r;
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	bool RuntimeComponentsStorage::optimize(uint32_t maxEntitiesCount)
+	{
+		uint32_t componentsCount = count;
+		uint32_t tgtComponentIndex = sortedComponentsCount;
+
+		// nothing to do
+		if (tgtComponentIndex == componentsCount || isCustomOrder)
+		{
+			return true;
+		}
+
+		// components of all entities before this one are already in place
+		uint32_t tgtEntityIndex = (tgtComponentIndex > 0) ? (backIndex[tgtComponentIndex - 1].u.index + 1) : 0;
+
+		uint32_t budget = maxEntitiesCount;
+		while (tgtComponentIndex < componentsCount && budget > 0)
+		{
+			uint32_t pageIndex = (tgtEntityIndex >> sparse_index::pageSizeLog2);
+			uint32_t pageEnd = ((pageIndex + 1) << sparse_index::pageSizeLog2);
+
+			// There are no components for the whole range of entities, skip the page
+			if (forwardIndex.is_empty_page(pageIndex))
+			{
+				tgtEntityIndex = pageEnd;
+				continue;
+			}
+
+			uint32_t maxEntityIndex = pageEnd;
+			if (budget < (pageEnd - tgtEntityIndex))
+			{
+				maxEntityIndex = tgtEntityIndex + budget;
+			}
+			budget -= (maxEntityIndex - tgtEntityIndex);
+
+			for (; tgtEntityIndex < maxEntityIndex; tgtEntityIndex++)
+			{
+				int32_t srcComponentIndex = forwardIndex.get(tgtEntityIndex);
+				if (srcComponentIndex < 0)
+				{
+					continue;
+				}
+
+				assert(backIndex[srcComponentIndex].u.index == tgtEntityIndex);
+				assert((uint32_t)srcComponentIndex >= tgtComponentIndex);
+
+				uint32_t srcEntityIndex = backIndex[tgtComponentIndex].u.index;
+				if (tgtEntityIndex == srcEntityIndex)
+				{
+					tgtComponentIndex++;
+					continue;
+				}
+
+				swap_components(srcComponentIndex, tgtComponentIndex);
+
+				forwardIndex.set(srcEntityIndex, srcComponentIndex);
+				forwardIndex.set(tgtEntityIndex, tgtComponentIndex);
+				std::swap(backIndex[tgtComponentIndex], backIndex[srcComponentIndex]);
+				std::swap(versions[tgtComponentIndex], versions[srcComponentIndex]);
+
+				tgtComponentIndex++;
+			}
+		}
+
+		sortedComponentsCount = tgtComponentIndex;
+		return (sortedComponentsCount == componentsCount);
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	void RuntimeComponentsStorage::optimize(const EntityId* order, uint32_t orderCount)
+	{
+		uint32_t tgtComponentIndex = 0;
+		for (uint32_t i = 0; i < orderCount; i++)
+		{
+			uint32_t tgtEntityIndex = order[i].u.index;
+
+			int32_t srcComponentIndex = forwardIndex.get(tgtEntityIndex);
+			if (srcComponentIndex < 0)
+			{
+				continue;
+			}
+
+			assert(backIndex[srcComponentIndex].u.index == tgtEntityIndex);
+			assert((uint32_t)srcComponentIndex >= tgtComponentIndex && "Duplicate entity in the list");
+
+			if ((uint32_t)srcComponentIndex != tgtComponentIndex)
+			{
+				uint32_t srcEntityIndex = backIndex[tgtComponentIndex].u.index;
+
+				swap_components(srcComponentIndex, tgtComponentIndex);
+
+				forwardIndex.set(srcEntityIndex, srcComponentIndex);
+				forwardIndex.set(tgtEntityIndex, tgtComponentIndex);
+				std::swap(backIndex[tgtComponentIndex], backIndex[srcComponentIndex]);
+				std::swap(versions[tgtComponentIndex], versions[srcComponentIndex]);
+			}
+
+			tgtComponentIndex++;
+		}
+
+		sortedComponentsCount = 0;
+		isCustomOrder = true;
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	size_t RuntimeComponentsStorage::trim(const TrimPolicy& policy)
+	{
+		uint32_t indexCount = 0;
+		for (auto it = backIndex.begin(); it != backIndex.end(); ++it)
+		{
+			indexCount = std::max(indexCount, (uint32_t)it->u.index + 1);
+		}
+
+		size_t bytesCount = forwardIndex.trim(indexCount);
+
+		size_t newCapacity = policy.shrink_capacity(count, capacityCount);
+		if (newCapacity != capacityCount)
+		{
+			bytesCount += size_t(capacityCount - newCapacity) * stride;
+			grow(narrow_cast<uint32_t>(newCapacity));
+		}
+
+		bytesCount += trim_capacity(backIndex, policy);
+		bytesCount += trim_capacity(versions, policy);
+		return bytesCount;
+	}
+
+
+
+	namespace internal
+	{
+		// owner of the runtime storages
+		struct RuntimeStorageRegistry
+		{
+			std::array<RuntimeComponentsStorage*, ecs::bitset::MaxBitCount::value> storages;
+
+			RuntimeStorageRegistry()
+			{
+				storages.fill(nullptr);
+			}
+
+			~RuntimeStorageRegistry()
+			{
+				for (auto it = storages.begin(); it != storages.end(); ++it)
+				{
+					delete *it;
+					*it = nullptr;
+				}
+			}
+		};
+
+		static RuntimeStorageRegistry& GetRuntimeStorageRegistry()
+		{
+			static RuntimeStorageRegistry registry;
+			return registry;
+		}
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	uint32_t RegisterComponentType(const ComponentTypeDesc& desc)
+	{
+		uint32_t componentTypeIndex = ecs::GlobalIdCounter()++;
+		assert(componentTypeIndex < ecs::bitset::MaxBitCount::value);
+
+		internal::RuntimeStorageRegistry& registry = internal::GetRuntimeStorageRegistry();
+		registry.storages[componentTypeIndex] = new RuntimeComponentsStorage(componentTypeIndex, desc);
+		return componentTypeIndex;
+	}
+
+	/////////////////////////////////////////////////////////////////////////////////
+	RuntimeComponentsStorage& GetRuntimeComponentStorage(uint32_t componentTypeIndex)
+	{
+		assert(componentTypeIndex < ecs::bitset::MaxBitCount::value);
+		RuntimeComponentsStorage* storage = internal::GetRuntimeStorageRegistry().storages[componentTypeIndex];
+		assert(storage != nullptr && "Not a runtime component type");
+		return *storage;
+	}
+
+}
@@ -0,0 +1,142 @@
+// The MIT License (MIT)
+//
+// 	Copyright (c) 2017 Sergey Makeev
+//
+// 	Permission is hereby granted, free of charge, to any person obtaining a copy
+// 	of this software and associated documentation files (the "Software"), to deal
+// 	in the Software without restriction, including without limitation the rights
+// 	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// 	copies of the Software, and to permit persons to whom the Software is
+// 	furnished to do so, subject to the following conditions:
+//
+//      The above copyright notice and this permission notice shall be included in
+// 	all copies or substantial portions of the Software.
+//
+// 	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// 	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// 	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// 	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// 	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// 	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// 	THE SOFTWARE.
+#include <stdint.h>
+#include <assert.h>
+#include <Utils.h>
+
+
+namespace ecs
+{
+	namespace internal
+	{
+		/////////////////////////////////////////////////////////////////////////////////
+		worker_pool::worker_pool()
+			: jobFunc(nullptr)
+			, jobData(nullptr)
+			, jobThreadsCount(0)
+			, jobGeneration(0)
+			, pendingCount(0)
+			, isBusy(false)
+			, isExiting(false)
+		{
+		}
+
+		/////////////////////////////////////////////////////////////////////////////////
+		worker_pool::~worker_pool()
+		{
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				isExiting = true;
+			}
+			jobStarted.notify_all();
+
+			for (auto it = threads.begin(); it != threads.end(); ++it)
+			{
+				it->join();
+			}
+		}
+
+		/////////////////////////////////////////////////////////////////////////////////
+		// generation - the last job generation seen by the thread
+		void worker_pool::worker_thread(uint32_t threadIndex, uint32_t generation)
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			for (;;)
+			{
+				jobStarted.wait(guard, [&]() { return isExiting || jobGeneration != generation; });
+				if (isExiting)
+				{
+					return;
+				}
+
+				generation = jobGeneration;
+
+				// the job needs less threads
+				if (threadIndex >= jobThreadsCount)
+				{
+					continue;
+				}
+
+				JobFunc func = jobFunc;
+				void* userData = jobData;
+
+				guard.unlock();
+				func(userData, threadIndex);
+				guard.lock();
+
+				assert(pendingCount > 0);
+				pendingCount--;
+				if (pendingCount == 0)
+				{
+					jobFinished.notify_one();
+				}
+			}
+		}
+
+		/////////////////////////////////////////////////////////////////////////////////
+		void worker_pool::run(uint32_t threadsCount, JobFunc func, void* userData)
+		{
+			if (threadsCount <= 1)
+			{
+				func(userData, 0);
+				return;
+			}
+
+			{
+				std::unique_lock<std::mutex> guard(lock);
+
+				// called from the job or from the other thread, workers are busy
+				if (isBusy)
+				{
+					guard.unlock();
+					for (uint32_t threadIndex = 0; threadIndex < threadsCount; threadIndex++)
+					{
+						func(userData, threadIndex);
+					}
+					return;
+				}
+
+				isBusy = true;
+				while (threads.size() < threadsCount - 1)
+				{
+					uint32_t threadIndex = narrow_cast<uint32_t>(threads.size()) + 1;
+					threads.emplace_back(&worker_pool::worker_thread, this, threadIndex, jobGeneration);
+				}
+
+				jobFunc = func;
+				jobData = userData;
+				jobThreadsCount = threadsCount;
+				pendingCount = threadsCount - 1;
+				jobGeneration++;
+			}
+			jobStarted.notify_all();
+
+			func(userData, 0);
+
+			std::unique_lock<std::mutex> guard(lock);
+			jobFinished.wait(guard, [&]() { return pendingCount == 0; });
+			jobFunc = nullptr;
+			jobData = nullptr;
+			isBusy = false;
+		}
+	}
+}
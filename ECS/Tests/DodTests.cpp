@@ -22,7 +22,10 @@
 
 #include <UnitTest++.h>
 #include <ECS.h>
+#include <Compression.h>
 #include <algorithm>
+#include <memory>
+#include <atomic>
 #include "TestComponents.h"
 
 
@@ -97,6 +100,1093 @@ TEST(BasicSortStorage)
 	CHECK(ecs::GetComponentStorage<DummyComponent>().empty());
 }
 
+TEST(SparseIndex)
+{
+	ecs::sparse_index index;
+
+	CHECK(index.get(0) == -1);
+	CHECK(index.get(1000000) == -1);
+	CHECK(index.memory_footprint() == 0);
+
+	index.set(3, 13);
+	index.set(1000000, 7);
+
+	CHECK(index.get(3) == 13);
+	CHECK(index.get(1000000) == 7);
+	CHECK(index.get(4) == -1);
+	CHECK(index.get(999999) == -1);
+	CHECK(index.get(5000) == -1);
+
+	// only two pages must be allocated, other pages are shared
+	uint32_t pagesCount = index.pages_count();
+	uint32_t allocatedPagesCount = 0;
+	for (uint32_t pageIndex = 0; pageIndex < pagesCount; pageIndex++)
+	{
+		if (!index.is_empty_page(pageIndex))
+		{
+			allocatedPagesCount++;
+		}
+	}
+	CHECK(allocatedPagesCount == 2);
+
+	index.reset(3);
+	index.reset(500000);
+	CHECK(index.get(3) == -1);
+	CHECK(index.get(500000) == -1);
+	CHECK(index.get(1000000) == 7);
+
+	index.clear();
+	CHECK(index.get(1000000) == -1);
+	CHECK(index.memory_footprint() == 0);
+}
+
+TEST(SparseIndexMemoryFootprint)
+{
+	const uint32_t entitiesCount = 1000000;
+	const uint32_t componentTypesCount = 200;
+	const uint32_t componentsPerType = 512;
+
+	// each component type is used by a small group of entities and by the one entity with the highest index
+	std::vector<std::unique_ptr<ecs::sparse_index>> indices;
+	for (uint32_t typeIndex = 0; typeIndex < componentTypesCount; typeIndex++)
+	{
+		std::unique_ptr<ecs::sparse_index> index(new ecs::sparse_index());
+
+		uint32_t firstEntityIndex = (uint32_t)(rand() % (entitiesCount - componentsPerType));
+		for (uint32_t i = 0; i < componentsPerType; i++)
+		{
+			index->set(firstEntityIndex + i, i);
+		}
+		index->set(entitiesCount - 1, componentsPerType);
+
+		CHECK(index->get(firstEntityIndex) == 0);
+		CHECK(index->get(entitiesCount - 1) == (int32_t)componentsPerType);
+		indices.push_back(std::move(index));
+	}
+
+	// flat forward index: 4 bytes * max entity index for each component type
+	size_t flatBytes = size_t(componentTypesCount) * entitiesCount * sizeof(int32_t);
+
+	size_t pagedBytes = 0;
+	for (auto it = indices.begin(); it != indices.end(); ++it)
+	{
+		pagedBytes += (*it)->memory_footprint();
+	}
+
+	printf("Forward index memory footprint (%d entities, %d component types): flat %d Kb, paged %d Kb\n",
+		entitiesCount, componentTypesCount, (int)(flatBytes / 1024), (int)(pagedBytes / 1024));
+
+	CHECK(pagedBytes * 10 < flatBytes);
+}
+
+TEST(StructureOfArraysStorage)
+{
+	ecs::DestroyAll();
+
+	std::vector<EntityId> ids;
+	for (int i = 0; i < 100; i++)
+	{
+		ids.push_back(ecs::CreateEntity());
+	}
+
+	// add components in reverse order
+	for (auto it = ids.rbegin(); it != ids.rend(); ++it)
+	{
+		float v = (float)it->u.index;
+		ecs::AddComponent(*it, PosSoA(v, -v));
+	}
+
+	// remove every third component
+	for (size_t i = 0; i < ids.size(); i += 3)
+	{
+		ecs::RemoveComponent<PosSoA>(ids[i]);
+	}
+
+	ecs::ComponentsStorage<PosSoA>& storage = ecs::GetComponentStorage<PosSoA>();
+	CHECK(storage.size() == 66);
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		ecs::field_span<float> x = storage.field<0>();
+		ecs::field_span<float> y = storage.field<1>();
+		CHECK(x.size == storage.size());
+		CHECK(y.size == storage.size());
+
+		for (size_t i = 0; i < ids.size(); i++)
+		{
+			int32_t componentIndex = storage.index_of(ids[i]);
+			if ((i % 3) == 0)
+			{
+				CHECK(componentIndex < 0);
+				continue;
+			}
+
+			CHECK(componentIndex >= 0);
+			float v = (float)ids[i].u.index;
+			CHECK_CLOSE(x[componentIndex], v, 0.0001f);
+			CHECK_CLOSE(y[componentIndex], -v, 0.0001f);
+		}
+
+		ecs::OptimizeLayoutForCache();
+	}
+
+	// after optimization components are ordered by entity index
+	ecs::field_span<float> x = storage.field<0>();
+	for (uint32_t i = 1; i < x.size; i++)
+	{
+		CHECK(x[i - 1] < x[i]);
+	}
+
+	ecs::DestroyAll();
+	CHECK(storage.empty());
+}
+
+TEST(ChunkedStorage)
+{
+	ecs::DestroyAll();
+
+	ecs::ComponentsStorage<ParticleChunked>& storage = ecs::GetComponentStorage<ParticleChunked>();
+
+	std::vector<EntityId> ids;
+	const int count = 10000;
+	for (int i = 0; i < count; i++)
+	{
+		ids.push_back(ecs::CreateEntity());
+	}
+
+	ecs::AddComponent(ids[0], ParticleChunked(0.0f));
+	ParticleChunked* pFirst = ecs::GetComponent<ParticleChunked>(ids[0]);
+
+	// growth must not move existing components
+	for (int i = count - 1; i > 0; i--)
+	{
+		ecs::AddComponent(ids[i], ParticleChunked(float(i)));
+		CHECK(ecs::GetComponent<ParticleChunked>(ids[0]) == pFirst);
+	}
+	CHECK(storage.size() == (uint32_t)count);
+
+	for (int i = 1; i < count; i += 2)
+	{
+		ecs::RemoveComponent<ParticleChunked>(ids[i]);
+	}
+
+	ecs::OptimizeLayoutForCache();
+	CHECK(storage.is_optimized());
+
+	const ParticleChunked* pPrev = nullptr;
+	for (int i = 0; i < count; i += 2)
+	{
+		const ParticleChunked* pComp = ecs::GetComponent<ParticleChunked>(ids[i]);
+		CHECK(pComp != nullptr);
+		CHECK_CLOSE(pComp->x, float(i), 0.0001f);
+		CHECK_CLOSE(pComp->w, float(i), 0.0001f);
+
+		// components are linear inside the block
+		if (pPrev && ((i / 2) % ecs::chunked_vector<ParticleChunked, 4096>::blockSize) != 0)
+		{
+			CHECK(pPrev + 1 == pComp);
+		}
+		pPrev = pComp;
+	}
+
+	ecs::DestroyAll();
+	CHECK(storage.empty());
+}
+
+TEST(ReservedStorage)
+{
+	ecs::DestroyAll();
+
+	ecs::ComponentsStorage<ParticleReserved>& storage = ecs::GetComponentStorage<ParticleReserved>();
+
+	std::vector<EntityId> ids;
+	const int count = 100000;
+	for (int i = 0; i < count; i++)
+	{
+		ids.push_back(ecs::CreateEntity());
+	}
+
+	ecs::AddComponent(ids[0], ParticleReserved(0.0f));
+	ParticleReserved* pFirst = ecs::GetComponent<ParticleReserved>(ids[0]);
+
+	// growth must not move existing components
+	for (int i = 1; i < count; i++)
+	{
+		ecs::AddComponent(ids[i], ParticleReserved(float(i)));
+		CHECK(ecs::GetComponent<ParticleReserved>(ids[0]) == pFirst);
+	}
+	CHECK(storage.size() == (uint32_t)count);
+	CHECK(storage.capacity() >= (uint32_t)count);
+
+	// components are linear in memory
+	for (int i = 0; i < count; i++)
+	{
+		const ParticleReserved* pComp = ecs::GetComponent<ParticleReserved>(ids[i]);
+		CHECK(pComp == pFirst + i);
+		CHECK_CLOSE(pComp->z, float(i), 0.0001f);
+	}
+
+	// DestroyAll returns the memory to the OS, but the address range stays reserved
+	ecs::DestroyAll();
+	CHECK(storage.empty());
+	CHECK(storage.capacity() == 0);
+
+	EntityId id = ecs::CreateEntity(ParticleReserved(1.0f));
+	CHECK(ecs::GetComponent<ParticleReserved>(id) == pFirst);
+	CHECK_CLOSE(ecs::GetComponent<ParticleReserved>(id)->x, 1.0f, 0.0001f);
+
+	ecs::DestroyAll();
+}
+
+TEST(ReservedVectorGrowth)
+{
+	const uint32_t maxCount = 100000;
+	ecs::reserved_vector<uint64_t, maxCount> v;
+
+	// geometric growth past MAX_COUNT / 2 is clamped
+	for (uint32_t i = 0; i < maxCount; i += 16)
+	{
+		ecs::reserve_additional(v, 16);
+		CHECK(v.capacity() >= v.size() + 16 && v.capacity() <= maxCount);
+		for (uint32_t j = 0; j < 16; j++)
+		{
+			v.push_back(uint64_t(i + j));
+		}
+	}
+
+	CHECK(v.size() == maxCount);
+	CHECK(v.capacity() == maxCount);
+	CHECK(v[maxCount - 1] == maxCount - 1);
+}
+
+// entities created in small batches after the entity storage capacity passes 2^19 (ECS_RESERVED_ENTITY_STORAGE = 1 grows up to 2^20)
+TEST(CreateEntitiesGrowth)
+{
+	ecs::DestroyAll();
+
+	const uint32_t count = 600000;
+	std::vector<EntityId> ids(count);
+	ecs::CreateEntities(ids.data(), count);
+
+	EntityId batch[16];
+	for (uint32_t i = 0; i < 1000; i++)
+	{
+		ecs::CreateEntities(batch, 16);
+	}
+	CHECK(ecs::IsValid(batch[15]));
+	CHECK(ecs::GetActiveList().size() == count + 16000);
+
+	ecs::DestroyAll();
+}
+
+template<typename T>
+double MeasureWorstAddComponentTime(const std::vector<EntityId>& ids, double& totalTime)
+{
+	double worstTime = 0.0;
+	totalTime = 0.0;
+	UnitTest::Timer timer;
+	for (size_t i = 0; i < ids.size(); i++)
+	{
+		timer.Start();
+		ecs::AddComponent(ids[i], T(float(i)));
+		double t = timer.GetTimeInMs();
+		worstTime = std::max(worstTime, t);
+		totalTime += t;
+	}
+	return worstTime;
+}
+
+TEST(ChunkedStorageGrowthLatency)
+{
+	ecs::DestroyAll();
+
+	std::vector<EntityId> ids;
+	const int count = 500000;
+	for (int i = 0; i < count; i++)
+	{
+		ids.push_back(ecs::CreateEntity());
+	}
+
+	double vectorTotalTime = 0.0;
+	double vectorWorstTime = MeasureWorstAddComponentTime<Particle>(ids, vectorTotalTime);
+
+	double chunkedTotalTime = 0.0;
+	double chunkedWorstTime = MeasureWorstAddComponentTime<ParticleChunked>(ids, chunkedTotalTime);
+
+	printf("AddComponent x %d: vector storage worst %3.3f ms (total %3.2f ms), chunked storage worst %3.3f ms (total %3.2f ms)\n",
+		count, vectorWorstTime, vectorTotalTime, chunkedWorstTime, chunkedTotalTime);
+
+	CHECK(ecs::GetComponentStorage<Particle>().size() == (uint32_t)count);
+	CHECK(ecs::GetComponentStorage<ParticleChunked>().size() == (uint32_t)count);
+
+	ecs::DestroyAll();
+}
+
+TEST(BatchComponents)
+{
+	ecs::DestroyAll();
+
+	const uint32_t count = 100000;
+
+	// per entity
+	UnitTest::Timer timer;
+	timer.Start();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		ecs::CreateEntity(Pos(float(i), 0.0f), Velocity(0.0f, float(i)), DummyComponent2(int(i)));
+	}
+	double singleTime = timer.GetTimeInMs();
+
+	ecs::DestroyAll();
+
+	// batch
+	std::vector<EntityId> ids(count);
+	std::vector<Pos> positions;
+	std::vector<Velocity> velocities;
+	std::vector<DummyComponent2> values;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		positions.push_back(Pos(float(i), 0.0f));
+		velocities.push_back(Velocity(0.0f, float(i)));
+		values.push_back(DummyComponent2(int(i)));
+	}
+
+	timer.Start();
+	ecs::CreateEntities(ids.data(), count);
+	ecs::AddComponentBatch(ids.data(), positions.data(), count);
+	ecs::AddComponentBatch(ids.data(), velocities.data(), count);
+	ecs::AddComponentBatch(ids.data(), values.data(), count);
+	double batchTime = timer.GetTimeInMs();
+
+	printf("Create %d entities with 3 components: one by one %3.2f ms, batch %3.2f ms\n", count, singleTime, batchTime);
+
+	CHECK(ecs::GetComponentStorage<Pos>().is_optimized());
+	for (uint32_t i = 0; i < count; i++)
+	{
+		CHECK(ecs::IsValid(ids[i]));
+		const Pos* pos = ecs::GetComponent<Pos>(ids[i]);
+		const Velocity* vel = ecs::GetComponent<Velocity>(ids[i]);
+		const DummyComponent2* val = ecs::GetComponent<DummyComponent2>(ids[i]);
+		CHECK(pos != nullptr && vel != nullptr && val != nullptr);
+		CHECK_CLOSE(pos->x, float(i), 0.0001f);
+		CHECK_CLOSE(vel->y, float(i), 0.0001f);
+		CHECK(val->v == int(i));
+	}
+
+	// remove every other velocity
+	std::vector<EntityId> removeIds;
+	for (uint32_t i = 0; i < count; i += 2)
+	{
+		removeIds.push_back(ids[i]);
+	}
+	ecs::RemoveComponentBatch<Velocity>(removeIds.data(), (uint32_t)removeIds.size());
+
+	CHECK(ecs::GetComponentStorage<Velocity>().size() == count / 2);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const Velocity* vel = ecs::GetComponent<Velocity>(ids[i]);
+		CHECK((vel == nullptr) == ((i % 2) == 0));
+	}
+
+	ecs::DestroyAll();
+}
+
+TEST(SharedComponents)
+{
+	ecs::DestroyAll();
+
+	ecs::ComponentsStorage<Material>& storage = ecs::GetComponentStorage<Material>();
+
+	std::vector<EntityId> ids;
+	const uint32_t count = 1000;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		ids.push_back(ecs::CreateEntity(Material(i % 4), Pos(float(i), 0.0f)));
+	}
+
+	CHECK(storage.size() == count);
+	CHECK(storage.unique_count() == 4);
+
+	// read-only access returns the shared instance
+	const Material* pShared = ecs::GetComponent<const Material>(ids[0]);
+	CHECK(pShared == ecs::GetComponent<const Material>(ids[4]));
+	CHECK(pShared != ecs::GetComponent<const Material>(ids[1]));
+
+	typedef ecs::Aspect<const Material, Pos> TAspect;
+	for (TAspect view : ecs::CreateEnumerator<TAspect>(ecs::GetActiveList()))
+	{
+		CHECK(view.c0->id == uint32_t(view.c1->x) % 4);
+	}
+	CHECK(storage.unique_count() == 4);
+
+	// copy on write
+	Material* pMaterial = ecs::GetComponent<Material>(ids[0]);
+	CHECK(pMaterial != pShared);
+	pMaterial->params[0] = -1.0f;
+	CHECK(storage.unique_count() == 5);
+	CHECK(ecs::GetComponent<const Material>(ids[0]) == pMaterial);
+	CHECK(ecs::GetComponent<const Material>(ids[4]) == pShared);
+	CHECK_CLOSE(pShared->params[0], 0.0f, 0.0001f);
+
+	// equal value is shared
+	EntityId id = ecs::CreateEntity(Material(1));
+	CHECK(ecs::GetComponent<const Material>(id) == ecs::GetComponent<const Material>(ids[1]));
+	CHECK(storage.unique_count() == 5);
+
+	ecs::OptimizeLayoutForCache();
+	CHECK(ecs::GetComponent<const Material>(ids[4]) == pShared);
+
+	for (uint32_t i = 0; i < count; i += 2)
+	{
+		ecs::RemoveComponent<Material>(ids[i]);
+	}
+	CHECK(storage.unique_count() == 2);
+
+	ecs::DestroyAll();
+	CHECK(storage.empty());
+	CHECK(storage.unique_count() == 0);
+}
+
+TEST(SharedComponentsReintern)
+{
+	ecs::DestroyAll();
+
+	ecs::ComponentsStorage<Material>& storage = ecs::GetComponentStorage<Material>();
+
+	std::vector<EntityId> ids;
+	const uint32_t count = 1000;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		ids.push_back(ecs::CreateEntity(Material(i % 4), Pos(float(i), 0.0f)));
+	}
+	CHECK(storage.unique_count() == 4);
+
+	// non-const aspect (read only usage) makes the private copies
+	typedef ecs::Aspect<Material, Pos> TAspect;
+	for (TAspect view : ecs::CreateEnumerator<TAspect>(ecs::GetActiveList()))
+	{
+		CHECK(view.c0->id == uint32_t(view.c1->x) % 4);
+	}
+	CHECK(storage.unique_count() > 4);
+
+	// unchanged copies are merged back
+	CHECK(ecs::Trim() > 0);
+	CHECK(storage.unique_count() == 4);
+	CHECK(ecs::GetComponent<const Material>(ids[0]) == ecs::GetComponent<const Material>(ids[4]));
+
+	// modified copy stays unique, the same value added later is shared with it
+	Material* pMaterial = ecs::GetComponent<Material>(ids[1]);
+	pMaterial->id = 100;
+	ecs::Trim();
+	CHECK(storage.unique_count() == 5);
+
+	*ecs::GetComponent<Material>(ids[2]) = *ecs::GetComponent<const Material>(ids[1]);
+	ecs::Trim();
+	CHECK(storage.unique_count() == 5);
+	CHECK(ecs::GetComponent<const Material>(ids[2]) == ecs::GetComponent<const Material>(ids[1]));
+	CHECK(ecs::GetComponent<const Material>(ids[6]) != ecs::GetComponent<const Material>(ids[2]));
+
+	ecs::DestroyAll();
+	CHECK(storage.unique_count() == 0);
+}
+
+template<typename T>
+void MeasureStorageMoves(const std::vector<EntityId>& ids, double& optimizeTime, double& eraseTime)
+{
+	// add in the reverse order (fragmented storage)
+	for (size_t i = ids.size(); i > 0; i--)
+	{
+		ecs::AddComponent(ids[i - 1], T(float(i - 1)));
+	}
+
+	ecs::ComponentsStorage<T>& storage = ecs::GetComponentStorage<T>();
+
+	UnitTest::Timer timer;
+	timer.Start();
+	storage.optimize();
+	optimizeTime = timer.GetTimeInMs();
+
+	timer.Start();
+	for (size_t i = 0; i < ids.size(); i += 2)
+	{
+		ecs::RemoveComponent<T>(ids[i]);
+	}
+	eraseTime = timer.GetTimeInMs();
+}
+
+TEST(ParallelForWorkerPool)
+{
+	const uint32_t threadsCount = 4;
+	const uint32_t itemsCount = 10000;
+
+	std::vector<uint32_t> items(itemsCount, 0);
+	for (uint32_t pass = 0; pass < 100; pass++)
+	{
+		// the number of threads varies between the calls (workers are reused)
+		uint32_t passThreadsCount = 2 + (pass % (threadsCount - 1));
+		uint32_t itemsPerThread = (itemsCount + passThreadsCount - 1) / passThreadsCount;
+		ecs::internal::ParallelFor(passThreadsCount, [&](uint32_t threadIndex)
+		{
+			uint32_t first = std::min(itemsCount, threadIndex * itemsPerThread);
+			uint32_t last = std::min(itemsCount, first + itemsPerThread);
+			for (uint32_t i = first; i < last; i++)
+			{
+				items[i]++;
+			}
+		});
+	}
+
+	for (uint32_t i = 0; i < itemsCount; i++)
+	{
+		CHECK(items[i] == 100);
+	}
+
+	// nested call is executed by the calling worker
+	std::atomic<uint32_t> counter(0);
+	ecs::internal::ParallelFor(threadsCount, [&](uint32_t /*threadIndex*/)
+	{
+		ecs::internal::ParallelFor(threadsCount, [&](uint32_t /*threadIndex*/)
+		{
+			counter++;
+		});
+	});
+	CHECK(counter == threadsCount * threadsCount);
+}
+
+TEST(ParallelOptimizeLayout)
+{
+	ecs::DestroyAll();
+
+	const uint32_t count = 200000;
+	std::vector<EntityId> ids(count);
+	ecs::CreateEntities(ids.data(), count);
+
+	// large fragmented storages (split between workers) + small storages
+	for (uint32_t i = count; i > 0; i--)
+	{
+		uint32_t index = i - 1;
+		ecs::AddComponent(ids[index], Particle(float(index)));
+		ecs::AddComponent(ids[index], ParticleChunked(float(index)));
+		if ((index % 16) == 0)
+		{
+			ecs::AddComponent(ids[index], Pos(float(index), 0.0f));
+		}
+		if ((index % 32) == 0)
+		{
+			ecs::AddComponent(ids[index], DummyComponent2(int(index)));
+		}
+	}
+
+	UnitTest::Timer timer;
+	timer.Start();
+	ecs::OptimizeLayoutForCacheParallel(4);
+	double parallelTime = timer.GetTimeInMs();
+	printf("Parallel OptimizeLayoutForCache (4 threads): %3.2f ms\n", parallelTime);
+
+	CHECK(ecs::GetComponentStorage<Particle>().is_optimized());
+	CHECK(ecs::GetComponentStorage<ParticleChunked>().is_optimized());
+	CHECK(ecs::GetComponentStorage<Pos>().is_optimized());
+	CHECK(ecs::GetComponentStorage<DummyComponent2>().is_optimized());
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		CHECK(ecs::GetComponentStorage<Particle>().index_of(ids[i]) == (int32_t)i);
+		CHECK(ecs::GetComponentStorage<ParticleChunked>().index_of(ids[i]) == (int32_t)i);
+		CHECK_CLOSE(ecs::GetComponent<const Particle>(ids[i])->x, float(i), 0.0001f);
+		CHECK_CLOSE(ecs::GetComponent<const ParticleChunked>(ids[i])->w, float(i), 0.0001f);
+		if ((i % 16) == 0)
+		{
+			CHECK(ecs::GetComponentStorage<Pos>().index_of(ids[i]) == (int32_t)(i / 16));
+			CHECK_CLOSE(ecs::GetComponent<const Pos>(ids[i])->x, float(i), 0.0001f);
+		}
+	}
+
+	ecs::DestroyAll();
+}
+
+TEST(SortByKey)
+{
+	ecs::DestroyAll();
+
+	const uint32_t count = 100000;
+	std::vector<EntityId> ids(count);
+	ecs::CreateEntities(ids.data(), count);
+
+	// pseudo random keys with a lot of duplicates
+	uint32_t seed = 12345;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		ecs::AddComponent(ids[i], Particle(float((seed >> 8) % 5000)));
+	}
+
+	ecs::ComponentsStorage<Particle>& storage = ecs::GetComponentStorage<Particle>();
+	auto depthKey = [](const Particle& p) -> uint32_t
+	{
+		return uint32_t(p.x);
+	};
+
+	UnitTest::Timer timer;
+	timer.Start();
+	storage.sort_by(depthKey);
+	double sortTime = timer.GetTimeInMs();
+	CHECK(storage.is_optimized());
+
+	// storage order -> entity
+	std::vector<uint32_t> order(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		int32_t index = storage.index_of(ids[i]);
+		CHECK(index >= 0 && index < (int32_t)count);
+		order[index] = i;
+	}
+
+	// sorted by key, equal keys keep the order of entities (stable sort)
+	for (uint32_t i = 1; i < count; i++)
+	{
+		float prevKey = ecs::GetComponent<const Particle>(ids[order[i - 1]])->x;
+		float key = ecs::GetComponent<const Particle>(ids[order[i]])->x;
+		CHECK(prevKey <= key);
+		if (prevKey == key)
+		{
+			CHECK(order[i - 1] < order[i]);
+		}
+	}
+
+	// parallel version must produce the same layout (64 bit keys)
+	auto wideKey = [](const Particle& p) -> uint64_t
+	{
+		return (uint64_t(p.x) << 32) | 0xFFFFFFFF;
+	};
+
+	timer.Start();
+	storage.sort_by(wideKey, 4);
+	double parallelSortTime = timer.GetTimeInMs();
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		CHECK(storage.index_of(ids[order[i]]) == (int32_t)i);
+	}
+
+	printf("Sort %d components by key: %3.2f ms, parallel (64-bit key) %3.2f ms\n", count, sortTime, parallelSortTime);
+
+	ecs::DestroyAll();
+}
+
+TEST(RelocatableStorageMoves)
+{
+	ecs::DestroyAll();
+
+	static_assert(ecs::is_trivially_relocatable<Block64>::value, "Trivially copyable type must be relocatable");
+	static_assert(!ecs::is_trivially_relocatable<Block64Movable>::value, "Type with user-defined move must not be relocatable");
+	static_assert(ecs::is_trivially_relocatable<OwnedValue>::value, "Opt-in relocatable type");
+	static_assert(sizeof(Block64) == 64 && sizeof(Block64Movable) == 64, "Invalid benchmark component size");
+
+	const uint32_t count = 200000;
+	std::vector<EntityId> ids(count);
+	ecs::CreateEntities(ids.data(), count);
+
+	double relocatableOptimizeTime = 0.0;
+	double relocatableEraseTime = 0.0;
+	MeasureStorageMoves<Block64>(ids, relocatableOptimizeTime, relocatableEraseTime);
+
+	double movableOptimizeTime = 0.0;
+	double movableEraseTime = 0.0;
+	MeasureStorageMoves<Block64Movable>(ids, movableOptimizeTime, movableEraseTime);
+
+	printf("64 byte component x %d: relocatable optimize %3.2f ms, erase %3.2f ms; movable optimize %3.2f ms, erase %3.2f ms\n",
+		count, relocatableOptimizeTime, relocatableEraseTime, movableOptimizeTime, movableEraseTime);
+
+	for (uint32_t i = 1; i < count; i += 2)
+	{
+		CHECK_CLOSE(ecs::GetComponent<Block64>(ids[i])->values[15], float(i), 0.0001f);
+		CHECK_CLOSE(ecs::GetComponent<Block64Movable>(ids[i])->values[15], float(i), 0.0001f);
+	}
+
+	// opt-in relocatable type with ownership (bitwise moves must not leak or double free)
+	for (uint32_t i = count; i > 0; i--)
+	{
+		ecs::AddComponent(ids[i - 1], OwnedValue(i - 1));
+	}
+	for (uint32_t i = 0; i < count; i += 3)
+	{
+		ecs::RemoveComponent<OwnedValue>(ids[i]);
+	}
+	ecs::OptimizeLayoutForCache();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const OwnedValue* v = ecs::GetComponent<OwnedValue>(ids[i]);
+		if ((i % 3) == 0)
+		{
+			CHECK(v == nullptr);
+		}
+		else
+		{
+			CHECK(v != nullptr && *v->value == i);
+		}
+	}
+
+	ecs::DestroyAll();
+}
+
+template<typename T>
+void FragmentStorage(const std::vector<EntityId>& ids)
+{
+	// add in the shuffled order
+	std::vector<uint32_t> order(ids.size());
+	for (uint32_t i = 0; i < (uint32_t)order.size(); i++)
+	{
+		order[i] = i;
+	}
+	uint32_t seed = 4242;
+	for (uint32_t i = (uint32_t)order.size() - 1; i > 0; i--)
+	{
+		seed = seed * 1664525 + 1013904223;
+		std::swap(order[i], order[(seed >> 8) % (i + 1)]);
+	}
+
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		ecs::AddComponent(ids[order[i]], T(float(order[i])));
+	}
+}
+
+template<typename T>
+void MeasureOptimizePermutation(const std::vector<EntityId>& ids, const char* name)
+{
+	ecs::ComponentsStorage<T>& storage = ecs::GetComponentStorage<T>();
+
+	// incremental version (swaps)
+	FragmentStorage<T>(ids);
+	UnitTest::Timer timer;
+	timer.Start();
+	storage.optimize(UINT32_MAX);
+	double swapTime = timer.GetTimeInMs();
+
+	for (size_t i = 0; i < ids.size(); i++)
+	{
+		ecs::RemoveComponent<T>(ids[i]);
+	}
+
+	// full version (cycles of the permutation, swaps for small trivially copyable components)
+	FragmentStorage<T>(ids);
+	timer.Start();
+	storage.optimize();
+	double cycleTime = timer.GetTimeInMs();
+	CHECK(storage.is_optimized());
+
+	for (uint32_t i = 0; i < (uint32_t)ids.size(); i++)
+	{
+		CHECK(storage.index_of(ids[i]) == (int32_t)i);
+		CHECK_CLOSE(ecs::GetComponent<const T>(ids[i])->values[0], float(i), 0.0001f);
+	}
+
+	printf("Optimize fragmented %s x %d: swaps %3.2f ms, optimize() %3.2f ms (%s)\n", name, (int)ids.size(), swapTime, cycleTime,
+		ecs::internal::optimize_by_cycles<T>::value ? "cycles" : "swaps");
+
+	for (size_t i = 0; i < ids.size(); i++)
+	{
+		ecs::RemoveComponent<T>(ids[i]);
+	}
+}
+
+TEST(OptimizePermutationCycles)
+{
+	ecs::DestroyAll();
+
+	const uint32_t count = 200000;
+	std::vector<EntityId> ids(count);
+	ecs::CreateEntities(ids.data(), count);
+
+	MeasureOptimizePermutation<Block16>(ids, "16 byte component");
+	MeasureOptimizePermutation<Block64>(ids, "64 byte component");
+	MeasureOptimizePermutation<Block64Movable>(ids, "64 byte component (movable)");
+	MeasureOptimizePermutation<Block256>(ids, "256 byte component");
+
+	ecs::DestroyAll();
+}
+
+TEST(ComponentsAlignment)
+{
+	ecs::DestroyAll();
+
+	static_assert(sizeof(Vec3) == 12 && sizeof(Segment) == 24 && sizeof(IsolatedCounter) == 64, "Invalid test component size");
+	static_assert(ecs::component_alignment<Vec3>::value == 16, "Default alignment");
+	static_assert(ecs::component_alignment<IsolatedCounter>::value == 64, "Alignment override");
+
+	const uint32_t count = 1000;
+	std::vector<EntityId> ids(count);
+	ecs::CreateEntities(ids.data(), count);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		ecs::AddComponent(ids[i], Vec3(float(i)));
+		ecs::AddComponent(ids[i], Segment(float(i)));
+		ecs::AddComponent(ids[i], IsolatedCounter(i));
+	}
+
+	// densely packed (stride = sizeof(T))
+	const Vec3* pFirstVec = ecs::GetComponent<const Vec3>(ids[0]);
+	const Segment* pFirstSegment = ecs::GetComponent<const Segment>(ids[0]);
+	CHECK(((uintptr_t)pFirstVec % 16) == 0);
+	CHECK(((uintptr_t)pFirstSegment % 16) == 0);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		CHECK(ecs::GetComponent<const Vec3>(ids[i]) == pFirstVec + i);
+		CHECK(ecs::GetComponent<const Segment>(ids[i]) == pFirstSegment + i);
+		CHECK_CLOSE(ecs::GetComponent<const Vec3>(ids[i])->z, float(i), 0.0001f);
+		CHECK_CLOSE(ecs::GetComponent<const Segment>(ids[i])->b.y, -float(i), 0.0001f);
+	}
+
+	// every component at its own cache line (also after the storage reallocation and layout optimization)
+	for (uint32_t i = 0; i < count; i += 2)
+	{
+		ecs::RemoveComponent<IsolatedCounter>(ids[i]);
+	}
+	ecs::OptimizeLayoutForCache();
+	ecs::Trim();
+	for (uint32_t i = 1; i < count; i += 2)
+	{
+		const IsolatedCounter* counter = ecs::GetComponent<const IsolatedCounter>(ids[i]);
+		CHECK(((uintptr_t)counter % 64) == 0);
+		CHECK(counter->value == i);
+	}
+
+	ecs::DestroyAll();
+}
+
+TEST(StorageStats)
+{
+	ecs::DestroyAll();
+	ecs::ResetComponentsStats();
+
+	const uint32_t count = 10000;
+	std::vector<EntityId> ids(count);
+	ecs::CreateEntities(ids.data(), count);
+
+	// fragmented storage (reverse order)
+	for (uint32_t i = count; i > 0; i--)
+	{
+		ecs::AddComponent(ids[i - 1], Vec3(float(i - 1)));
+	}
+
+	ecs::ComponentsStorage<Vec3>& storage = ecs::GetComponentStorage<Vec3>();
+	ecs::StorageStats stats = storage.stats();
+	CHECK(stats.componentTypeIndex == ecs::GetComponentTypeIndex<Vec3>());
+	CHECK(stats.componentSize == sizeof(Vec3));
+	CHECK(stats.count == count);
+	CHECK(stats.capacity >= count);
+	CHECK(stats.dataBytes == size_t(stats.capacity) * sizeof(Vec3));
+	CHECK(stats.forwardIndexBytes >= count * sizeof(int32_t));
+	CHECK(stats.backIndexBytes >= count * sizeof(EntityId));
+	CHECK(stats.versionsBytes >= count * sizeof(uint32_t));
+	CHECK(stats.pushCount == count);
+	CHECK(stats.eraseCount == 0);
+	CHECK(stats.fragmentation() > 0.99f);
+	CHECK(stats.misplacedCount == count - 1);
+
+	for (uint32_t i = 0; i < count; i += 4)
+	{
+		ecs::RemoveComponent<Vec3>(ids[i]);
+	}
+	ecs::OptimizeLayoutForCache();
+
+	stats = storage.stats();
+	CHECK(stats.count == count - count / 4);
+	CHECK(stats.eraseCount == count / 4);
+	CHECK(stats.misplacedCount == 0);
+	CHECK(stats.unsortedTailCount == 0);
+	CHECK(stats.fragmentation() == 0.0f);
+	CHECK(stats.occupancy() > 0.0f && stats.occupancy() <= 1.0f);
+
+	// single component of the low entity index at the end: long unsorted tail, but only one misplaced component
+	ecs::AddComponent(ids[0], Vec3(0.0f));
+	stats = storage.stats();
+	CHECK(stats.unsortedTailCount == stats.count);
+	CHECK(stats.misplacedCount == 1);
+	CHECK(stats.fragmentation() < 0.001f);
+	ecs::RemoveComponent<Vec3>(ids[0]);
+	stats = storage.stats();
+
+	// world totals = sum over all the storages
+	ecs::vector<ecs::StorageStats> storagesStats;
+	ecs::StorageStats total = ecs::GetComponentsStats(&storagesStats);
+	CHECK(storagesStats.size() == ecs::GetStorageLinearDirectory().size());
+
+	ecs::StorageStats sum;
+	bool isFound = false;
+	for (auto it = storagesStats.begin(); it != storagesStats.end(); ++it)
+	{
+		sum.accumulate(*it);
+		if (it->componentTypeIndex == stats.componentTypeIndex)
+		{
+			CHECK(it->count == stats.count && it->total_bytes() == stats.total_bytes());
+			isFound = true;
+		}
+	}
+	CHECK(isFound);
+	CHECK(total.count == sum.count);
+	CHECK(total.total_bytes() == sum.total_bytes());
+	CHECK(total.pushCount >= count);
+
+	ecs::ResetComponentsStats();
+	CHECK(storage.stats().pushCount == 0 && storage.stats().eraseCount == 0);
+	CHECK(ecs::GetComponentsStats().pushCount == 0);
+
+	ecs::DestroyAll();
+}
+
+// component layout "loaded from data"
+struct RuntimeValue
+{
+	static int aliveCount;
+
+	std::unique_ptr<uint32_t> value;
+
+	RuntimeValue(uint32_t v)
+		: value(new uint32_t(v))
+	{
+		aliveCount++;
+	}
+
+	RuntimeValue(RuntimeValue&& other)
+		: value(std::move(other.value))
+	{
+		aliveCount++;
+	}
+
+	~RuntimeValue()
+	{
+		aliveCount--;
+	}
+
+	static void Move(void* pDst, void* pSrc)
+	{
+		new (pDst) RuntimeValue(std::move(*(RuntimeValue*)pSrc));
+	}
+
+	static void Destroy(void* p)
+	{
+		((RuntimeValue*)p)->~RuntimeValue();
+	}
+};
+
+int RuntimeValue::aliveCount = 0;
+
+TEST(RuntimeComponents)
+{
+	ecs::DestroyAll();
+
+	ecs::ComponentTypeDesc posDesc = { "RuntimePos", sizeof(float) * 3, alignof(float), nullptr, nullptr };
+	uint32_t posType = ecs::RegisterComponentType(posDesc);
+
+	ecs::ComponentTypeDesc valueDesc = { "RuntimeValue", sizeof(RuntimeValue), alignof(RuntimeValue), &RuntimeValue::Move, &RuntimeValue::Destroy };
+	uint32_t valueType = ecs::RegisterComponentType(valueDesc);
+
+	ecs::RuntimeComponentsStorage& posStorage = ecs::GetRuntimeComponentStorage(posType);
+	ecs::RuntimeComponentsStorage& valueStorage = ecs::GetRuntimeComponentStorage(valueType);
+
+	const uint32_t count = 1000;
+	std::vector<EntityId> ids(count);
+	ecs::CreateEntities(ids.data(), count);
+
+	// add in the reverse order (fragmented storage)
+	for (uint32_t i = count; i > 0; i--)
+	{
+		uint32_t index = i - 1;
+		float pos[3] = { float(index), 1.0f, 2.0f };
+		ecs::AddRuntimeComponent(ids[index], posType, pos);
+
+		RuntimeValue value(index);
+		ecs::AddRuntimeComponent(ids[index], valueType, &value);
+	}
+	CHECK(RuntimeValue::aliveCount == (int)count);
+	CHECK(posStorage.size() == count);
+	CHECK(!posStorage.is_optimized());
+
+	// remove odd
+	for (uint32_t i = 1; i < count; i += 2)
+	{
+		ecs::RemoveRuntimeComponent(ids[i], valueType);
+		CHECK(ecs::GetRuntimeComponent(ids[i], valueType) == nullptr);
+	}
+	CHECK(RuntimeValue::aliveCount == (int)(count / 2));
+
+	ecs::OptimizeLayoutForCache();
+	CHECK(posStorage.is_optimized());
+	CHECK(valueStorage.is_optimized());
+
+	// iterate as a byte span (components are stored in the order of entities)
+	ecs::component_span posSpan = posStorage.span();
+	CHECK(posSpan.size == count);
+	CHECK(posSpan.stride == sizeof(float) * 3);
+	for (uint32_t i = 0; i < posSpan.size; i++)
+	{
+		const float* pos = (const float*)posSpan[i];
+		CHECK_CLOSE(pos[0], float(i), 0.0001f);
+		CHECK_CLOSE(pos[2], 2.0f, 0.0001f);
+	}
+
+	ecs::component_span valueSpan = valueStorage.span();
+	CHECK(valueSpan.size == count / 2);
+	for (uint32_t i = 0; i < valueSpan.size; i++)
+	{
+		const RuntimeValue* value = (const RuntimeValue*)valueSpan[i];
+		CHECK(*value->value == i * 2);
+		CHECK(value == ecs::GetRuntimeComponent(ids[i * 2], valueType));
+	}
+
+	// runtime components can be hibernated as well
+	ecs::Hibernate(ids[10]);
+	CHECK(valueStorage.size() == count / 2 - 1);
+	CHECK(RuntimeValue::aliveCount == (int)(count / 2));
+	ecs::Wake(ids[10]);
+	CHECK(valueStorage.size() == count / 2);
+	CHECK(RuntimeValue::aliveCount == (int)(count / 2));
+	CHECK(*((const RuntimeValue*)ecs::GetRuntimeComponent(ids[10], valueType))->value == 10);
+
+	ecs::DestroyAll();
+	CHECK(RuntimeValue::aliveCount == 0);
+	CHECK(posStorage.empty());
+	CHECK(valueStorage.empty());
+}
+
+TEST(LzCompression)
+{
+	std::vector<uint8_t> src;
+	uint32_t seed = 1;
+	for (int i = 0; i < 100000; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		// mix of repetitive and random data
+		src.push_back((i % 1000) < 700 ? uint8_t(i % 13) : uint8_t(seed >> 24));
+	}
+
+	uint32_t srcSize = (uint32_t)src.size();
+	std::vector<uint8_t> compressed(ecs::lz::CompressBound(srcSize));
+	uint32_t compressedSize = ecs::lz::Compress(src.data(), srcSize, compressed.data(), (uint32_t)compressed.size());
+	CHECK(compressedSize > 0);
+	CHECK(compressedSize < srcSize / 2);
+
+	std::vector<uint8_t> decompressed(srcSize);
+	CHECK(ecs::lz::Decompress(compressed.data(), compressedSize, decompressed.data(), srcSize));
+	CHECK(decompressed == src);
+
+	// incompressible data
+	for (uint32_t i = 0; i < srcSize; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		src[i] = uint8_t(seed >> 24);
+	}
+	compressedSize = ecs::lz::Compress(src.data(), srcSize, compressed.data(), (uint32_t)compressed.size());
+	CHECK(compressedSize > 0);
+	CHECK(ecs::lz::Decompress(compressed.data(), compressedSize, decompressed.data(), srcSize));
+	CHECK(decompressed == src);
+
+	// corrupted data
+	CHECK(!ecs::lz::Decompress(compressed.data(), compressedSize / 2, decompressed.data(), srcSize));
+}
+
 TEST(CacheFriendly)
 {
 	ecs::DestroyAll();
@@ -217,6 +1307,114 @@ TEST(CacheFriendly)
 
 }
 
+TEST(IncrementalOptimizeLayoutBudget)
+{
+	ecs::DestroyAll();
+
+	// several small fragmented storages, each one is optimized in a single step
+	std::vector<EntityId> ids;
+	const int count = 100;
+	for (int i = 0; i < count; i++)
+	{
+		ids.push_back(ecs::CreateEntity());
+	}
+	for (int i = count - 1; i >= 0; i--)
+	{
+		ecs::AddComponent(ids[i], Block16(float(i)));
+		ecs::AddComponent(ids[i], Block64(float(i)));
+		ecs::AddComponent(ids[i], Block256(float(i)));
+		ecs::AddComponent(ids[i], Vec3(float(i)));
+	}
+
+	// zero budget: the time is checked after every step, not only after the unfinished ones
+	CHECK(!ecs::OptimizeLayoutForCache(0));
+	uint32_t fragmentedStorages = 0;
+	fragmentedStorages += ecs::GetComponentStorage<Block16>().is_optimized() ? 0 : 1;
+	fragmentedStorages += ecs::GetComponentStorage<Block64>().is_optimized() ? 0 : 1;
+	fragmentedStorages += ecs::GetComponentStorage<Block256>().is_optimized() ? 0 : 1;
+	fragmentedStorages += ecs::GetComponentStorage<Vec3>().is_optimized() ? 0 : 1;
+	CHECK(fragmentedStorages == 3);
+
+	int iterationsCount = 1;
+	while (!ecs::OptimizeLayoutForCache(0))
+	{
+		iterationsCount++;
+	}
+	CHECK(iterationsCount >= 4);
+	CHECK(ecs::GetComponentStorage<Block16>().is_optimized());
+	CHECK(ecs::GetComponentStorage<Vec3>().is_optimized());
+
+	ecs::DestroyAll();
+}
+
+TEST(IncrementalOptimizeLayout)
+{
+	ecs::DestroyAll();
+
+	ecs::ComponentsStorage<DummyComponent>& storage = ecs::GetComponentStorage<DummyComponent>();
+
+	std::vector<EntityId> ids;
+	const int count = 20000;
+	for (int i = 0; i < count; i++)
+	{
+		ids.push_back(ecs::CreateEntity());
+	}
+
+	// components added in the order of entities, nothing to optimize
+	for (int i = 0; i < count; i++)
+	{
+		ecs::AddComponent(ids[i], DummyComponent(float(i), -float(i)));
+	}
+	CHECK(storage.is_optimized());
+
+	// fragment the storage
+	for (int i = 0; i < count; i += 3)
+	{
+		ecs::RemoveComponent<DummyComponent>(ids[i]);
+	}
+	for (int i = count - 1; i >= 0; i--)
+	{
+		if (ecs::GetComponent<DummyComponent>(ids[i]) == nullptr)
+		{
+			ecs::AddComponent(ids[i], DummyComponent(float(i), -float(i)));
+		}
+	}
+	CHECK(!storage.is_optimized());
+
+	// time-sliced optimization, storage is modified between the calls
+	int iterationsCount = 0;
+	int mutationIndex = 0;
+	while (!ecs::OptimizeLayoutForCache(0))
+	{
+		if (mutationIndex < count)
+		{
+			ecs::RemoveComponent<DummyComponent>(ids[mutationIndex]);
+			ecs::AddComponent(ids[mutationIndex], DummyComponent(float(mutationIndex), -float(mutationIndex)));
+			mutationIndex += 997;
+		}
+		iterationsCount++;
+	}
+	CHECK(iterationsCount > 1);
+	CHECK(storage.is_optimized());
+
+	// second call is a no-op
+	CHECK(ecs::OptimizeLayoutForCache(0));
+
+	const DummyComponent* pPrev = nullptr;
+	for (int i = 0; i < count; i++)
+	{
+		const DummyComponent* pComp = ecs::GetComponent<DummyComponent>(ids[i]);
+		CHECK(pComp != nullptr);
+		CHECK_CLOSE(pComp->x, float(i), 0.0001f);
+		CHECK_CLOSE(pComp->y, -float(i), 0.0001f);
+		CHECK(pPrev < pComp);
+		pPrev = pComp;
+	}
+
+	ecs::DestroyAll();
+	CHECK(storage.empty());
+}
+
 
 
 
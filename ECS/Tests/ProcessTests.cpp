@@ -35,6 +35,7 @@ SUITE(ProcessTests)
 		ecs::bitset aspectMask;
 		ecs::EntityList workingSet;
 		ecs::BucketsList buckets;
+		ecs::vector<uint64_t> matchBitmap;
 
 	public:
 
@@ -50,15 +51,27 @@ SUITE(ProcessTests)
 
 			remap.resize(maxEntityIndex, ecs::MapTuple::Invalid());
 
-			for (auto it = entities.cbegin(); it != entities.cend(); ++it)
+			ecs::MatchAspect(entities, aspectMask, matchBitmap);
+			for (uint32_t i = 0; i < (uint32_t)entities.size(); i++)
 			{
-				const ConstEntityId id = *it;
-				remap[it->u.index] = ecs::IsMatchAspect(id, aspectMask) ? ecs::MapTuple::Create(0, id) : ecs::MapTuple::Invalid();
+				const ConstEntityId id = entities[i];
+				bool isMatch = ((matchBitmap[i / 64] >> (i % 64)) & 1) != 0;
+				remap[id.u.index] = isMatch ? ecs::MapTuple::Create(0, id) : ecs::MapTuple::Invalid();
 			}
 
 			ecs::FoldAndReorder(remap, workingSet, buckets);
 		}
 
+		virtual size_t Trim(const ecs::TrimPolicy& policy) override
+		{
+			return ecs::trim_capacity(remap, policy) + ecs::trim_capacity(workingSet, policy);
+		}
+
+		size_t GetRemapCapacity() const
+		{
+			return remap.capacity();
+		}
+
 
 		virtual void Update(float deltaTime) override
 		{
@@ -88,7 +101,7 @@ SUITE(ProcessTests)
 	class TestProcess2 : public ecs::Process< ecs::Aspect<Pos> >
 	{
 		ecs::RemapList remap;
-		ecs::bitset aspectMask;
+		ecs::archetype_match_cache aspectCache;
 		ecs::EntityList workingSet;
 		ecs::BucketsList buckets;
 
@@ -96,8 +109,10 @@ SUITE(ProcessTests)
 
 		TestProcess2()
 		{
+			ecs::bitset aspectMask;
 			ecs::bitset tmp;
 			TAspect::GenerateMask(aspectMask, tmp);
+			aspectCache.reset(aspectMask);
 		}
 
 		virtual void ReMap(const ecs::ConstEntityList& entities, uint32_t maxEntityIndex) override
@@ -109,7 +124,7 @@ SUITE(ProcessTests)
 			for (auto it = entities.cbegin(); it != entities.cend(); ++it)
 			{
 				const ConstEntityId id = *it;
-				remap[it->u.index] = ecs::IsMatchAspect(id, aspectMask) ? ecs::MapTuple::Create(0, id) : ecs::MapTuple::Invalid();
+				remap[it->u.index] = ecs::IsMatchAspect(id, aspectCache) ? ecs::MapTuple::Create(0, id) : ecs::MapTuple::Invalid();
 			}
 
 			ecs::FoldAndReorder(remap, workingSet, buckets);
@@ -179,6 +194,576 @@ TEST(SimpleProcess)
 
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+TEST(BatchAspectMatch)
+{
+	ecs::DestroyAll();
+
+	const uint32_t count = 200000;
+	std::vector<EntityId> ids(count);
+	ecs::CreateEntities(ids.data(), count);
+
+	uint32_t seed = 777;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		uint32_t components = (seed >> 8);
+		if (components & 1)
+		{
+			ecs::AddComponent(ids[i], Pos(float(i), 0.0f));
+		}
+		if (components & 2)
+		{
+			ecs::AddComponent(ids[i], Velocity(1.0f, 0.0f));
+		}
+		if (components & 4)
+		{
+			ecs::AddComponent(ids[i], Stunned());
+		}
+	}
+
+	// stale ids (destroyed and reused indices) in the list
+	ecs::ConstEntityList list;
+	list.insert(list.end(), ids.begin(), ids.end());
+	for (uint32_t i = 0; i < count; i += 7)
+	{
+		ecs::DestroyEntity(ids[i]);
+	}
+	for (uint32_t i = 0; i < count; i += 14)
+	{
+		ecs::CreateEntity(Pos(0.0f, 0.0f), Velocity(0.0f, 0.0f), Stunned());
+	}
+
+	ecs::bitset aspectMask;
+	ecs::bitset tmp;
+	ecs::Aspect<Pos, const Velocity, const Stunned>::GenerateMask(aspectMask, tmp);
+
+	std::vector<ConstEntityId> expected;
+	for (auto it = list.cbegin(); it != list.cend(); ++it)
+	{
+		if (ecs::IsMatchAspect(*it, aspectMask))
+		{
+			expected.push_back(*it);
+		}
+	}
+
+	std::vector<ConstEntityId> matched(list.size());
+	uint32_t matchedCount = ecs::MatchAspect(list, aspectMask, matched.data());
+
+	CHECK(matchedCount == expected.size());
+	CHECK(matchedCount > 0);
+	for (uint32_t i = 0; i < matchedCount && i < expected.size(); i++)
+	{
+		CHECK(matched[i] == expected[i]);
+	}
+
+	ecs::vector<uint64_t> bitmap;
+	ecs::MatchAspect(list, aspectMask, bitmap);
+	CHECK(bitmap.size() == (list.size() + 63) / 64);
+	for (uint32_t i = 0; i < (uint32_t)list.size(); i++)
+	{
+		bool isMatch = ((bitmap[i / 64] >> (i % 64)) & 1) != 0;
+		CHECK(isMatch == ecs::IsMatchAspect(list[i], aspectMask));
+	}
+
+	// whole entities array (by entity index)
+	const ecs::ConstEntityList& activeList = ecs::GetActiveListConst();
+	ecs::MatchAspectAll(aspectMask, bitmap);
+	uint32_t matchedAll = 0;
+	for (size_t i = 0; i < bitmap.size(); i++)
+	{
+		for (uint64_t bits = bitmap[i]; bits != 0; bits &= bits - 1)
+		{
+			matchedAll++;
+		}
+	}
+	uint32_t expectedAll = 0;
+	for (auto it = activeList.cbegin(); it != activeList.cend(); ++it)
+	{
+		bool isMatch = ecs::IsMatchAspect(*it, aspectMask);
+		expectedAll += isMatch ? 1 : 0;
+		CHECK(isMatch == (((bitmap[it->u.index / 64] >> (it->u.index % 64)) & 1) != 0));
+	}
+	CHECK(matchedAll == expectedAll);
+
+	ecs::DestroyAll();
+}
+
+TEST(ArchetypeTableClear)
+{
+	ecs::bitset a;
+	a.set(1);
+	ecs::bitset b;
+	b.set(2);
+
+	ecs::archetype_table archetypes;
+	ecs::ArchetypeId idA = archetypes.intern(a);
+	CHECK(archetypes.intern(a) == idA);
+
+	ecs::archetype_match_cache cache(a);
+	cache.update(archetypes);
+	CHECK(cache.is_match(idA));
+
+	// same ids, different masks
+	archetypes.clear();
+	ecs::ArchetypeId idB = archetypes.intern(b);
+	CHECK(idB == idA);
+	cache.update(archetypes);
+	CHECK(!cache.is_match(idB));
+	CHECK(!cache.is_match(ecs::archetype_table::emptyArchetype));
+}
+
+TEST(ArchetypeInterning)
+{
+	const uint32_t count = 10000;
+
+	// archetypes are shared with the previous tests (never destroyed)
+	uint32_t initialArchetypesCount = ecs::GetArchetypesCount();
+
+	// a lot of entities, a few unique components masks
+	std::vector<EntityId> ids;
+	ids.reserve(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		EntityId id = ecs::CreateEntity(Pos(float(i), 0.0f));
+		if (i % 2)
+		{
+			ecs::AddComponent(id, Velocity(1.0f, 0.0f));
+		}
+		if (i % 3)
+		{
+			ecs::AddComponent(id, Stunned());
+		}
+		ids.push_back(id);
+	}
+
+	uint32_t archetypesCount = ecs::GetArchetypesCount();
+	CHECK(archetypesCount - initialArchetypesCount <= 4);
+
+	// add/remove/add go through the cached transitions, no new archetypes
+	for (uint32_t i = 1; i < count; i += 6)
+	{
+		if (i % 2)
+		{
+			ecs::RemoveComponent<Velocity>(ids[i]);
+			ecs::AddComponent(ids[i], Velocity(2.0f, 0.0f));
+		}
+	}
+	CHECK(ecs::GetArchetypesCount() == archetypesCount);
+
+	ecs::bitset aspectMask;
+	ecs::bitset tmp;
+	ecs::Aspect<Pos, const Velocity, const Stunned>::GenerateMask(aspectMask, tmp);
+
+	// per-archetype cached matching is equal to the mask test
+	ecs::archetype_match_cache cache(aspectMask);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		bool isMatch = (i % 2) != 0 && (i % 3) != 0;
+		CHECK(ecs::IsMatchAspect(ids[i], aspectMask) == isMatch);
+		CHECK(ecs::IsMatchAspect(ids[i], cache) == isMatch);
+	}
+
+	// new archetype after the cache was filled
+	ecs::AddComponent(ids[0], Velocity(1.0f, 0.0f));
+	ecs::RemoveComponent<Pos>(ids[0]);
+	CHECK(ecs::GetArchetypesCount() >= archetypesCount);
+	CHECK(ecs::IsMatchAspect(ids[0], cache) == false);
+	ecs::AddComponent(ids[0], Pos(0.0f, 0.0f));
+	ecs::AddComponent(ids[0], Stunned());
+	CHECK(ecs::IsMatchAspect(ids[0], cache) == true);
+
+	// hibernated entities keep the archetype
+	ecs::Hibernate(ids[1], false);
+	CHECK(ecs::IsMatchAspect(ids[1], cache) == false);
+	ecs::Wake(ids[1]);
+	CHECK(ecs::GetComponent<Velocity>(ids[1]) != nullptr);
+	CHECK(ecs::IsMatchAspect(ids[1], cache) == true);
+
+	ecs::DestroyAll();
+}
+
+TEST(TrimAfterMassDestruction)
+{
+	const float deltaTime = 0.016666f;
+
+	ecs::DestroyAll();
+	ecs::Update(deltaTime);
+
+	TestProcess process;
+
+	const uint32_t count = 50000;
+	std::vector<EntityId> ids;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		ids.push_back(ecs::CreateEntity(Pos(float(i), 0.0f), Velocity(1.0f, 0.0f)));
+	}
+	ecs::Update(deltaTime);
+	CHECK(process.GetRemapCapacity() >= count);
+
+	// despawn wave (keep first 1000 entities)
+	const uint32_t aliveCount = 1000;
+	for (uint32_t i = aliveCount; i < count; i++)
+	{
+		ecs::DestroyEntity(ids[i]);
+	}
+	ecs::Update(deltaTime);
+
+	ecs::ComponentsStorage<Pos>& storage = ecs::GetComponentStorage<Pos>();
+	CHECK(storage.size() == aliveCount);
+	CHECK(storage.capacity() >= count);
+
+	size_t reclaimedBytes = ecs::Trim();
+	CHECK(reclaimedBytes > 0);
+	CHECK(storage.capacity() < count);
+
+	// hysteresis: nothing to reclaim without changes
+	CHECK(ecs::Trim() == 0);
+
+	// alive entities are not affected
+	for (uint32_t i = 0; i < aliveCount; i++)
+	{
+		const Pos* pos = ecs::GetComponent<Pos>(ids[i]);
+		CHECK(pos != nullptr);
+		CHECK(pos->x > float(i) && pos->x < float(i + 1));
+	}
+	ecs::Update(deltaTime);
+
+	// full cleanup
+	ecs::DestroyAll();
+	ecs::Update(deltaTime);
+	CHECK(ecs::Trim(ecs::TrimPolicy(0.0f, 0)) > 0);
+	CHECK(storage.capacity() == 0);
+	CHECK(process.GetRemapCapacity() == 0);
+}
+
+	// Same as TestProcess, but for the structure-of-arrays components
+	class TestProcessSoA : public ecs::Process< ecs::Aspect<PosSoA, const VelocitySoA> >
+	{
+		ecs::RemapList remap;
+		ecs::bitset aspectMask;
+		ecs::EntityList workingSet;
+		ecs::BucketsList buckets;
+
+		// pos += vel * dt
+		static void Integrate(float* pos, const float* vel, uint32_t count, float deltaTime)
+		{
+			__m128 dt = _mm_set1_ps(deltaTime);
+
+			uint32_t i = 0;
+			for (; (i + 4) <= count; i += 4)
+			{
+				__m128 p = _mm_loadu_ps(pos + i);
+				__m128 v = _mm_loadu_ps(vel + i);
+				_mm_storeu_ps(pos + i, _mm_add_ps(p, _mm_mul_ps(v, dt)));
+			}
+
+			for (; i < count; i++)
+			{
+				pos[i] += vel[i] * deltaTime;
+			}
+		}
+
+	public:
+
+		TestProcessSoA()
+		{
+			ecs::bitset tmp;
+			TAspect::GenerateMask(aspectMask, tmp);
+		}
+
+		virtual void ReMap(const ecs::ConstEntityList& entities, uint32_t maxEntityIndex) override
+		{
+			remap.resize(maxEntityIndex, ecs::MapTuple::Invalid());
+
+			for (auto it = entities.cbegin(); it != entities.cend(); ++it)
+			{
+				const ConstEntityId id = *it;
+				remap[it->u.index] = ecs::IsMatchAspect(id, aspectMask) ? ecs::MapTuple::Create(0, id) : ecs::MapTuple::Invalid();
+			}
+
+			ecs::FoldAndReorder(remap, workingSet, buckets);
+		}
+
+		virtual void Update(float deltaTime) override
+		{
+			ecs::ComponentsStorage<PosSoA>& posStorage = ecs::GetComponentStorage<PosSoA>();
+			const ecs::ComponentsStorage<VelocitySoA>& velStorage = ecs::GetComponentStorage<VelocitySoA>();
+
+			ecs::field_span<float> posX = posStorage.field<0>();
+			ecs::field_span<float> posY = posStorage.field<1>();
+			ecs::field_span<const float> velX = velStorage.field<0>();
+			ecs::field_span<const float> velY = velStorage.field<1>();
+
+			// find runs of entities with consecutive components in both storages and integrate them as a whole
+			uint32_t count = ecs::narrow_cast<uint32_t>(workingSet.size());
+			for (uint32_t i = 0; i < count;)
+			{
+				int32_t firstPos = posStorage.index_of(workingSet[i]);
+				int32_t firstVel = velStorage.index_of(workingSet[i]);
+				assert(firstPos >= 0 && firstVel >= 0);
+
+				uint32_t runLength = 1;
+				while ((i + runLength) < count &&
+					posStorage.index_of(workingSet[i + runLength]) == firstPos + (int32_t)runLength &&
+					velStorage.index_of(workingSet[i + runLength]) == firstVel + (int32_t)runLength)
+				{
+					runLength++;
+				}
+
+				Integrate(posX.data + firstPos, velX.data + firstVel, runLength, deltaTime);
+				Integrate(posY.data + firstPos, velY.data + firstVel, runLength, deltaTime);
+
+				i += runLength;
+			}
+		}
+
+	};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+TEST(StructureOfArraysProcess)
+{
+	ecs::DestroyAll();
+	ecs::Update(1.0f);
+
+	std::vector<EntityId> ids;
+	for (int i = 0; i < 103; i++)
+	{
+		float v = (float)i;
+		if ((i % 10) == 7)
+		{
+			ids.push_back(ecs::CreateEntity(PosSoA(v, v)));
+		}
+		else
+		{
+			ids.push_back(ecs::CreateEntity(PosSoA(v, v), VelocitySoA(1.0f, -2.0f)));
+		}
+	}
+
+	TestProcessSoA process;
+
+	const int framesCount = 8;
+	for (int frame = 0; frame < framesCount; frame++)
+	{
+		ecs::Update(0.5f);
+
+		if (frame == 3)
+		{
+			ecs::OptimizeLayoutForCache();
+		}
+	}
+
+	for (size_t i = 0; i < ids.size(); i++)
+	{
+		const ecs::ComponentsStorage<PosSoA>& posStorage = ecs::GetComponentStorage<PosSoA>();
+		int32_t componentIndex = posStorage.index_of(ids[i]);
+		CHECK(componentIndex >= 0);
+
+		float v = (float)i;
+		float expectedX = v;
+		float expectedY = v;
+		if ((i % 10) != 7)
+		{
+			expectedX += 1.0f * 0.5f * framesCount;
+			expectedY += -2.0f * 0.5f * framesCount;
+		}
+
+		CHECK_CLOSE(posStorage.field<0>()[componentIndex], expectedX, 0.0001f);
+		CHECK_CLOSE(posStorage.field<1>()[componentIndex], expectedY, 0.0001f);
+	}
+}
+
+class StunProcess : public ecs::Process< ecs::Aspect<Dummy, const Stunned> >
+{
+	ecs::RemapList remap;
+	ecs::bitset aspectMask;
+	ecs::EntityList workingSet;
+	ecs::BucketsList buckets;
+
+public:
+
+	StunProcess()
+	{
+		// process entities with and without tag
+		aspectMask.set(ecs::GetComponentTypeIndex<Dummy>());
+	}
+
+	virtual void ReMap(const ecs::ConstEntityList& entities, uint32_t maxEntityIndex) override
+	{
+		remap.resize(maxEntityIndex, ecs::MapTuple::Invalid());
+
+		for (auto it = entities.cbegin(); it != entities.cend(); ++it)
+		{
+			const ConstEntityId id = *it;
+			remap[it->u.index] = ecs::IsMatchAspect(id, aspectMask) ? ecs::MapTuple::Create(0, id) : ecs::MapTuple::Invalid();
+		}
+
+		ecs::FoldAndReorder(remap, workingSet, buckets);
+	}
+
+	virtual void Update(float /*deltaTime*/) override
+	{
+		auto enumerator = ecs::CreateEnumerator<TAspect>(workingSet);
+		for (auto it = enumerator.begin(); it != enumerator.end(); ++it)
+		{
+			TAspect entityAspect = *it;
+
+			// toggle tag (deferred by the Dispatcher)
+			if (entityAspect.c1)
+			{
+				ecs::RemoveComponent<Stunned>(entityAspect.id);
+			}
+			else
+			{
+				ecs::AddComponent(entityAspect.id, Stunned());
+			}
+
+			entityAspect.c0->val++;
+		}
+	}
+
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+TEST(TagComponentsDeferred)
+{
+	ecs::DestroyAll();
+	ecs::Update(1.0f);
+
+	StunProcess process;
+
+	std::vector<EntityId> ids;
+	for (int i = 0; i < 10; i++)
+	{
+		if (i & 1)
+		{
+			ids.push_back(ecs::CreateEntity(Dummy(0), Stunned()));
+		}
+		else
+		{
+			ids.push_back(ecs::CreateEntity(Dummy(0)));
+		}
+	}
+
+	for (int frame = 0; frame < 5; frame++)
+	{
+		ecs::Update(1.0f);
+
+		for (int i = 0; i < 10; i++)
+		{
+			bool wasStunned = (i & 1) != 0;
+			bool isStunned = ((frame & 1) == 0) ? !wasStunned : wasStunned;
+			CHECK((ecs::GetComponent<Stunned>(ids[i]) != nullptr) == isStunned);
+			CHECK(ecs::GetComponent<Dummy>(ids[i])->val == (frame + 1));
+		}
+	}
+
+	ecs::DestroyAll();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+class DistanceWriteProcess : public ecs::Process< ecs::Aspect<Distance> >
+{
+	ecs::EntityList workingSet;
+
+public:
+
+	virtual void ReMap(const ecs::ConstEntityList& entities, uint32_t /*maxEntityIndex*/) override
+	{
+		workingSet.clear();
+		for (auto it = entities.cbegin(); it != entities.cend(); ++it)
+		{
+			workingSet.push_back(EntityId::internal::CreateFromConst(*it));
+		}
+	}
+
+	virtual void Update(float /*deltaTime*/) override
+	{
+		// write the current frame
+		for (TAspect view : ecs::CreateEnumerator<TAspect>(workingSet))
+		{
+			view.c0->value += 1.0f;
+		}
+	}
+};
+
+
+class DistanceReadProcess : public ecs::Process< ecs::Aspect<const Distance> >
+{
+	ecs::EntityList workingSet;
+
+public:
+
+	int frame;
+	int checksCount;
+
+	DistanceReadProcess()
+		: frame(0)
+		, checksCount(0)
+	{
+	}
+
+	virtual void ReMap(const ecs::ConstEntityList& entities, uint32_t /*maxEntityIndex*/) override
+	{
+		workingSet.clear();
+		for (auto it = entities.cbegin(); it != entities.cend(); ++it)
+		{
+			workingSet.push_back(EntityId::internal::CreateFromConst(*it));
+		}
+	}
+
+	virtual void Update(float /*deltaTime*/) override
+	{
+		// read the previous frame (the result does not depend on the order of processes)
+		for (TAspect view : ecs::CreateEnumerator<TAspect>(workingSet))
+		{
+			CHECK_CLOSE(view.c0->value, float(frame), 0.0001f);
+			checksCount++;
+		}
+		frame++;
+	}
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+TEST(DoubleBufferedComponents)
+{
+	ecs::DestroyAll();
+	ecs::Update(1.0f);
+
+	for (int i = 0; i < 10; i++)
+	{
+		ecs::CreateEntity(Distance(0.0f));
+	}
+
+	{
+		DistanceReadProcess readBefore;
+		DistanceWriteProcess write;
+		DistanceReadProcess readAfter;
+
+		for (int frame = 0; frame < 8; frame++)
+		{
+			ecs::Update(1.0f);
+		}
+
+		CHECK(readBefore.checksCount == 80);
+		CHECK(readAfter.checksCount == 80);
+	}
+
+	// the last frame is visible after flip
+	const ecs::EntityList& list = ecs::GetActiveList();
+	for (auto it = list.begin(); it != list.end(); ++it)
+	{
+		const Distance* distance = ecs::GetComponent<const Distance>(*it);
+		CHECK_CLOSE(distance->value, 8.0f, 0.0001f);
+	}
+
+	ecs::DestroyAll();
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 TEST(FoldAndReorder)
 {
@@ -459,11 +1044,16 @@ public:
 		}
 
 		ecs::FoldAndReorder(remap, workingSet, buckets);
+
+		// store components in the update order
+		ecs::OptimizeLayoutForProcess(workingSet, aspectMask);
 	}
 
 	virtual void Update(float /*deltaTime*/) override
 	{
 		int bucketIndex = 0;
+		const Pos* prevPos = nullptr;
+		const Dummy* prevDummy = nullptr;
 
 		// buckets must be updated in order
 		for (const ecs::Bucket& bucket : buckets)
@@ -500,6 +1090,15 @@ public:
 				// update current entity frame
 				dummy->val = currentFrame;
 
+				// components are stored in the update order (linear scan)
+				if (prevPos)
+				{
+					CHECK(prevPos + 1 == pos);
+					CHECK(prevDummy + 1 == dummy);
+				}
+				prevPos = pos;
+				prevDummy = dummy;
+
 			}
 
 			bucketIndex++;
@@ -539,4 +1138,67 @@ TEST(OrderedUpdateInsideProcess)
 }
 
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+TEST(OptimizeLayoutForProcessSharedStorage)
+{
+	ecs::DestroyAll();
+
+	const uint32_t count = 64;
+	std::vector<EntityId> ids;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		ids.push_back(ecs::CreateEntity(Pos(float(i), 0.0f), Dummy(int(i))));
+	}
+
+	// working sets of two processes: <Pos, Dummy> updated in the reverse order, <Pos> updated in the entities order
+	ecs::bitset maskA;
+	ecs::bitset maskB;
+	ecs::bitset tmp;
+	ecs::Aspect<Pos, Dummy>::GenerateMask(maskA, tmp);
+	ecs::Aspect<Pos>::GenerateMask(maskB, tmp);
+
+	ecs::EntityList orderA;
+	ecs::EntityList orderB;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		orderA.push_back(ids[count - 1 - i]);
+		orderB.push_back(ids[i]);
+	}
+
+	ecs::ComponentsStorage<Pos>& posStorage = ecs::GetComponentStorage<Pos>();
+	ecs::ComponentsStorage<Dummy>& dummyStorage = ecs::GetComponentStorage<Dummy>();
+
+	// the shared storage follows the last caller
+	ecs::OptimizeLayoutForProcess(orderA, maskA);
+	ecs::OptimizeLayoutForProcess(orderB, maskB);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		CHECK(posStorage.index_of(ids[i]) == (int32_t)i);
+		CHECK(dummyStorage.index_of(ids[i]) == (int32_t)(count - 1 - i));
+	}
+
+	ecs::OptimizeLayoutForProcess(orderA, maskA);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		CHECK(posStorage.index_of(ids[i]) == (int32_t)(count - 1 - i));
+	}
+
+	// cache optimization keeps the custom order
+	ecs::OptimizeLayoutForCache();
+	CHECK(posStorage.index_of(ids[0]) == (int32_t)(count - 1));
+	CHECK(dummyStorage.index_of(ids[0]) == (int32_t)(count - 1));
+
+	// until the storage is modified
+	ecs::RemoveComponent<Pos>(ids[count - 1]);
+	ecs::OptimizeLayoutForCache();
+	for (uint32_t i = 0; i < count - 1; i++)
+	{
+		CHECK(posStorage.index_of(ids[i]) == (int32_t)i);
+		CHECK(dummyStorage.index_of(ids[i]) == (int32_t)(count - 1 - i));
+	}
+
+	ecs::DestroyAll();
+}
+
+
 }
@@ -22,6 +22,7 @@
 
 #include <UnitTest++.h>
 #include <ECS.h>
+#include <algorithm>
 #include "TestComponents.h"
 
 
@@ -32,7 +33,7 @@ SUITE(SimpleTests)
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 TEST(BitSetSimple)
 {
-	ecs::bitset bset;
+	ecs::basic_bitset<384> bset;
 
 	CHECK(bset.get(1) == false);
 	bset.set(1);
@@ -173,7 +174,7 @@ TEST(BitSetSimple)
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 TEST(BitSetIterator)
 {
-	ecs::bitset bset;
+	ecs::basic_bitset<384> bset;
 
 	CHECK(bset.get(0) == false);
 	bset.set(0);
@@ -236,7 +237,7 @@ TEST(BitSetIterator)
 	bset.clear();
 
 	std::vector<uint32_t> randomSequence;
-	for (int bitIndex = 0; bitIndex < ecs::bitset::MaxBitCount::value; bitIndex++)
+	for (int bitIndex = 0; bitIndex < ecs::basic_bitset<384>::MaxBitCount::value; bitIndex++)
 	{
 		if ((rand() % 1024) < 512)
 		{
@@ -271,8 +272,8 @@ TEST(BitSetIterator)
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 TEST(BitSetContains)
 {
-	ecs::bitset bset1;
-	ecs::bitset bset2;
+	ecs::basic_bitset<384> bset1;
+	ecs::basic_bitset<384> bset2;
 
 	bset1.set(2);
 	CHECK(bset1.get(2) == true);
@@ -317,6 +318,183 @@ TEST(BitSetContains)
 }
 
 
+template<uint32_t BITS>
+void CheckBitSetWidth()
+{
+	typedef ecs::basic_bitset<BITS> bitset_type;
+	static_assert(sizeof(bitset_type) == BITS / 8, "Invalid bitset size");
+
+	std::vector<bitset_type> masks(256);
+	std::vector<std::vector<uint32_t>> enabledBits(masks.size());
+	for (size_t i = 0; i < masks.size(); i++)
+	{
+		for (uint32_t bitIndex = 0; bitIndex < BITS; bitIndex++)
+		{
+			if ((rand() % 1024) < 64)
+			{
+				masks[i].set(bitIndex);
+				enabledBits[i].push_back(bitIndex);
+			}
+		}
+	}
+
+	// iterator
+	for (size_t i = 0; i < masks.size(); i++)
+	{
+		std::vector<uint32_t> bits;
+		for (auto it = masks[i].begin(); it != masks[i].end(); ++it)
+		{
+			bits.push_back(*it);
+		}
+		CHECK(bits == enabledBits[i]);
+	}
+
+	// contains / matcher (aspects are subsets of some masks)
+	for (size_t i = 0; i < masks.size(); i++)
+	{
+		bitset_type aspect;
+		for (size_t j = 0; j < enabledBits[i].size(); j += 3)
+		{
+			aspect.set(enabledBits[i][j]);
+		}
+		aspect.set(BITS - 1);
+
+		ecs::basic_bitset_matcher<BITS> matcher(aspect);
+		for (size_t j = 0; j < masks.size(); j++)
+		{
+			bool isMatch = true;
+			for (auto it = aspect.begin(); it != aspect.end(); ++it)
+			{
+				isMatch &= masks[j].get(*it);
+			}
+			CHECK(masks[j].contains(aspect) == isMatch);
+			CHECK(matcher.match(masks[j]) == isMatch);
+		}
+
+		bitset_type superset = masks[i];
+		for (auto it = aspect.begin(); it != aspect.end(); ++it)
+		{
+			superset.set(*it);
+		}
+		CHECK(superset.contains(aspect));
+		CHECK(matcher.match_block(&superset, 1) == 1);
+	}
+
+	// excluded / any-of masks (single pass matcher vs scalar rule)
+	for (size_t i = 0; i < masks.size(); i++)
+	{
+		const bitset_type& aspect = masks[i];
+		const bitset_type& excluded = masks[(i + 1) % masks.size()];
+		const bitset_type& anyOf = masks[(i + 2) % masks.size()];
+
+		ecs::basic_bitset_matcher<BITS> matcher(aspect, excluded, anyOf);
+		ecs::basic_bitset_matcher<BITS> noAnyOfMatcher(aspect, excluded, bitset_type());
+		for (size_t j = 0; j < masks.size(); j++)
+		{
+			bitset_type mask = masks[j];
+			if (j % 2)
+			{
+				// make the required test pass to test the rest
+				for (auto it = aspect.begin(); it != aspect.end(); ++it)
+				{
+					mask.set(*it);
+				}
+			}
+			if (j % 4 == 1)
+			{
+				for (auto it = excluded.begin(); it != excluded.end(); ++it)
+				{
+					mask.reset(*it);
+				}
+			}
+
+			bool isRequired = mask.contains(aspect) && !mask.intersects(excluded);
+			CHECK(matcher.match(mask) == (isRequired && (anyOf.empty() || mask.intersects(anyOf))));
+			CHECK(noAnyOfMatcher.match(mask) == isRequired);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+TEST(BitSetWidths)
+{
+	CheckBitSetWidth<64>();
+	CheckBitSetWidth<128>();
+	CheckBitSetWidth<256>();
+	CheckBitSetWidth<384>();
+	CheckBitSetWidth<512>();
+	CheckBitSetWidth<1024>();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+TEST(SimdKernels)
+{
+	ecs::SimdLevel::Type simdLevel = ecs::GetSimdLevel();
+	CHECK(simdLevel < ecs::SimdLevel::COUNT);
+	CHECK(ecs::GetSimdLevelName(simdLevel) != nullptr);
+	CHECK(ecs::internal::GetMatchMasksKernel(simdLevel) != nullptr);
+
+	for (uint32_t i = 0; i < 32; i++)
+	{
+		CHECK(ecs::internal::BitScanForward(1u << i) == i);
+		CHECK(ecs::internal::BitScanForward(0x80000000u | (1u << i)) == i);
+	}
+
+	std::vector<ecs::bitset> masks(512);
+	for (size_t i = 0; i < masks.size(); i++)
+	{
+		for (uint32_t bitIndex = 0; bitIndex < ecs::bitset::MaxBitCount::value; bitIndex++)
+		{
+			if ((rand() % 1024) < 48)
+			{
+				masks[i].set(bitIndex);
+			}
+		}
+	}
+
+	std::vector<uint8_t> results(masks.size());
+	for (size_t i = 0; i < 64; i++)
+	{
+		// required = subset of some mask, the rest is random
+		ecs::aspect_filter filter;
+		for (auto it = masks[i].begin(); it != masks[i].end(); ++it)
+		{
+			if (rand() % 4 == 0)
+			{
+				filter.required.set(*it);
+			}
+		}
+		if (i % 2)
+		{
+			filter.excluded.set(rand() % ecs::bitset::MaxBitCount::value);
+		}
+		if (i % 3)
+		{
+			filter.anyOf.set(rand() % ecs::bitset::MaxBitCount::value);
+			filter.anyOf.set(rand() % ecs::bitset::MaxBitCount::value);
+		}
+
+		// every kernel supported by this CPU
+		for (int level = ecs::SimdLevel::SSE2; level <= simdLevel; level++)
+		{
+			ecs::internal::MatchMasksFunc kernel = ecs::internal::GetMatchMasksKernel((ecs::SimdLevel::Type)level);
+			CHECK(kernel != nullptr);
+
+			std::fill(results.begin(), results.end(), uint8_t(0xFF));
+			kernel(filter, masks.data(), (uint32_t)masks.size(), results.data());
+			for (size_t j = 0; j < masks.size(); j++)
+			{
+				CHECK(results[j] == (filter.match(masks[j]) ? 1 : 0));
+			}
+		}
+
+		ecs::internal::MatchMasks(filter, masks.data(), (uint32_t)masks.size(), results.data());
+		CHECK(results[i] == (filter.match(masks[i]) ? 1 : 0));
+	}
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 TEST(CreateAndDestroy)
 {
@@ -448,6 +626,134 @@ TEST(SimpleComponentTest)
 }
 
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+TEST(TagComponentTest)
+{
+	ecs::DestroyAll();
+
+	EntityId id1 = ecs::CreateEntity(PositionComponent(1.0f, 2.0f), Visible());
+	EntityId id2 = ecs::CreateEntity(PositionComponent(3.0f, 4.0f), Visible(), Stunned());
+	EntityId id3 = ecs::CreateEntity(PositionComponent(5.0f, 6.0f));
+
+	CHECK(ecs::GetComponent<Visible>(id1) != nullptr);
+	CHECK(ecs::GetComponent<Stunned>(id1) == nullptr);
+	CHECK(ecs::GetComponent<Visible>(id2) != nullptr);
+	CHECK(ecs::GetComponent<Stunned>(id2) != nullptr);
+	CHECK(ecs::GetComponent<Visible>(id3) == nullptr);
+	CHECK(ecs::GetComponent<Stunned>(id3) == nullptr);
+
+	// tags are not registered as regular storages
+	CHECK(ecs::GetStorageDirectory()[ecs::GetComponentTypeIndex<Visible>()] == nullptr);
+
+	typedef ecs::Aspect<const PositionComponent, const Visible> TAspect;
+	ecs::bitset aspectMask;
+	ecs::bitset tmp;
+	TAspect::GenerateMask(aspectMask, tmp);
+
+	CHECK(ecs::IsMatchAspect(id1, aspectMask) == true);
+	CHECK(ecs::IsMatchAspect(id2, aspectMask) == true);
+	CHECK(ecs::IsMatchAspect(id3, aspectMask) == false);
+
+	TAspect aspect1 = TAspect::Create(id1);
+	CHECK(aspect1.c0 != nullptr);
+	CHECK(aspect1.c1 != nullptr);
+
+	ecs::RemoveComponent<Visible>(id1);
+	ecs::AddComponent(id3, Visible());
+
+	CHECK(ecs::GetComponent<Visible>(id1) == nullptr);
+	CHECK(ecs::GetComponent<Visible>(id3) != nullptr);
+	CHECK(ecs::IsMatchAspect(id1, aspectMask) == false);
+	CHECK(ecs::IsMatchAspect(id3, aspectMask) == true);
+
+	ecs::DestroyEntity(id2);
+	CHECK(!ecs::IsValid(id2));
+
+	ecs::DestroyAll();
+	CHECK(ecs::GetComponentStorage<PositionComponent>().empty());
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+TEST(AspectFilterTest)
+{
+	ecs::DestroyAll();
+
+	EntityId id1 = ecs::CreateEntity(PositionComponent(1.0f, 2.0f), Visible());
+	EntityId id2 = ecs::CreateEntity(PositionComponent(3.0f, 4.0f), Visible(), Stunned());
+	EntityId id3 = ecs::CreateEntity(PositionComponent(5.0f, 6.0f));
+	EntityId id4 = ecs::CreateEntity(PositionComponent(7.0f, 8.0f), RotationComponent(1.0f));
+
+	// has position, but not stunned
+	typedef ecs::Aspect<const PositionComponent, ecs::Without<Stunned>> TAwakeAspect;
+	ecs::aspect_filter awake;
+	ecs::bitset tmp;
+	TAwakeAspect::GenerateMask(awake, tmp);
+	CHECK(awake.required.get(ecs::GetComponentTypeIndex<PositionComponent>()));
+	CHECK(awake.excluded.get(ecs::GetComponentTypeIndex<Stunned>()));
+	CHECK(awake.anyOf.empty());
+
+	CHECK(ecs::IsMatchAspect(id1, awake) == true);
+	CHECK(ecs::IsMatchAspect(id2, awake) == false);
+	CHECK(ecs::IsMatchAspect(id3, awake) == true);
+	CHECK(ecs::IsMatchAspect(id4, awake) == true);
+
+	TAwakeAspect aspect = TAwakeAspect::Create(id1);
+	CHECK(aspect.c0 != nullptr);
+	CHECK(aspect.c1 == nullptr);
+
+	// has position and (visible or rotation), but not stunned
+	typedef ecs::Aspect<const PositionComponent, ecs::AnyOf<Visible, RotationComponent>, ecs::Without<Stunned>> TShownAspect;
+	ecs::aspect_filter shown;
+	TShownAspect::GenerateMask(shown, tmp);
+
+	CHECK(ecs::IsMatchAspect(id1, shown) == true);
+	CHECK(ecs::IsMatchAspect(id2, shown) == false);
+	CHECK(ecs::IsMatchAspect(id3, shown) == false);
+	CHECK(ecs::IsMatchAspect(id4, shown) == true);
+
+	// SIMD matcher / batch matching give the same results
+	ecs::bitset_matcher matcher = shown.matcher();
+	ecs::ConstEntityList list;
+	list.push_back(id1);
+	list.push_back(id2);
+	list.push_back(id3);
+	list.push_back(id4);
+
+	ecs::vector<uint64_t> bitmap;
+	ecs::MatchAspect(list, shown, bitmap);
+	CHECK(bitmap.size() == 1);
+	CHECK(bitmap[0] == ((1 << 0) | (1 << 3)));
+
+	ecs::archetype_match_cache cache(shown);
+	for (uint32_t i = 0; i < list.size(); i++)
+	{
+		ecs::bitset mask;
+		mask.set(ecs::GetComponentTypeIndex<PositionComponent>());
+		if (i == 0 || i == 1)
+		{
+			mask.set(ecs::GetComponentTypeIndex<Visible>());
+		}
+		if (i == 1)
+		{
+			mask.set(ecs::GetComponentTypeIndex<Stunned>());
+		}
+		if (i == 3)
+		{
+			mask.set(ecs::GetComponentTypeIndex<RotationComponent>());
+		}
+		CHECK(matcher.match(mask) == shown.match(mask));
+		CHECK(ecs::IsMatchAspect(list[i], cache) == ecs::IsMatchAspect(list[i], shown));
+	}
+
+	ecs::RemoveComponent<Stunned>(id2);
+	CHECK(ecs::IsMatchAspect(id2, shown) == true);
+	CHECK(ecs::IsMatchAspect(id2, cache) == true);
+
+	ecs::DestroyAll();
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 TEST(EntityAspectTest)
 {
@@ -641,9 +947,216 @@ TEST(GetActiveListTest)
 }
 
 
+TEST(ChangeVersionsTest)
+{
+	ecs::DestroyAll();
+	ecs::Update(1.0f);
+
+	uint32_t createFrame = ecs::GetFrameIndex();
+
+	std::vector<EntityId> ids;
+	for (int i = 0; i < 100; i++)
+	{
+		ids.push_back(ecs::CreateEntity(Pos(float(i), 0.0f), Velocity(0.0f, 1.0f)));
+	}
+
+	ecs::Update(1.0f);
+	uint32_t frame = ecs::GetFrameIndex();
+	CHECK(frame > createFrame);
+
+	typedef ecs::Aspect<const Pos> TConstAspect;
+	typedef ecs::Aspect<Pos> TAspect;
+
+	int changedCount = 0;
+	for (TConstAspect view : ecs::CreateChangedEnumerator<TConstAspect, Pos>(ecs::GetActiveList(), createFrame))
+	{
+		CHECK(view.c0 != nullptr);
+		changedCount++;
+	}
+	CHECK(changedCount == 100);
+
+	changedCount = 0;
+	for (TConstAspect view : ecs::CreateChangedEnumerator<TConstAspect, Pos>(ecs::GetActiveList(), frame))
+	{
+		CHECK(view.c0 != nullptr);
+		changedCount++;
+	}
+	CHECK(changedCount == 0);
+
+	// read-only access
+	const Pos* pos = ecs::GetComponent<const Pos>(ids[5]);
+	CHECK(pos != nullptr);
+	CHECK(!ecs::IsChangedSince<Pos>(ids[5], frame));
+
+	// write access
+	ecs::GetComponent<Pos>(ids[3])->x = 5.0f;
+	ecs::MarkChanged<Pos>(ids[7]);
+	TAspect::Create(ids[11]).c0->y = 1.0f;
+
+	CHECK(ecs::IsChangedSince<Pos>(ids[3], frame));
+	CHECK(!ecs::IsChangedSince<Velocity>(ids[3], frame));
+
+	std::vector<EntityId> changedIds;
+	for (TConstAspect view : ecs::CreateChangedEnumerator<TConstAspect, Pos>(ecs::GetActiveList(), frame))
+	{
+		changedIds.push_back(view.id);
+	}
+	std::sort(changedIds.begin(), changedIds.end(), [](const EntityId& a, const EntityId& b)
+	{
+		return a.u.index < b.u.index;
+	});
+	CHECK(changedIds.size() == 3);
+	if (changedIds.size() == 3)
+	{
+		CHECK(changedIds[0] == ids[3]);
+		CHECK(changedIds[1] == ids[7]);
+		CHECK(changedIds[2] == ids[11]);
+	}
+
+	// versions are preserved by storage layout changes
+	ecs::RemoveComponent<Pos>(ids[0]);
+	ecs::OptimizeLayoutForCache();
+	CHECK(ecs::IsChangedSince<Pos>(ids[7], frame));
+	CHECK(!ecs::IsChangedSince<Pos>(ids[8], frame));
+
+	ecs::DestroyAll();
+}
+
+
+TEST(HibernateTest)
+{
+	ecs::DestroyAll();
+
+	std::vector<EntityId> ids;
+	for (int i = 0; i < 100; i++)
+	{
+		EntityId id = ecs::CreateEntity(Pos(float(i), -float(i)), Dummy(i));
+		if (i % 3 == 0)
+		{
+			ecs::AddComponents(id, Velocity(1.0f, float(i)), Material(i % 2), Stunned());
+		}
+		ids.push_back(id);
+	}
+
+	// hibernate all even entities (half of them without compression)
+	for (int i = 0; i < 100; i += 2)
+	{
+		ecs::Hibernate(ids[i], (i % 4) == 0);
+	}
+
+	CHECK(ecs::GetActiveList().size() == 50);
+	CHECK(ecs::GetComponentStorage<Pos>().size() == 50);
+	CHECK(ecs::GetComponentStorage<Dummy>().size() == 50);
+	CHECK(ecs::GetComponentStorage<Velocity>().size() == 17);
+	CHECK(ecs::GetComponentStorage<Material>().size() == 17);
+
+	// hibernated entities are not visible to processes
+	ecs::bitset posMask;
+	posMask.set(ecs::GetComponentTypeIndex<Pos>());
+
+	for (int i = 0; i < 100; i++)
+	{
+		CHECK(ecs::IsValid(ids[i]));
+		CHECK(ecs::IsHibernated(ids[i]) == ((i % 2) == 0));
+		CHECK((ecs::GetComponent<Pos>(ids[i]) == nullptr) == ((i % 2) == 0));
+		CHECK(ecs::IsMatchAspect(ids[i], posMask) == ((i % 2) != 0));
+	}
+
+	// even the filter without the required components doesn't match the hibernated entities
+	ecs::aspect_filter notStunned;
+	notStunned.excluded.set(ecs::GetComponentTypeIndex<Stunned>());
+	ecs::archetype_match_cache notStunnedCache(notStunned);
+	ecs::vector<uint64_t> bitmap;
+	ecs::MatchAspectAll(notStunned, bitmap);
+	for (int i = 0; i < 100; i++)
+	{
+		bool isMatch = ((i % 2) != 0) && ((i % 3) != 0);
+		CHECK(ecs::IsMatchAspect(ids[i], notStunned) == isMatch);
+		CHECK(ecs::IsMatchAspect(ids[i], notStunnedCache) == isMatch);
+		CHECK(((bitmap[ids[i].u.index / 64] >> (ids[i].u.index % 64)) & 1) == (isMatch ? 1u : 0u));
+	}
+
+	// destroy some hibernated entities
+	ecs::DestroyEntity(ids[0]);
+	ecs::DestroyEntity(ids[2]);
+	CHECK(!ecs::IsValid(ids[0]));
+	CHECK(!ecs::IsValid(ids[2]));
+
+	// wake the rest
+	for (int i = 4; i < 100; i += 2)
+	{
+		ecs::Wake(ids[i]);
+	}
+	CHECK(ecs::GetActiveList().size() == 98);
+
+	for (int i = 4; i < 100; i++)
+	{
+		CHECK(!ecs::IsHibernated(ids[i]));
+
+		const Pos* pos = ecs::GetComponent<const Pos>(ids[i]);
+		const Dummy* dummy = ecs::GetComponent<const Dummy>(ids[i]);
+		CHECK(pos != nullptr && dummy != nullptr);
+		CHECK_CLOSE(pos->x, float(i), 0.0001f);
+		CHECK_CLOSE(pos->y, -float(i), 0.0001f);
+		CHECK(dummy->val == i);
+
+		const Velocity* vel = ecs::GetComponent<const Velocity>(ids[i]);
+		const Material* material = ecs::GetComponent<const Material>(ids[i]);
+		const Stunned* stunned = ecs::GetComponent<const Stunned>(ids[i]);
+		if (i % 3 == 0)
+		{
+			CHECK(vel != nullptr && material != nullptr && stunned != nullptr);
+			CHECK_CLOSE(vel->y, float(i), 0.0001f);
+			CHECK(material->id == uint32_t(i % 2));
+		}
+		else
+		{
+			CHECK(vel == nullptr && material == nullptr && stunned == nullptr);
+		}
+	}
+	CHECK(ecs::GetComponentStorage<Material>().unique_count() == 2);
 
+	// destroy all with some hibernated entities
+	ecs::Hibernate(ids[10]);
+	ecs::Hibernate(ids[11], false);
+	ecs::DestroyAll();
+	CHECK(ecs::GetComponentStorage<Pos>().empty());
+	CHECK(ecs::GetComponentStorage<Material>().unique_count() == 0);
 }
 
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+TEST(HibernateAlignedComponents)
+{
+	ecs::DestroyAll();
 
+	std::vector<EntityId> ids;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		ids.push_back(ecs::CreateEntity(Pos(float(i), 0.0f), WideAligned(i)));
+	}
 
+	// cold block has the alignment of the most aligned component
+	WideAligned::misalignedMovesCount = 0;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		ecs::Hibernate(ids[i], false);
+	}
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		ecs::Wake(ids[i]);
+	}
+	CHECK(WideAligned::misalignedMovesCount == 0);
+
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		const WideAligned* pComponent = ecs::GetComponent<const WideAligned>(ids[i]);
+		CHECK(pComponent != nullptr && pComponent->value == i);
+		CHECK(((uintptr_t)pComponent % 128) == 0);
+	}
+
+	ecs::DestroyAll();
+}
+
+
+}
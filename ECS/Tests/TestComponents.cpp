@@ -31,4 +31,24 @@ ECS_IMPLEMENT_COMPONENT_META(Dummy);
 ECS_IMPLEMENT_COMPONENT_META(PositionComponent);
 ECS_IMPLEMENT_COMPONENT_META(RotationComponent);
 ECS_IMPLEMENT_COMPONENT_META(ParentComponent);
+ECS_IMPLEMENT_COMPONENT_META(PosSoA);
+ECS_IMPLEMENT_COMPONENT_META(VelocitySoA);
+ECS_IMPLEMENT_COMPONENT_META(Particle);
+ECS_IMPLEMENT_COMPONENT_META(ParticleChunked);
+ECS_IMPLEMENT_COMPONENT_META(ParticleReserved);
+ECS_IMPLEMENT_COMPONENT_META(Material);
+ECS_IMPLEMENT_COMPONENT_META(Block16);
+ECS_IMPLEMENT_COMPONENT_META(Block64);
+ECS_IMPLEMENT_COMPONENT_META(Block64Movable);
+ECS_IMPLEMENT_COMPONENT_META(Block256);
+ECS_IMPLEMENT_COMPONENT_META(OwnedValue);
+ECS_IMPLEMENT_COMPONENT_META(Vec3);
+ECS_IMPLEMENT_COMPONENT_META(Segment);
+ECS_IMPLEMENT_COMPONENT_META(IsolatedCounter);
+ECS_IMPLEMENT_COMPONENT_META(WideAligned);
+ECS_IMPLEMENT_COMPONENT_META(Distance);
+ECS_IMPLEMENT_COMPONENT_META(Stunned);
+ECS_IMPLEMENT_COMPONENT_META(Visible);
 
+
+uint32_t WideAligned::misalignedMovesCount = 0;
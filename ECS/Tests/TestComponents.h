@@ -21,7 +21,9 @@
 // 	THE SOFTWARE.
 #pragma once
 
-#include <EntityId.h>
+#include <memory>
+#include <EntityID.h>
+#include <ComponentTraits.h>
 
 struct DummyComponent
 {
@@ -141,3 +143,303 @@ struct ParentComponent
 	}
 };
 
+
+
+struct PosSoA
+{
+	float x;
+	float y;
+
+	PosSoA(float _x, float _y)
+		: x(_x)
+		, y(_y)
+	{
+	}
+};
+
+ECS_DECLARE_COMPONENT_SOA(PosSoA, &PosSoA::x, &PosSoA::y);
+
+
+
+struct VelocitySoA
+{
+	float x;
+	float y;
+
+	VelocitySoA(float _x, float _y)
+		: x(_x)
+		, y(_y)
+	{
+	}
+};
+
+ECS_DECLARE_COMPONENT_SOA(VelocitySoA, &VelocitySoA::x, &VelocitySoA::y);
+
+
+
+struct Particle
+{
+	float x;
+	float y;
+	float z;
+	float w;
+
+	Particle(float v)
+		: x(v)
+		, y(v)
+		, z(v)
+		, w(v)
+	{
+	}
+};
+
+
+
+struct ParticleChunked
+{
+	float x;
+	float y;
+	float z;
+	float w;
+
+	ParticleChunked(float v)
+		: x(v)
+		, y(v)
+		, z(v)
+		, w(v)
+	{
+	}
+};
+
+ECS_DECLARE_COMPONENT_CHUNKED(ParticleChunked, 4096);
+
+
+
+struct ParticleReserved
+{
+	float x;
+	float y;
+	float z;
+	float w;
+
+	ParticleReserved(float v)
+		: x(v)
+		, y(v)
+		, z(v)
+		, w(v)
+	{
+	}
+};
+
+ECS_DECLARE_COMPONENT_RESERVED(ParticleReserved);
+
+
+
+struct Material
+{
+	float params[15];
+	uint32_t id;
+
+	Material(uint32_t _id)
+		: id(_id)
+	{
+		for (int i = 0; i < 15; i++)
+		{
+			params[i] = float(_id) + float(i);
+		}
+	}
+};
+
+ECS_DECLARE_COMPONENT_SHARED(Material);
+
+
+
+// 16 bytes, trivially copyable
+struct Block16
+{
+	float values[4];
+
+	Block16(float v)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			values[i] = v;
+		}
+	}
+};
+
+// 64 bytes, trivially copyable (relocatable by default)
+struct Block64
+{
+	float values[16];
+
+	Block64(float v)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			values[i] = v;
+		}
+	}
+};
+
+// 64 bytes, user-defined move (not relocatable)
+struct Block64Movable
+{
+	float values[16];
+
+	Block64Movable(float v)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			values[i] = v;
+		}
+	}
+
+	Block64Movable(Block64Movable&& other)
+	{
+		*this = std::move(other);
+	}
+
+	Block64Movable& operator=(Block64Movable&& other)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			values[i] = other.values[i];
+		}
+		return *this;
+	}
+};
+
+// 256 bytes, trivially copyable
+struct Block256
+{
+	float values[64];
+
+	Block256(float v)
+	{
+		for (int i = 0; i < 64; i++)
+		{
+			values[i] = v;
+		}
+	}
+};
+
+// 12 bytes (densely packed)
+struct Vec3
+{
+	float x;
+	float y;
+	float z;
+
+	Vec3(float v)
+		: x(v)
+		, y(v)
+		, z(v)
+	{
+	}
+};
+
+// 24 bytes
+struct Segment
+{
+	Vec3 a;
+	Vec3 b;
+
+	Segment(float v)
+		: a(v)
+		, b(-v)
+	{
+	}
+};
+
+// one cache line per component (written from different threads)
+struct IsolatedCounter
+{
+	uint32_t value;
+	uint8_t padding[60];
+
+	IsolatedCounter(uint32_t v)
+		: value(v)
+	{
+	}
+};
+
+ECS_DECLARE_COMPONENT_ALIGNMENT(IsolatedCounter, 64);
+
+// 128 byte aligned, counts the moves from/to the misaligned addresses
+struct WideAligned
+{
+	uint32_t value;
+	uint8_t padding[124];
+
+	static uint32_t misalignedMovesCount;
+
+	WideAligned(uint32_t v)
+		: value(v)
+	{
+	}
+
+	WideAligned(WideAligned&& other)
+		: value(other.value)
+	{
+		check_alignment(this);
+		check_alignment(&other);
+	}
+
+	WideAligned& operator=(WideAligned&& other)
+	{
+		value = other.value;
+		check_alignment(this);
+		check_alignment(&other);
+		return *this;
+	}
+
+	static void check_alignment(const void* p)
+	{
+		if (((uintptr_t)p % 128) != 0)
+		{
+			misalignedMovesCount++;
+		}
+	}
+};
+
+ECS_DECLARE_COMPONENT_ALIGNMENT(WideAligned, 128);
+
+// owns memory, but can be relocated by memcpy
+struct OwnedValue
+{
+	std::unique_ptr<uint32_t> value;
+
+	OwnedValue(uint32_t v)
+		: value(new uint32_t(v))
+	{
+	}
+};
+
+ECS_DECLARE_COMPONENT_RELOCATABLE(OwnedValue);
+
+
+
+struct Distance
+{
+	float value;
+
+	Distance(float _value)
+		: value(_value)
+	{
+	}
+};
+
+ECS_DECLARE_COMPONENT_DOUBLE_BUFFERED(Distance);
+
+
+
+// Tag components (no data)
+struct Stunned
+{
+};
+
+struct Visible
+{
+};
+
@@ -1,5 +1,8 @@
 -- build script
 
+isPosix = (os.get() == "linux" or os.get() == "bsd")
+isOSX = (os.get() == "macosx")
+
 solution "ECS"
 	language "C++"
 
@@ -58,13 +61,16 @@ configuration "x32"
 	flags {
 		"EnableSSE2",
 	}
+
+configuration "vs*"
 	defines {
 		"WIN32",
 	}
 
-configuration "x64"
-	defines {
-		"WIN32",
+-- GCC / Clang
+configuration { "gmake" }
+	buildoptions {
+		"-std=c++14",
 	}
 
 --  give each configuration/platform a unique output/target directory
@@ -133,5 +139,41 @@ project "ECSTest"
 		"ECS",
 	}
 
+	configuration { "gmake" }
+		links {
+			"pthread",
+		}
+
+
+-- the same tests with the virtual memory reserved entity storage
+project "ECSTestReserved"
+	kind "ConsoleApp"
+
+	flags {
+		"NoPCH",
+	}
+
+	defines {
+		"ECS_RESERVED_ENTITY_STORAGE=1",
+	}
 
+	files {
+		"ECS/Source/**.*",
+		"ECS/Include/**.*",
+		"ECS/Tests/**.*",
+	}
+
+	includedirs {
+		"ECS/Source/",
+		"ECS/Include/",
+		"ThirdParty/UnitTest++/UnitTest++",
+	}
+
+	links {
+		"UnitTest++",
+	}
 
+	configuration { "gmake" }
+		links {
+			"pthread",
+		}